@@ -0,0 +1,269 @@
+#ifndef MATRIX_MULTIPROCESSING_ASYNC_H
+#define MATRIX_MULTIPROCESSING_ASYNC_H
+
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "MatrixCalculator.h"
+#include "ThreadPool.h"
+
+/**
+ *  C++20 coroutines on the ThreadPool, so matrix operations compose without a thread blocked per operation.
+ *
+ *  Task<T> is lazy: calling a coroutine that returns one only allocates its frame, the body runs when the task
+ *  is awaited. co_await schedule(pool) moves the coroutine onto a pool worker (one post, no future, no thread),
+ *  and when a task finishes it resumes whoever awaited it directly (symmetric transfer), so a chain of awaits
+ *  runs on one worker without growing its stack.
+ *
+ *      Task<> addThenMultiply(MatrixCalculator &sum, MatrixCalculator &product) {
+ *          co_await asyncAdd(sum);
+ *          product.setMatrices(sum.takeResult(), ...);
+ *          co_await asyncMultiply(product);
+ *      }
+ *      syncWait(pool, whenAll(pool, std::move(tasks)));
+ *
+ *  whenAll runs tasks concurrently and resumes the caller when the last one finishes, syncWait is the only place
+ *  a thread waits, and it runs pool tasks while it does, so it works on a pool without workers too. An awaited
+ *  operation runs on a worker, so its kernel follows the rules for nested parallel calls: gemm and transpose
+ *  still split across the pool, the statically scheduled element-wise kernels run on that one worker.
+ */
+
+template<typename T = void>
+class Task;
+
+
+// Detached coroutine: starts at once, frees itself at the end, exceptions must not escape it
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept { }
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+
+// What every Task promise has: the coroutine to resume at the end and the exception it ended with
+class TaskPromiseBase {
+private:
+    // Resumes the awaiting coroutine directly instead of returning to the thread that resumed this one
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> finished) noexcept {
+            std::coroutine_handle<> continuation = finished.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept { }
+    };
+
+public:
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() noexcept { error = std::current_exception(); }
+};
+
+template<typename T>
+class TaskPromise : public TaskPromiseBase {
+private:
+    std::optional<T> value;
+
+public:
+    template<typename U>
+    void return_value(U &&result) { value.emplace(std::forward<U>(result)); }
+
+    T result() {
+        if (error) { std::rethrow_exception(error); }
+        return std::move(*value);
+    }
+};
+
+template<>
+class TaskPromise<void> : public TaskPromiseBase {
+public:
+    void return_void() noexcept { }
+
+    void result() {
+        if (error) { std::rethrow_exception(error); }
+    }
+};
+
+
+// Lazily started coroutine producing a T (or an exception), owned by one Task and awaited at most once
+template<typename T>
+class [[nodiscard]] Task {
+public:
+    struct promise_type : TaskPromise<T> {
+        Task get_return_object() noexcept { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    };
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) { }
+
+    // Starts the task with awaiting as its continuation; TAKE_RESULT false only waits for it to finish
+    template<bool TAKE_RESULT>
+    struct Awaiter {
+        std::coroutine_handle<promise_type> handle;
+
+        bool await_ready() const noexcept { return handle.done(); }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+
+        auto await_resume() {
+            if constexpr (TAKE_RESULT) { return handle.promise().result(); }
+        }
+    };
+
+    template<typename U>
+    friend U syncWait(ThreadPool &pool, Task<U> task);
+
+public:
+    Task() = default;
+    Task(Task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) { }
+    Task &operator=(Task &&other) noexcept {
+        if (this != &other) {
+            if (handle) { handle.destroy(); }
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task() {
+        if (handle) { handle.destroy(); }
+    }
+
+    bool valid() const { return bool(handle); }
+
+    Awaiter<true> operator co_await() const noexcept { return {handle}; }
+};
+
+
+// co_await schedule(pool) continues the coroutine on a pool worker
+class ScheduleAwaiter {
+private:
+    ThreadPool &pool;
+
+public:
+    explicit ScheduleAwaiter(ThreadPool &pool) : pool(pool) { }
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> coroutine) { pool.post([coroutine]() { coroutine.resume(); }); }
+    void await_resume() const noexcept { }
+};
+
+inline ScheduleAwaiter schedule(ThreadPool &pool) { return ScheduleAwaiter(pool); }
+
+
+// Runs every task on the pool at once and resumes the awaiting coroutine when the last one has finished
+class WhenAllAwaiter {
+private:
+    ThreadPool &pool;
+    std::vector<Task<>> &tasks;
+
+    // One per task plus one for await_suspend itself, so the caller cannot be resumed before it has suspended
+    std::atomic<std::size_t> remaining{0};
+    std::coroutine_handle<> awaiting;
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    static DetachedTask runOne(WhenAllAwaiter &all, Task<> &task) {
+        co_await schedule(all.pool);
+        try {
+            co_await task;
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(all.errorMutex);
+            if (!all.error) { all.error = std::current_exception(); }
+        }
+        if (--all.remaining == 0) { all.awaiting.resume(); }
+    }
+
+public:
+    WhenAllAwaiter(ThreadPool &pool, std::vector<Task<>> &tasks) : pool(pool), tasks(tasks) { }
+
+    bool await_ready() const noexcept { return tasks.empty(); }
+
+    bool await_suspend(std::coroutine_handle<> caller) {
+        awaiting = caller;
+        remaining = tasks.size() + 1;
+        for (Task<> &task: tasks) { runOne(*this, task); }
+        return --remaining != 0;
+    }
+
+    // The first exception any task threw, once all of them have finished
+    void await_resume() const {
+        if (error) { std::rethrow_exception(error); }
+    }
+};
+
+inline Task<> whenAll(ThreadPool &pool, std::vector<Task<>> tasks) {
+    co_await WhenAllAwaiter(pool, tasks);
+}
+
+
+// Runs task to completion, the calling thread runs pool tasks meanwhile. Returns its result or rethrows
+template<typename T>
+T syncWait(ThreadPool &pool, Task<T> task) {
+    std::atomic<bool> done{false};
+    auto signal = [](Task<T> &task, std::atomic<bool> &done) -> DetachedTask {
+        co_await typename Task<T>::template Awaiter<false>{task.handle};
+        done = true;
+    };
+    signal(task, done);
+    pool.helpUntil([&done]() { return done.load(); });
+    return task.handle.promise().result();
+}
+
+
+// function() on a pool worker, the awaiting coroutine continues there
+template<typename Function>
+Task<std::invoke_result_t<Function &>> asyncRun(ThreadPool &pool, Function function) {
+    co_await schedule(pool);
+    co_return function();
+}
+
+// The calculator operations as tasks on the calculator's pool. calculator must outlive the task
+template<typename T, typename Acc>
+Task<> asyncAdd(BasicMatrixCalculator<T, Acc> &calculator) {
+    return asyncRun(calculator.getThreadPool(), [&calculator]() { calculator.matrixAdd(); });
+}
+
+template<typename T, typename Acc>
+Task<> asyncSubtract(BasicMatrixCalculator<T, Acc> &calculator) {
+    return asyncRun(calculator.getThreadPool(), [&calculator]() { calculator.matrixSubtract(); });
+}
+
+template<typename T, typename Acc>
+Task<> asyncMultiply(BasicMatrixCalculator<T, Acc> &calculator) {
+    return asyncRun(calculator.getThreadPool(), [&calculator]() { calculator.matrixMultiply(); });
+}
+
+inline Task<> asyncTranspose(MatrixCalculator &calculator) {
+    return asyncRun(calculator.getThreadPool(), [&calculator]() { calculator.matrixTranspose(); });
+}
+
+inline Task<> asyncSolve(MatrixCalculator &calculator) {
+    return asyncRun(calculator.getThreadPool(), [&calculator]() { calculator.matrixSolve(); });
+}
+
+#endif //MATRIX_MULTIPROCESSING_ASYNC_H
@@ -0,0 +1,251 @@
+#ifndef MATRIX_MULTIPROCESSING_BATCHED_H
+#define MATRIX_MULTIPROCESSING_BATCHED_H
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <vector>
+#include "Matrix.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+/**
+ *  Batches of many small matrices of one shape, processed together.
+ *
+ *  Storage is batch-innermost ("SoA"): element (row, col) of every matrix in the batch is contiguous, one plane
+ *  per element. A SIMD vector therefore holds the same element of W different matrices, and one kernel pass
+ *  computes W (or a whole BATCH_BLOCK) independent small products at once with no shuffles and no ragged
+ *  edges, whatever the matrix shape. The batch dimension is padded to a multiple of BATCH_BLOCK with zero
+ *  matrices, and blocks of the batch are spread over the thread pool.
+ */
+
+static constexpr std::size_t BATCH_BLOCK = 32;
+
+
+class MatrixBatch {
+private:
+    struct AlignedDeleter {
+        void operator()(double *pointer) const { std::free(pointer); }
+    };
+
+    std::unique_ptr<double[], AlignedDeleter> data;
+    std::size_t count = 0;
+    std::size_t rows = 0;
+    std::size_t cols = 0;
+    std::size_t batchStride = 0;
+
+public:
+    MatrixBatch() = default;
+
+    // count zero-initialized rows x cols matrices
+    MatrixBatch(std::size_t count, std::size_t rows, std::size_t cols)
+        : count(count), rows(rows), cols(cols), batchStride((count + BATCH_BLOCK - 1) / BATCH_BLOCK * BATCH_BLOCK) {
+        std::size_t bytes = rows * cols * batchStride * sizeof(double);
+        if (bytes == 0) { return; }
+
+        void *buffer = std::aligned_alloc(MATRIX_ALIGNMENT, bytes);
+        if (buffer == nullptr) { throw std::bad_alloc(); }
+        std::memset(buffer, 0, bytes);
+        data.reset(static_cast<double *>(buffer));
+    }
+
+    MatrixBatch(MatrixBatch &&) noexcept = default;
+    MatrixBatch &operator=(MatrixBatch &&) noexcept = default;
+
+    std::size_t getCount() const { return count; }
+    std::size_t getRows() const { return rows; }
+    std::size_t getCols() const { return cols; }
+    std::size_t getBatchStride() const { return batchStride; }
+
+    // Element (row, col) of every matrix, getBatchStride() values
+    double *plane(std::size_t row, std::size_t col) { return data.get() + (row * cols + col) * batchStride; }
+    const double *plane(std::size_t row, std::size_t col) const { return data.get() + (row * cols + col) * batchStride; }
+
+    double &operator()(std::size_t index, std::size_t row, std::size_t col) { return plane(row, col)[index]; }
+    double operator()(std::size_t index, std::size_t row, std::size_t col) const { return plane(row, col)[index]; }
+
+    void set(std::size_t index, ConstMatrixView matrix) {
+        if (index >= count || matrix.getRows() != rows || matrix.getCols() != cols) {
+            throw std::invalid_argument("Matrix does not fit this batch");
+        }
+        for (std::size_t row = 0; row < rows; row++) {
+            for (std::size_t col = 0; col < cols; col++) { plane(row, col)[index] = matrix(row, col); }
+        }
+    }
+
+    Matrix get(std::size_t index) const {
+        if (index >= count) { throw std::out_of_range("Batch index out of range"); }
+        Matrix matrix(rows, cols);
+        for (std::size_t row = 0; row < rows; row++) {
+            for (std::size_t col = 0; col < cols; col++) { matrix(row, col) = plane(row, col)[index]; }
+        }
+        return matrix;
+    }
+};
+
+
+// out = a + b for one block of the batch, sums[block] gets each matrix's total
+template<int W>
+MATRIX_INLINE void batchedAddBlock(const MatrixBatch &a, const MatrixBatch &b, MatrixBatch &out, double *sums,
+                                   std::size_t offset) {
+    typedef typename SimdVector<double, W>::type V;
+    constexpr std::size_t NV = BATCH_BLOCK / W;
+
+    V total[NV];
+    MATRIX_UNROLL
+    for (std::size_t v = 0; v < NV; v++) { total[v] = V{}; }
+
+    for (std::size_t row = 0; row < a.getRows(); row++) {
+        for (std::size_t col = 0; col < a.getCols(); col++) {
+            const double *left = a.plane(row, col) + offset, *right = b.plane(row, col) + offset;
+            double *result = out.plane(row, col) + offset;
+            MATRIX_UNROLL
+            for (std::size_t v = 0; v < NV; v++) {
+                V x, y;
+                loadVector(x, left + v * W);
+                loadVector(y, right + v * W);
+                V value = x + y;
+                storeVector(result + v * W, value);
+                total[v] += value;
+            }
+        }
+    }
+    for (std::size_t v = 0; v < NV; v++) { storeVector(sums + offset + v * W, total[v]); }
+}
+
+
+// out = a * b for one block of the batch, all BATCH_BLOCK products of an output element kept in registers
+template<int W>
+MATRIX_INLINE void batchedMultiplyBlock(const MatrixBatch &a, const MatrixBatch &b, MatrixBatch &out, double *sums,
+                                        std::size_t offset) {
+    typedef typename SimdVector<double, W>::type V;
+    constexpr std::size_t NV = BATCH_BLOCK / W;
+
+    V total[NV];
+    MATRIX_UNROLL
+    for (std::size_t v = 0; v < NV; v++) { total[v] = V{}; }
+
+    for (std::size_t row = 0; row < out.getRows(); row++) {
+        for (std::size_t col = 0; col < out.getCols(); col++) {
+            V acc[NV];
+            MATRIX_UNROLL
+            for (std::size_t v = 0; v < NV; v++) { acc[v] = V{}; }
+
+            for (std::size_t k = 0; k < a.getCols(); k++) {
+                const double *left = a.plane(row, k) + offset, *right = b.plane(k, col) + offset;
+                MATRIX_UNROLL
+                for (std::size_t v = 0; v < NV; v++) {
+                    V x, y;
+                    loadVector(x, left + v * W);
+                    loadVector(y, right + v * W);
+                    acc[v] += x * y;
+                }
+            }
+
+            double *result = out.plane(row, col) + offset;
+            MATRIX_UNROLL
+            for (std::size_t v = 0; v < NV; v++) {
+                storeVector(result + v * W, acc[v]);
+                total[v] += acc[v];
+            }
+        }
+    }
+    for (std::size_t v = 0; v < NV; v++) { storeVector(sums + offset + v * W, total[v]); }
+}
+
+
+typedef void (*BatchedBlockKernel)(const MatrixBatch &, const MatrixBatch &, MatrixBatch &, double *, std::size_t);
+
+inline void batchedAddScalar(const MatrixBatch &a, const MatrixBatch &b, MatrixBatch &out, double *sums, std::size_t offset) {
+    batchedAddBlock<1>(a, b, out, sums, offset);
+}
+
+inline void batchedMultiplyScalar(const MatrixBatch &a, const MatrixBatch &b, MatrixBatch &out, double *sums,
+                                  std::size_t offset) {
+    batchedMultiplyBlock<1>(a, b, out, sums, offset);
+}
+
+#ifdef MATRIX_X86_SIMD
+MATRIX_TARGET_AVX2 inline void batchedAddAvx2(const MatrixBatch &a, const MatrixBatch &b, MatrixBatch &out,
+                                              double *sums, std::size_t offset) {
+    batchedAddBlock<4>(a, b, out, sums, offset);
+}
+
+MATRIX_TARGET_AVX2 inline void batchedMultiplyAvx2(const MatrixBatch &a, const MatrixBatch &b, MatrixBatch &out,
+                                                   double *sums, std::size_t offset) {
+    batchedMultiplyBlock<4>(a, b, out, sums, offset);
+}
+
+MATRIX_TARGET_AVX512 inline void batchedAddAvx512(const MatrixBatch &a, const MatrixBatch &b, MatrixBatch &out,
+                                                  double *sums, std::size_t offset) {
+    batchedAddBlock<8>(a, b, out, sums, offset);
+}
+
+MATRIX_TARGET_AVX512 inline void batchedMultiplyAvx512(const MatrixBatch &a, const MatrixBatch &b, MatrixBatch &out,
+                                                       double *sums, std::size_t offset) {
+    batchedMultiplyBlock<8>(a, b, out, sums, offset);
+}
+#endif
+
+
+// Runs kernel on every block of the batch, about 16K output elements per pool task
+inline std::vector<double> runBatched(BatchedBlockKernel kernel, const MatrixBatch &a, const MatrixBatch &b,
+                                      MatrixBatch &out, ThreadPool &pool) {
+    std::vector<double> sums(out.getBatchStride(), 0.0);
+    const std::size_t blocks = out.getBatchStride() / BATCH_BLOCK;
+    const std::size_t elementsPerBlock = std::max<std::size_t>(1, out.getRows() * out.getCols() * BATCH_BLOCK);
+    const std::size_t grain = std::max<std::size_t>(1, 16384 / elementsPerBlock);
+
+    pool.parallelFor(blocks, grain, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t block = begin; block < end; block++) { kernel(a, b, out, sums.data(), block * BATCH_BLOCK); }
+    });
+
+    sums.resize(out.getCount());
+    return sums;
+}
+
+
+// out[i] = a[i] + b[i] for every matrix in the batch, returns the sum of each result
+inline std::vector<double> batchedAdd(const MatrixBatch &a, const MatrixBatch &b, MatrixBatch &out,
+                                      ThreadPool &pool = ThreadPool::global(), SimdLevel level = activeSimdLevel()) {
+    if (a.getCount() != b.getCount() || out.getCount() != a.getCount() || a.getRows() != b.getRows() ||
+        a.getCols() != b.getCols() || out.getRows() != a.getRows() || out.getCols() != a.getCols()) {
+        throw std::invalid_argument("Batched add operands have different shapes");
+    }
+
+    BatchedBlockKernel kernel = batchedAddScalar;
+#ifdef MATRIX_X86_SIMD
+    if (level == SimdLevel::AVX512) { kernel = batchedAddAvx512; }
+    else if (level == SimdLevel::AVX2) { kernel = batchedAddAvx2; }
+#else
+    (void) level;
+#endif
+    return runBatched(kernel, a, b, out, pool);
+}
+
+// out[i] = a[i] * b[i] for every matrix in the batch, returns the sum of each result
+inline std::vector<double> batchedMultiply(const MatrixBatch &a, const MatrixBatch &b, MatrixBatch &out,
+                                           ThreadPool &pool = ThreadPool::global(),
+                                           SimdLevel level = activeSimdLevel()) {
+    if (a.getCount() != b.getCount() || out.getCount() != a.getCount() || a.getCols() != b.getRows() ||
+        out.getRows() != a.getRows() || out.getCols() != b.getCols()) {
+        throw std::invalid_argument("Batched multiply operands have incompatible shapes");
+    }
+
+    BatchedBlockKernel kernel = batchedMultiplyScalar;
+#ifdef MATRIX_X86_SIMD
+    if (level == SimdLevel::AVX512) { kernel = batchedMultiplyAvx512; }
+    else if (level == SimdLevel::AVX2) { kernel = batchedMultiplyAvx2; }
+#else
+    (void) level;
+#endif
+    return runBatched(kernel, a, b, out, pool);
+}
+
+#endif //MATRIX_MULTIPROCESSING_BATCHED_H
@@ -0,0 +1,835 @@
+#ifndef MATRIX_MULTIPROCESSING_BENCHMARKS_H
+#define MATRIX_MULTIPROCESSING_BENCHMARKS_H
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Async.h"
+#include "Batched.h"
+#include "ElementTypes.h"
+#include "Elementwise.h"
+#include "Expressions.h"
+#include "Factorization.h"
+#include "Gemm.h"
+#include "Matrix.h"
+#include "MatrixCalculator.h"
+#include "Numa.h"
+#include "Simd.h"
+#include "SparseMatrix.h"
+#include "Strassen.h"
+#include "ThreadPool.h"
+#include "Transpose.h"
+
+/**
+ *  Benchmarks, run with: ./a.out --bench <name> [--full] [--threads N]
+ *
+ *  --full lifts the size caps that keep the slow reference runs short, --threads sets the largest thread count
+ *  the scaling benchmark tries and the thread count of the stream benchmark (default: hardware_concurrency).
+ */
+
+struct BenchmarkOptions {
+    bool full = false;
+    std::size_t maxThreads = 0;     // 0: hardware_concurrency
+};
+
+
+// Matrix with uniform values in [-1, 1), same seed gives the same matrix
+inline Matrix randomMatrix(std::size_t rows, std::size_t cols, unsigned seed) {
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+    Matrix matrix(rows, cols);
+    for (std::size_t row = 0; row < rows; row++) {
+        for (std::size_t col = 0; col < cols; col++) { matrix(row, col) = distribution(generator); }
+    }
+    return matrix;
+}
+
+
+inline double maxAbsDifference(ConstMatrixView a, ConstMatrixView b) {
+    double worst = 0;
+    for (std::size_t row = 0; row < a.getRows(); row++) {
+        for (std::size_t col = 0; col < a.getCols(); col++) { worst = std::max(worst, std::fabs(a(row, col) - b(row, col))); }
+    }
+    return worst;
+}
+
+
+// Best of `repeats` runs of function, in seconds
+template<typename Function>
+double bestTime(int repeats, Function &&function) {
+    double best = 1e300;
+    for (int run = 0; run < repeats; run++) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+
+// GFLOP/s of every available GEMM kernel against the naive triple loop
+inline void benchmarkGemm(const BenchmarkOptions &options) {
+    const std::size_t naiveLimit = options.full ? 4096 : 1024;
+
+    std::vector<SimdLevel> levels = {SimdLevel::SCALAR};
+    if (activeSimdLevel() >= SimdLevel::AVX2) { levels.push_back(SimdLevel::AVX2); }
+    if (activeSimdLevel() >= SimdLevel::AVX512) { levels.push_back(SimdLevel::AVX512); }
+
+    std::cout << "GEMM benchmark, C = A * B (double), best SIMD level: " << simdLevelName(activeSimdLevel()) << std::endl;
+    std::cout << std::setw(6) << "n" << std::setw(12) << "naive";
+    for (SimdLevel level: levels) { std::cout << std::setw(12) << simdLevelName(level); }
+    std::cout << std::setw(12) << "speedup" << std::setw(12) << "max error" << "   (GFLOP/s)" << std::endl;
+
+    for (std::size_t n = 64; n <= 4096; n *= 2) {
+        Matrix a = randomMatrix(n, n, 1), b = randomMatrix(n, n, 2);
+        Matrix reference(n, n), c(n, n);
+        const double flops = 2.0 * double(n) * double(n) * double(n);
+        const int repeats = n <= 256 ? 5 : n <= 1024 ? 3 : 1;
+
+        std::cout << std::setw(6) << n << std::fixed << std::setprecision(2);
+
+        double naiveGflops = 0;
+        if (n <= naiveLimit) {
+            naiveGflops = flops / bestTime(n <= 512 ? repeats : 1, [&]() { gemmNaive(a, b, reference); }) * 1e-9;
+            std::cout << std::setw(12) << naiveGflops;
+        } else {
+            gemm(a, b, reference, 1.0, 0.0, gemmKernelFor(SimdLevel::SCALAR));
+            std::cout << std::setw(12) << "-";
+        }
+
+        double bestGflops = 0, worstError = 0;
+        for (SimdLevel level: levels) {
+            const GemmKernel kernel = gemmKernelFor(level);
+            double gflops = flops / bestTime(repeats, [&]() { gemm(a, b, c, 1.0, 0.0, kernel); }) * 1e-9;
+            bestGflops = std::max(bestGflops, gflops);
+            worstError = std::max(worstError, maxAbsDifference(c, reference));
+            std::cout << std::setw(12) << gflops;
+        }
+
+        if (naiveGflops > 0) {
+            std::cout << std::setw(11) << bestGflops / naiveGflops << "x";
+        } else {
+            std::cout << std::setw(12) << "-";
+        }
+        std::cout << std::setw(12) << std::scientific << std::setprecision(1) << worstError << std::endl;
+    }
+    std::cout << std::defaultfloat;
+}
+
+
+// Speedup of the pool-parallel add, multiply and sum against thread count
+inline void benchmarkScaling(const BenchmarkOptions &options) {
+    const std::size_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    const std::size_t maxThreads = options.maxThreads > 0 ? options.maxThreads : hardwareThreads;
+    const std::size_t addSize = 4096, multiplySize = options.full ? 4096 : 2048;
+
+    std::vector<std::size_t> threadCounts;
+    for (std::size_t threads = 1; threads < maxThreads; threads *= 2) { threadCounts.push_back(threads); }
+    threadCounts.push_back(maxThreads);
+
+    Matrix addLeft = randomMatrix(addSize, addSize, 1), addRight = randomMatrix(addSize, addSize, 2);
+    Matrix mulLeft = randomMatrix(multiplySize, multiplySize, 3), mulRight = randomMatrix(multiplySize, multiplySize, 4);
+
+    std::cout << "Thread scaling, " << hardwareThreads << " hardware threads, SIMD level "
+              << simdLevelName(activeSimdLevel()) << std::endl;
+    std::cout << "add / sum " << addSize << "x" << addSize << ", multiply " << multiplySize << "x" << multiplySize
+              << ", wall seconds (speedup vs 1 thread)" << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(22) << "add" << std::setw(22) << "multiply"
+              << std::setw(22) << "sum" << std::endl;
+
+    double baseAdd = 0, baseMultiply = 0, baseSum = 0;
+    for (std::size_t threads: threadCounts) {
+        ThreadPool pool(threads);
+
+        MatrixCalculator adder(addSize, addSize);
+        adder.setThreadPool(pool);
+        adder.setMatrices(addLeft.view(), addRight.view());
+        double addTime = bestTime(5, [&]() { adder.matrixAdd(); });
+
+        MatrixCalculator multiplier(0, 0);
+        multiplier.setThreadPool(pool);
+        multiplier.setMatrices(Matrix::copyOf(mulLeft), Matrix::copyOf(mulRight));
+        double multiplyTime = bestTime(options.full ? 1 : 3, [&]() { multiplier.matrixMultiply(); });
+
+        ConstMatrixView summed = addLeft.view();
+        double sumTime = bestTime(5, [&]() {
+            volatile double sum = pool.parallelReduce(summed.getRows(), 4, 0.0, [summed](std::size_t begin, std::size_t end) {
+                double partial = 0;
+                for (std::size_t row = begin; row < end; row++) {
+                    for (std::size_t col = 0; col < summed.getCols(); col++) { partial += summed(row, col); }
+                }
+                return partial;
+            }, std::plus<double>());
+            (void) sum;
+        });
+
+        if (threads == 1) { baseAdd = addTime; baseMultiply = multiplyTime; baseSum = sumTime; }
+
+        std::cout << std::setw(8) << threads << std::fixed << std::setprecision(4)
+                  << std::setw(14) << addTime << " (" << std::setprecision(2) << std::setw(4) << baseAdd / addTime << "x)"
+                  << std::setprecision(4)
+                  << std::setw(14) << multiplyTime << " (" << std::setprecision(2) << std::setw(4) << baseMultiply / multiplyTime << "x)"
+                  << std::setprecision(4)
+                  << std::setw(14) << sumTime << " (" << std::setprecision(2) << std::setw(4) << baseSum / sumTime << "x)"
+                  << std::endl;
+    }
+    std::cout << std::defaultfloat;
+}
+
+
+// The original serial add with a dependent += sum chain, the baseline for benchmarkElementwise
+inline double serialAddAndSum(ConstMatrixView a, ConstMatrixView b, MatrixView out) {
+    double sum = 0;
+    for (std::size_t row = 0; row < a.getRows(); row++) {
+        for (std::size_t col = 0; col < a.getCols(); col++) {
+            out(row, col) = a(row, col) + b(row, col);
+            sum += out(row, col);
+        }
+    }
+    return sum;
+}
+
+
+// Fused add-and-sum against the serial loop: bandwidth, accuracy and run-to-run determinism
+inline void benchmarkElementwise(const BenchmarkOptions &options) {
+    const std::size_t n = options.full ? 8192 : 4096;
+    const std::size_t threads = options.maxThreads > 0 ? options.maxThreads : std::max(1u, std::thread::hardware_concurrency());
+
+    // Large offset plus small noise: the noise is what a naive sum loses
+    Matrix a = randomMatrix(n, n, 1), b = randomMatrix(n, n, 2), out(n, n);
+    for (std::size_t row = 0; row < n; row++) {
+        for (std::size_t col = 0; col < n; col++) { a(row, col) = 1e6 + a(row, col) * 1e-3; }
+    }
+
+    long double exact = 0;
+    for (std::size_t row = 0; row < n; row++) {
+        for (std::size_t col = 0; col < n; col++) { exact += (long double) (a(row, col) + b(row, col)); }
+    }
+
+    const double bytes = 3.0 * double(n) * double(n) * sizeof(double);
+    std::cout << "Fused add + sum, " << n << "x" << n << ", " << threads << " threads" << std::endl;
+    std::cout << std::setw(20) << "kernel" << std::setw(12) << "GB/s" << std::setw(16) << "relative error"
+              << std::setw(26) << "sum" << std::endl;
+
+    auto report = [&](const std::string &name, double seconds, double sum) {
+        double error = double(std::fabs((long double) sum - exact) / std::fabs(exact));
+        std::cout << std::setw(20) << name << std::fixed << std::setprecision(2) << std::setw(12) << bytes / seconds * 1e-9
+                  << std::scientific << std::setprecision(2) << std::setw(16) << error
+                  << std::setprecision(17) << std::setw(26) << sum << std::endl;
+    };
+
+    double serialSum = 0;
+    double serialSeconds = bestTime(3, [&]() { serialSum = serialAddAndSum(a, b, out); });
+    report("serial", serialSeconds, serialSum);
+
+    std::vector<SimdLevel> levels = {SimdLevel::SCALAR};
+    if (activeSimdLevel() >= SimdLevel::AVX2) { levels.push_back(SimdLevel::AVX2); }
+    if (activeSimdLevel() >= SimdLevel::AVX512) { levels.push_back(SimdLevel::AVX512); }
+
+    ThreadPool single(1), pool(threads);
+    for (SimdLevel level: levels) {
+        double fusedSum = 0;
+        double seconds = bestTime(3, [&]() { fusedSum = elementwise(pool, AddOp(), a, b, out, level); });
+        report(std::string("fused ") + simdLevelName(level), seconds, fusedSum);
+
+        double singleSum = elementwise(single, AddOp(), a, b, out, level);
+        if (singleSum != fusedSum) { std::cout << "    sum differs between 1 and " << threads << " threads" << std::endl; }
+    }
+    std::cout << std::defaultfloat;
+}
+
+
+// d = a + b - c * 2 evaluated eagerly (one pass and one temporary per operator) against one fused pass
+inline void benchmarkExpressions(const BenchmarkOptions &options) {
+    const std::size_t n = options.full ? 8192 : 4096;
+    ThreadPool &pool = ThreadPool::global();
+
+    Matrix a = randomMatrix(n, n, 1), b = randomMatrix(n, n, 2), c = randomMatrix(n, n, 3);
+    Matrix sum(n, n), scaled(n, n), eager(n, n), fused(n, n);
+
+    // Bytes each approach has to move: reads plus writes of whole matrices
+    const double matrixBytes = double(n) * double(n) * sizeof(double);
+    const double eagerBytes = (3 + 2 + 3) * matrixBytes;     // a+b -> t1, c*2 -> t2, t1-t2 -> d
+    const double fusedBytes = (3 + 1) * matrixBytes;         // read a, b, c, write d
+
+    double eagerSum = 0, fusedSum = 0;
+    double eagerSeconds = bestTime(3, [&]() {
+        elementwise(pool, AddOp(), a, b, sum);
+        elementwise(pool, ScaleOp{2.0}, c, c, scaled);
+        eagerSum = elementwise(pool, SubtractOp(), sum, scaled, eager);
+    });
+    double fusedSeconds = bestTime(3, [&]() { fusedSum = assign(fused, a + b - c * 2.0, pool); });
+
+    std::cout << "d = a + b - c * 2, " << n << "x" << n << ", " << pool.getConcurrency() << " threads, SIMD level "
+              << simdLevelName(activeSimdLevel()) << std::endl;
+    std::cout << std::setw(10) << "mode" << std::setw(12) << "seconds" << std::setw(14) << "GB moved"
+              << std::setw(12) << "GB/s" << std::setw(14) << "temporaries" << std::endl;
+    std::cout << std::fixed << std::setprecision(4)
+              << std::setw(10) << "eager" << std::setw(12) << eagerSeconds << std::setw(14) << eagerBytes * 1e-9
+              << std::setw(12) << eagerBytes / eagerSeconds * 1e-9 << std::setw(14) << 2 << std::endl
+              << std::setw(10) << "fused" << std::setw(12) << fusedSeconds << std::setw(14) << fusedBytes * 1e-9
+              << std::setw(12) << fusedBytes / fusedSeconds * 1e-9 << std::setw(14) << 0 << std::endl;
+    std::cout << "speedup " << std::setprecision(2) << eagerSeconds / fusedSeconds << "x, max difference "
+              << std::scientific << std::setprecision(1) << maxAbsDifference(eager, fused)
+              << ", sums " << std::setprecision(17) << eagerSum << " / " << fusedSum << std::endl;
+    std::cout << std::defaultfloat;
+}
+
+
+// n x n sparse test matrix: "banded" has a band of half-width 4, "power-law" has row lengths that fall off
+// like 1 / rank^0.8 around an average of 16 with uniformly random columns
+inline CsrMatrix randomSparseMatrix(std::size_t n, const std::string &kind, unsigned seed) {
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> value(-1.0, 1.0);
+    std::uniform_int_distribution<std::size_t> column(0, n - 1);
+
+    std::vector<double> weights(n);
+    double weightSum = 0;
+    for (std::size_t row = 0; row < n; row++) { weightSum += weights[row] = 1.0 / std::pow(double(row + 1), 0.8); }
+
+    std::vector<std::size_t> rowPointers{0};
+    std::vector<SparseIndex> columnIndices;
+    std::vector<double> values;
+    std::vector<SparseIndex> rowColumns;
+    for (std::size_t row = 0; row < n; row++) {
+        rowColumns.clear();
+        if (kind == "banded") {
+            for (std::size_t col = row >= 4 ? row - 4 : 0; col <= std::min(n - 1, row + 4); col++) { rowColumns.push_back(SparseIndex(col)); }
+        } else {
+            std::size_t length = std::min(n, std::max<std::size_t>(1, std::size_t(16.0 * double(n) * weights[row] / weightSum)));
+            for (std::size_t i = 0; i < length; i++) { rowColumns.push_back(SparseIndex(column(generator))); }
+            std::sort(rowColumns.begin(), rowColumns.end());
+            rowColumns.erase(std::unique(rowColumns.begin(), rowColumns.end()), rowColumns.end());
+        }
+        for (SparseIndex col: rowColumns) {
+            columnIndices.push_back(col);
+            values.push_back(value(generator));
+        }
+        rowPointers.push_back(values.size());
+    }
+    return CsrMatrix(n, n, std::move(rowPointers), std::move(columnIndices), std::move(values));
+}
+
+
+// Sparse add, SpMV and SpGEMM against the dense kernels on the same matrices
+inline void benchmarkSparse(const BenchmarkOptions &options) {
+    ThreadPool &pool = ThreadPool::global();
+    const std::size_t denseSize = options.full ? 4096 : 2048;
+    const std::size_t sparseOnlySize = options.full ? (1u << 22) : (1u << 18);
+
+    std::cout << "Sparse kernels, " << pool.getConcurrency() << " threads, milliseconds (dense / sparse = speedup)"
+              << std::endl;
+    std::cout << std::setw(10) << "matrix" << std::setw(10) << "n" << std::setw(12) << "nnz/row"
+              << std::setw(26) << "add" << std::setw(26) << "SpMV" << std::setw(26) << "SpGEMM" << std::endl;
+
+    auto cell = [](double denseSeconds, double sparseSeconds) {
+        std::ostringstream text;
+        text << std::fixed << std::setprecision(3);
+        if (denseSeconds > 0) { text << denseSeconds * 1e3 << " / "; }
+        text << sparseSeconds * 1e3;
+        if (denseSeconds > 0) { text << " = " << std::setprecision(0) << denseSeconds / sparseSeconds << "x"; }
+        return text.str();
+    };
+
+    for (const std::string kind: {"banded", "power-law"}) {
+        for (std::size_t n: {denseSize, sparseOnlySize}) {
+            const bool withDense = n == denseSize;
+            CsrMatrix a = randomSparseMatrix(n, kind, 1), b = randomSparseMatrix(n, kind, 2);
+            std::vector<double> x(n, 1.0), y;
+
+            double addSeconds = bestTime(3, [&]() { add(a, b, pool); });
+            double spmvSeconds = bestTime(5, [&]() { y = multiply(a, x, pool); });
+            double spgemmSeconds = bestTime(1, [&]() { multiply(a, b, pool); });
+
+            double denseAdd = 0, denseSpmv = 0, denseGemm = 0;
+            if (withDense) {
+                Matrix aDense = a.toDense(), bDense = b.toDense(), out(n, n), xDense(n, 1), yDense(n, 1);
+                xDense.view().fill(1.0);
+                denseAdd = bestTime(3, [&]() { elementwise(pool, AddOp(), aDense, bDense, out); });
+                denseSpmv = bestTime(5, [&]() { gemmParallel(pool, aDense, xDense, yDense); });
+                denseGemm = bestTime(1, [&]() { gemmParallel(pool, aDense, bDense, out); });
+
+                double worst = 0;
+                for (std::size_t row = 0; row < n; row++) { worst = std::max(worst, std::fabs(y[row] - yDense(row, 0))); }
+                if (worst > 1e-9) { std::cout << "    SpMV differs from dense by " << worst << std::endl; }
+            }
+
+            std::cout << std::setw(10) << kind << std::setw(10) << n << std::fixed << std::setprecision(1)
+                      << std::setw(12) << double(a.getNonZeros()) / double(n)
+                      << std::setw(26) << cell(denseAdd, addSeconds) << std::setw(26) << cell(denseSpmv, spmvSeconds)
+                      << std::setw(26) << cell(denseGemm, spgemmSeconds) << std::endl;
+        }
+    }
+    std::cout << std::defaultfloat;
+}
+
+
+// Matrices per second for batched add / multiply against one MatrixCalculator (and one std::async) per matrix
+inline void benchmarkBatched(const BenchmarkOptions &options) {
+    ThreadPool &pool = ThreadPool::global();
+    const std::size_t elementBudget = options.full ? (1u << 24) : (1u << 22);
+
+    std::cout << "Batched small matrices, " << pool.getConcurrency() << " threads, SIMD level "
+              << simdLevelName(activeSimdLevel()) << ", million matrices per second" << std::endl;
+    std::cout << std::setw(8) << "shape" << std::setw(10) << "batch" << std::setw(14) << "add async"
+              << std::setw(14) << "add calc" << std::setw(14) << "add batch" << std::setw(14) << "mul calc"
+              << std::setw(14) << "mul batch" << std::setw(12) << "max error" << std::endl;
+
+    for (std::size_t n: {2, 3, 4, 5, 8, 12, 16}) {
+        const std::size_t count = std::max<std::size_t>(4096, elementBudget / (n * n));
+        MatrixBatch a(count, n, n), b(count, n, n), out(count, n, n);
+        std::mt19937 generator(7);
+        std::uniform_real_distribution<double> value(-1.0, 1.0);
+        for (std::size_t row = 0; row < n; row++) {
+            for (std::size_t col = 0; col < n; col++) {
+                for (std::size_t i = 0; i < count; i++) { a(i, row, col) = value(generator); b(i, row, col) = value(generator); }
+            }
+        }
+
+        // Per-matrix baselines on a prefix of the batch, operands already unpacked
+        const std::size_t sampleCount = std::min<std::size_t>(count, 4096), asyncCount = std::min<std::size_t>(count, 512);
+        std::vector<MatrixCalculator> calculators;
+        for (std::size_t i = 0; i < sampleCount; i++) {
+            calculators.emplace_back(n, n);
+            calculators.back().setMatrices(a.get(i), b.get(i));
+        }
+
+        double asyncSeconds = bestTime(1, [&]() {
+            std::vector<std::future<void>> futures;
+            for (std::size_t i = 0; i < asyncCount; i++) {
+                futures.push_back(std::async(std::launch::async, &MatrixCalculator::matrixAdd, &calculators[i]));
+            }
+            for (auto &future: futures) { future.get(); }
+        });
+        double calcAddSeconds = bestTime(3, [&]() { for (auto &calculator: calculators) { calculator.matrixAdd(); } });
+        double calcMulSeconds = bestTime(3, [&]() { for (auto &calculator: calculators) { calculator.matrixMultiply(); } });
+
+        double batchAddSeconds = bestTime(3, [&]() { batchedAdd(a, b, out, pool); });
+        double batchMulSeconds = bestTime(3, [&]() { batchedMultiply(a, b, out, pool); });
+
+        double worst = 0;
+        for (std::size_t i = 0; i < sampleCount; i += 97) {
+            worst = std::max(worst, maxAbsDifference(out.get(i), calculators[i].getResult()));
+        }
+
+        auto rate = [](std::size_t matrices, double seconds) { return double(matrices) / seconds * 1e-6; };
+        std::cout << std::setw(5) << n << "x" << std::left << std::setw(2) << n << std::right << std::setw(10) << count
+                  << std::fixed << std::setprecision(3)
+                  << std::setw(14) << rate(asyncCount, asyncSeconds) << std::setw(14) << rate(sampleCount, calcAddSeconds)
+                  << std::setw(14) << rate(count, batchAddSeconds) << std::setw(14) << rate(sampleCount, calcMulSeconds)
+                  << std::setw(14) << rate(count, batchMulSeconds)
+                  << std::scientific << std::setprecision(1) << std::setw(12) << worst << std::endl;
+    }
+    std::cout << std::defaultfloat;
+}
+
+
+// STREAM Copy / Scale / Add / Triad in GB/s, serially placed matrices against first-touch placed ones
+inline void benchmarkStream(const BenchmarkOptions &options) {
+    const std::size_t threads = options.maxThreads != 0 ? options.maxThreads
+                                                        : std::max<unsigned>(1, std::thread::hardware_concurrency());
+    const std::size_t cols = 1024, rows = (options.full ? (std::size_t(1) << 25) : (std::size_t(1) << 23)) / cols;
+    const double scalar = 3.0, elementBytes = double(rows * cols * sizeof(double));
+    ThreadPool pool(threads, true);
+
+    std::cout << "STREAM, 3 x " << rows * cols * sizeof(double) / (1 << 20) << " MiB arrays, " << threads
+              << " pinned threads, " << NumaTopology::get().getNodeCount() << " NUMA node(s), SIMD level "
+              << simdLevelName(activeSimdLevel()) << ", best GB/s of 10 runs (STREAM byte counts)" << std::endl;
+    std::cout << std::setw(14) << "placement" << std::setw(10) << "Copy" << std::setw(10) << "Scale"
+              << std::setw(10) << "Add" << std::setw(10) << "Triad" << std::endl;
+
+    auto run = [&](const char *label, Matrix a, Matrix b, Matrix c) {
+        a.view().fill(1.0);
+        b.view().fill(2.0);
+        c.view().fill(0.0);
+        double copy = bestTime(10, [&]() { assign(c, MatrixTerm(a.view()), pool); });
+        double scale = bestTime(10, [&]() { assign(b, c * scalar, pool); });
+        double add = bestTime(10, [&]() { assign(c, a + b, pool); });
+        double triad = bestTime(10, [&]() { assign(a, b + c * scalar, pool); });
+
+        std::cout << std::setw(14) << label << std::fixed << std::setprecision(2)
+                  << std::setw(10) << 2 * elementBytes / copy * 1e-9 << std::setw(10) << 2 * elementBytes / scale * 1e-9
+                  << std::setw(10) << 3 * elementBytes / add * 1e-9 << std::setw(10) << 3 * elementBytes / triad * 1e-9
+                  << std::defaultfloat << std::endl;
+    };
+
+    // Matrix(rows, cols) zeroes everything on this thread: all pages land on its node
+    run("serial touch", Matrix(rows, cols), Matrix(rows, cols), Matrix(rows, cols));
+    run("first touch", allocateFirstTouch(rows, cols, pool), allocateFirstTouch(rows, cols, pool),
+        allocateFirstTouch(rows, cols, pool));
+
+    Matrix source = allocateFirstTouch(rows, cols, pool), target = allocateFirstTouch(rows, cols, pool);
+    double memcpySeconds = bestTime(10, [&]() {
+        std::memcpy(target.getData(), source.getData(), rows * source.getStride() * sizeof(double));
+    });
+    std::cout << std::setw(14) << "memcpy" << std::fixed << std::setprecision(2) << std::setw(10)
+              << 2 * elementBytes / memcpySeconds * 1e-9 << std::defaultfloat << "  (one thread)" << std::endl;
+}
+
+
+// Transpose bandwidth (bytes read + written) per SIMD level, in place and out of place, against memcpy
+inline void benchmarkTranspose(const BenchmarkOptions &options) {
+    ThreadPool &pool = ThreadPool::global();
+    std::vector<SimdLevel> levels = {SimdLevel::SCALAR};
+    if (activeSimdLevel() >= SimdLevel::AVX2) { levels.push_back(SimdLevel::AVX2); }
+    if (activeSimdLevel() >= SimdLevel::AVX512) { levels.push_back(SimdLevel::AVX512); }
+
+    std::cout << "Transpose, " << pool.getConcurrency() << " threads, GB/s (2 x matrix bytes per pass)" << std::endl;
+    std::cout << std::setw(12) << "shape" << std::setw(10) << "memcpy" << std::setw(10) << "naive";
+    for (SimdLevel level: levels) { std::cout << std::setw(10) << simdLevelName(level); }
+    std::cout << std::setw(10) << "in-place" << std::setw(12) << "max error" << std::endl;
+
+    std::vector<std::pair<std::size_t, std::size_t>> shapes = {{1000, 1000}, {1024, 1024}, {4096, 4096}, {4100, 4100},
+                                                               {2048, 8192}};
+    if (options.full) { shapes.emplace_back(8192, 8192); }
+
+    for (auto [rows, cols]: shapes) {
+        Matrix a = randomMatrix(rows, cols, 1), copy(rows, cols), reference(cols, rows), out(cols, rows);
+        const double bytes = 2.0 * double(rows * cols * sizeof(double));
+        auto rate = [bytes](double seconds) { return bytes / seconds * 1e-9; };
+
+        double memcpySeconds = bestTime(5, [&]() {
+            std::memcpy(copy.getData(), a.getData(), rows * a.getStride() * sizeof(double));
+        });
+        double naiveSeconds = bestTime(3, [&]() {
+            for (std::size_t row = 0; row < rows; row++) {
+                for (std::size_t col = 0; col < cols; col++) { reference(col, row) = a(row, col); }
+            }
+        });
+
+        std::cout << std::setw(6) << rows << "x" << std::left << std::setw(5) << cols << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(10) << rate(memcpySeconds) << std::setw(10) << rate(naiveSeconds);
+
+        double worst = 0;
+        for (SimdLevel level: levels) {
+            double seconds = bestTime(5, [&]() { transpose(a, out, pool, level); });
+            worst = std::max(worst, maxAbsDifference(out, reference));
+            std::cout << std::setw(10) << rate(seconds);
+        }
+
+        // Two in-place transposes restore the matrix, so every timed pass sees the same input
+        if (rows == cols) {
+            double seconds = bestTime(6, [&]() { transposeInPlace(copy, pool); });
+            transposeInPlace(copy, pool);
+            worst = std::max(worst, maxAbsDifference(copy, reference));
+            std::cout << std::setw(10) << rate(seconds);
+        } else {
+            std::cout << std::setw(10) << "-";
+        }
+        std::cout << std::scientific << std::setprecision(1) << std::setw(12) << worst << std::defaultfloat << std::endl;
+    }
+}
+
+
+// Tunes the Strassen crossover afresh, then compares Strassen against the blocked gemm on large squares
+inline void benchmarkStrassen(const BenchmarkOptions &options) {
+    std::cout << "Strassen crossover tuning, one thread, one Strassen level vs gemm (seconds)" << std::endl;
+    StrassenTuning tuning = tuneStrassenCrossover(options.full ? 4096 : 2048);
+    std::cout << std::setw(6) << "n" << std::setw(12) << "gemm" << std::setw(12) << "strassen" << std::endl;
+    for (const StrassenSample &sample: tuning.samples) {
+        std::cout << std::setw(6) << sample.n << std::fixed << std::setprecision(4) << std::setw(12) << sample.gemmSeconds
+                  << std::setw(12) << sample.strassenSeconds << std::defaultfloat << std::endl;
+    }
+    std::cout << "Crossover: " << tuning.crossover;
+    const std::string path = strassenCachePath();
+    if (!path.empty()) {
+        saveStrassenCrossover(path, tuning.crossover);
+        std::cout << " (cached in " << path << ")";
+    }
+    std::cout << std::endl << std::endl;
+
+    ThreadPool &pool = ThreadPool::global();
+    std::cout << "C = A * B, " << pool.getConcurrency() << " threads, effective GFLOP/s (2 n^3 / time)" << std::endl;
+    std::cout << std::setw(6) << "n" << std::setw(12) << "gemm" << std::setw(12) << "strassen" << std::setw(10) << "levels"
+              << std::setw(14) << "max error" << std::endl;
+
+    std::vector<std::size_t> sizes = {1024, 2048, 3000, 4096};
+    if (options.full) { sizes.push_back(8192); }
+    for (std::size_t n: sizes) {
+        Matrix a = randomMatrix(n, n, 1), b = randomMatrix(n, n, 2), reference(n, n), c(n, n);
+        const double flops = 2.0 * double(n) * double(n) * double(n);
+        const int repeats = n <= 2048 ? 3 : 1;
+
+        double gemmSeconds = bestTime(repeats, [&]() { gemmParallel(pool, a, b, reference); });
+        double strassenSeconds = bestTime(repeats, [&]() { strassen(a, b, c, pool, tuning.crossover); });
+
+        std::size_t levels = 0;
+        for (std::size_t size = n; size >= std::max(tuning.crossover, STRASSEN_MIN_CROSSOVER); size /= 2) { levels++; }
+
+        std::cout << std::setw(6) << n << std::fixed << std::setprecision(2) << std::setw(12) << flops / gemmSeconds * 1e-9
+                  << std::setw(12) << flops / strassenSeconds * 1e-9 << std::setw(10) << levels << std::scientific
+                  << std::setprecision(1) << std::setw(14) << maxAbsDifference(c, reference) << std::defaultfloat
+                  << std::endl;
+    }
+
+    // Concurrent calls on one pool: the caller's strassen() waits in helpUntil and runs queued strassen() jobs,
+    // each of which needs its own workspace
+    ThreadPool shared(3);
+    const std::size_t jobs = 12;
+    std::vector<Matrix> jobA, jobB, jobC, jobReference;
+    for (std::size_t i = 0; i < jobs; i++) {
+        jobA.push_back(randomMatrix(512, 512, unsigned(10 + i)));
+        jobB.push_back(randomMatrix(512, 512, unsigned(40 + i)));
+        jobC.emplace_back(512, 512);
+        jobReference.emplace_back(512, 512);
+        gemmParallel(pool, jobA[i], jobB[i], jobReference[i]);
+    }
+    Matrix a = randomMatrix(1024, 1024, 1), b = randomMatrix(1024, 1024, 2), reference(1024, 1024), c(1024, 1024);
+    gemmParallel(pool, a, b, reference);
+
+    std::vector<std::future<void>> futures;
+    for (std::size_t i = 0; i < jobs; i++) {
+        futures.push_back(shared.submit([&, i]() { strassen(jobA[i], jobB[i], jobC[i], shared, STRASSEN_MIN_CROSSOVER); }));
+    }
+    strassen(a, b, c, shared, STRASSEN_MIN_CROSSOVER);
+    for (auto &future: futures) { future.get(); }
+
+    double error = maxAbsDifference(c, reference);
+    for (std::size_t i = 0; i < jobs; i++) { error = std::max(error, maxAbsDifference(jobC[i], jobReference[i])); }
+    std::cout << "Concurrent: 1024 + " << jobs << " x 512 on a 3-thread pool, max error " << std::scientific
+              << std::setprecision(1) << error << std::defaultfloat << std::endl;
+}
+
+
+// LU and Cholesky GFLOP/s with scaled residuals, and a 64 right-hand-side solve, against plain gemm
+inline void benchmarkSolve(const BenchmarkOptions &options) {
+    ThreadPool &pool = ThreadPool::global();
+    const std::size_t rightHandSides = 64;
+    std::cout << "Factorizations, " << pool.getConcurrency() << " threads, block " << FACTOR_BLOCK
+              << ", GFLOP/s and scaled residual ||AX - B|| / (||A|| ||X|| n eps)" << std::endl;
+    std::cout << std::setw(6) << "n" << std::setw(10) << "gemm" << std::setw(10) << "LU" << std::setw(12) << "residual"
+              << std::setw(10) << "Cholesky" << std::setw(12) << "residual" << std::setw(10) << "solve" << std::endl;
+
+    std::vector<std::size_t> sizes = {256, 512, 1024, 2048};
+    if (options.full) { sizes.push_back(4096); }
+    for (std::size_t n: sizes) {
+        const double cube = double(n) * double(n) * double(n);
+        Matrix a = randomMatrix(n, n, 1), b = randomMatrix(n, rightHandSides, 2), product(n, n);
+        const int repeats = n <= 1024 ? 3 : 1;
+
+        double gemmSeconds = bestTime(repeats, [&]() { gemmParallel(pool, a, a, product); });
+
+        LuFactorization lu;
+        double luSeconds = bestTime(repeats, [&]() { lu = luFactor(a, pool); });
+        Matrix x;
+        double solveSeconds = bestTime(repeats, [&]() { x = luSolve(lu, b, pool); });
+        double luResidual = scaledResidual(a, x, b, pool);
+
+        // Symmetric positive definite: A * A^T + n * I
+        Matrix transposedA = transposed(a, pool), spd(n, n);
+        gemmParallel(pool, a, transposedA, spd);
+        for (std::size_t i = 0; i < n; i++) { spd(i, i) += double(n); }
+        CholeskyFactorization cholesky;
+        double choleskySeconds = bestTime(repeats, [&]() { cholesky = choleskyFactor(spd, pool); });
+        double choleskyResidual = scaledResidual(spd, choleskySolve(cholesky, b, pool), b, pool);
+
+        std::cout << std::setw(6) << n << std::fixed << std::setprecision(2)
+                  << std::setw(10) << 2 * cube / gemmSeconds * 1e-9 << std::setw(10) << 2 * cube / 3 / luSeconds * 1e-9
+                  << std::scientific << std::setprecision(2) << std::setw(12) << luResidual
+                  << std::fixed << std::setw(10) << cube / 3 / choleskySeconds * 1e-9
+                  << std::scientific << std::setw(12) << choleskyResidual << std::fixed
+                  << std::setw(10) << 2 * double(n) * double(n) * rightHandSides / solveSeconds * 1e-9
+                  << std::defaultfloat << std::endl;
+    }
+}
+
+
+// One row of benchmarkPrecision: T operands with Acc arithmetic through BasicMatrixCalculator, against double
+template<typename T, typename Acc = typename ElementTraits<T>::Accumulator>
+void benchmarkPrecisionRow(ThreadPool &pool, ConstMatrixView a, ConstMatrixView b, ConstMatrixView sum,
+                           ConstMatrixView product) {
+    typedef typename ElementTraits<T>::Result Result;
+    const std::size_t n = a.getRows();
+    const double scale = quantizationScale<T>(a), scaleB = quantizationScale<T>(b);
+    const int repeats = n <= 2048 ? 3 : 1;
+
+    // Both add operands share a's scale so the integers add up, b is roughly as large
+    BasicMatrixCalculator<T, Acc> calculator(0, 0);
+    calculator.setThreadPool(pool);
+    calculator.setMatrices(quantize<T>(a, scale), quantize<T>(b, scale));
+    const double addSeconds = bestTime(repeats, [&]() { calculator.matrixAdd(); });
+    const double addError = maxAbsDifference(dequantize(calculator.getResult(), scale), sum);
+
+    calculator.setMatrices(quantize<T>(a, scale), quantize<T>(b, scaleB));
+    const double multiplySeconds = bestTime(repeats, [&]() { calculator.matrixMultiply(); });
+    const double multiplyError = maxAbsDifference(dequantize(calculator.getResult(), scale * scaleB), product);
+
+    const double bytes = double(n) * double(n) * double(2 * sizeof(T) + sizeof(Result));
+    const double flops = 2.0 * double(n) * double(n) * double(n);
+    std::cout << std::setw(6) << n << std::setw(10) << (std::string(ElementTraits<T>::NAME) + "/" + ElementTraits<Acc>::NAME)
+              << std::fixed << std::setprecision(2) << std::setw(12) << bytes / addSeconds * 1e-9 << std::scientific
+              << std::setprecision(1) << std::setw(12) << addError << std::fixed << std::setprecision(2) << std::setw(12)
+              << flops / multiplySeconds * 1e-9 << std::scientific << std::setprecision(1) << std::setw(12)
+              << multiplyError << std::defaultfloat << std::endl;
+}
+
+
+// Add and multiply in every element type, throughput and error against the double result
+inline void benchmarkPrecision(const BenchmarkOptions &options) {
+    ThreadPool &pool = ThreadPool::global();
+    std::cout << "Element types, " << pool.getConcurrency() << " threads, inputs in [-1, 1), storage/accumulator, "
+              << "errors are max |result - double result|" << std::endl;
+    std::cout << std::setw(6) << "n" << std::setw(10) << "type" << std::setw(12) << "add GB/s" << std::setw(12)
+              << "add error" << std::setw(12) << "gemm GF/s" << std::setw(12) << "gemm error" << std::endl;
+
+    std::vector<std::size_t> sizes = {1024, 2048};
+    if (options.full) { sizes.push_back(4096); }
+    for (std::size_t n: sizes) {
+        Matrix a = randomMatrix(n, n, 1), b = randomMatrix(n, n, 2), sum(n, n), product(n, n);
+        elementwise(pool, AddOp(), a, b, sum);
+        gemmParallel(pool, a, b, product);
+
+        benchmarkPrecisionRow<double>(pool, a, b, sum, product);
+        benchmarkPrecisionRow<float, double>(pool, a, b, sum, product);
+        benchmarkPrecisionRow<float>(pool, a, b, sum, product);
+        benchmarkPrecisionRow<BFloat16>(pool, a, b, sum, product);
+        benchmarkPrecisionRow<Half>(pool, a, b, sum, product);
+        benchmarkPrecisionRow<std::int8_t>(pool, a, b, sum, product);
+    }
+}
+
+
+// An empty task that only hops onto the pool
+inline Task<> emptyTask(ThreadPool &pool) { co_await schedule(pool); }
+
+// Awaits depth - 1 nested tasks that finish without suspending, so each level is one frame and two transfers
+inline Task<> nestedTask(std::size_t depth) {
+    if (depth > 1) { co_await nestedTask(depth - 1); }
+}
+
+// Awaits an empty task per hop in sequence, each resumes on whichever worker picks up the post
+inline Task<> hopChain(ThreadPool &pool, std::size_t hops) {
+    for (std::size_t hop = 0; hop < hops; hop++) { co_await emptyTask(pool); }
+}
+
+
+// Nanoseconds per task to run tiny work through coroutines, pool futures and std::async
+inline void benchmarkCoroutines(const BenchmarkOptions &options) {
+    ThreadPool &pool = ThreadPool::global();
+    const std::size_t count = options.full ? 1000000 : 100000, asyncCount = 2000;
+    std::cout << "Scheduling overhead, " << pool.getConcurrency() << " threads, best of 5, ns per task" << std::endl;
+    std::cout << std::setw(34) << "method" << std::setw(10) << "tasks" << std::setw(12) << "ns/task" << std::endl;
+
+    auto report = [](const char *method, std::size_t tasks, double seconds) {
+        std::cout << std::setw(34) << method << std::setw(10) << tasks << std::fixed << std::setprecision(1)
+                  << std::setw(12) << seconds / double(tasks) * 1e9 << std::defaultfloat << std::endl;
+    };
+
+    report("co_await nested (no scheduling)", 1000, bestTime(5, [&]() { syncWait(pool, nestedTask(1000)); }));
+    report("co_await schedule, sequential", count, bestTime(5, [&]() { syncWait(pool, hopChain(pool, count)); }));
+    report("coroutine whenAll", count, bestTime(5, [&]() {
+        std::vector<Task<>> tasks;
+        tasks.reserve(count);
+        for (std::size_t i = 0; i < count; i++) { tasks.push_back(emptyTask(pool)); }
+        syncWait(pool, whenAll(pool, std::move(tasks)));
+    }));
+    report("pool.submit + future.get", count, bestTime(5, [&]() {
+        std::vector<std::future<void>> futures;
+        futures.reserve(count);
+        for (std::size_t i = 0; i < count; i++) { futures.push_back(pool.submit([]() { })); }
+        for (auto &future: futures) { future.get(); }
+    }));
+    report("std::async + future.get", asyncCount, bestTime(5, [&]() {
+        std::vector<std::future<void>> futures;
+        for (std::size_t i = 0; i < asyncCount; i++) { futures.push_back(std::async(std::launch::async, []() { })); }
+        for (auto &future: futures) { future.get(); }
+    }));
+
+    // Small operations, where the overhead is a visible part of the cost
+    const std::size_t calculatorCount = 4096;
+    std::vector<MatrixCalculator> calculators;
+    for (std::size_t i = 0; i < calculatorCount; i++) {
+        calculators.emplace_back(0, 0);
+        calculators.back().setMatrices(randomMatrix(16, 16, unsigned(i)), randomMatrix(16, 16, unsigned(i) + 1));
+    }
+    report("16x16 add, asyncAdd + whenAll", calculatorCount, bestTime(5, [&]() {
+        std::vector<Task<>> tasks;
+        for (MatrixCalculator &calculator: calculators) { tasks.push_back(asyncAdd(calculator)); }
+        syncWait(pool, whenAll(pool, std::move(tasks)));
+    }));
+    report("16x16 add, pool.submit + get", calculatorCount, bestTime(5, [&]() {
+        std::vector<std::future<void>> futures;
+        for (MatrixCalculator &calculator: calculators) { futures.push_back(pool.submit([&calculator]() { calculator.matrixAdd(); })); }
+        for (auto &future: futures) { future.get(); }
+    }));
+    report("16x16 add, inline", calculatorCount, bestTime(5, [&]() {
+        for (MatrixCalculator &calculator: calculators) { calculator.matrixAdd(); }
+    }));
+}
+
+
+// Entry point for --bench, returns the process exit code
+inline int runBenchmarks(int argc, char *argv[]) {
+    BenchmarkOptions options;
+    std::string name;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--full") == 0) { options.full = true; }
+        else if (std::strcmp(argv[i], "--bench") == 0 && i + 1 < argc) { name = argv[++i]; }
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) { options.maxThreads = std::stoul(argv[++i]); }
+    }
+
+    if (name == "gemm") {
+        benchmarkGemm(options);
+        return 0;
+    }
+    if (name == "elementwise") {
+        benchmarkElementwise(options);
+        return 0;
+    }
+    if (name == "expressions") {
+        benchmarkExpressions(options);
+        return 0;
+    }
+    if (name == "sparse") {
+        benchmarkSparse(options);
+        return 0;
+    }
+    if (name == "batched") {
+        benchmarkBatched(options);
+        return 0;
+    }
+    if (name == "solve") {
+        benchmarkSolve(options);
+        return 0;
+    }
+    if (name == "strassen") {
+        benchmarkStrassen(options);
+        return 0;
+    }
+    if (name == "transpose") {
+        benchmarkTranspose(options);
+        return 0;
+    }
+    if (name == "stream") {
+        benchmarkStream(options);
+        return 0;
+    }
+    if (name == "precision") {
+        benchmarkPrecision(options);
+        return 0;
+    }
+    if (name == "coroutines") {
+        benchmarkCoroutines(options);
+        return 0;
+    }
+    if (name == "scaling") {
+        benchmarkScaling(options);
+        return 0;
+    }
+    std::cerr << "Unknown benchmark '" << name << "', available: gemm, scaling, elementwise, expressions, sparse, batched, stream, transpose, strassen, solve, precision, coroutines" << std::endl;
+    return 1;
+}
+
+#endif //MATRIX_MULTIPROCESSING_BENCHMARKS_H
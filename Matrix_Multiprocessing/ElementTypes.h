@@ -0,0 +1,323 @@
+#ifndef MATRIX_MULTIPROCESSING_ELEMENTTYPES_H
+#define MATRIX_MULTIPROCESSING_ELEMENTTYPES_H
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include "Matrix.h"
+#include "Simd.h"
+
+/**
+ *  Element types narrower than double, and the conversions the kernels use between storage and arithmetic.
+ *
+ *  A matrix of T is stored as T but computed on in ElementTraits<T>::Accumulator: loads widen each vector to the
+ *  accumulator type, results are rounded back to ElementTraits<T>::Result on the store. The element-wise kernels
+ *  are memory bound, so halving or quartering the bytes per element is what makes them faster; gemm converts
+ *  while packing its panels, so its micro-kernel runs on floats (twice the lanes of doubles) or int32.
+ *
+ *      double      accumulates in double, result double
+ *      float       accumulates in float (or double if asked), result float
+ *      BFloat16    8-bit mantissa, float's range; accumulates in float, result BFloat16
+ *      Half        IEEE binary16, 11-bit mantissa, max 65504; accumulates in float, result Half
+ *      int8_t      accumulates in int32, result int32 (quantized data, see quantize())
+ *
+ *  BFloat16 and Half are plain 16-bit patterns. Conversions round to nearest even and are written once for
+ *  scalars and vector-extension types alike, so the vector paths are branch-free integer and float arithmetic.
+ */
+
+// Copies the bits of from into to, both the same size
+template<typename To, typename From>
+MATRIX_INLINE void bitCast(To &to, const From &from) {
+    static_assert(sizeof(To) == sizeof(From), "bitCast needs types of the same size");
+    std::memcpy(&to, &from, sizeof(To));
+}
+
+
+// Trivial types like double, so matrices of them are zeroed and copied bytewise; a default-constructed value is
+// uninitialized
+struct BFloat16 {
+    std::uint16_t bits;
+
+    BFloat16() = default;
+    explicit BFloat16(float value) {
+        std::uint32_t wide;
+        narrow(wide, value);
+        bits = std::uint16_t(wide);
+    }
+
+    explicit operator float() const {
+        float value;
+        widen(value, std::uint32_t(bits));
+        return value;
+    }
+
+    // value = the float for 16-bit patterns held in 32-bit lanes (U: uint32_t or a vector of them, F: matching floats)
+    template<typename F, typename U>
+    static MATRIX_INLINE void widen(F &value, const U &wide) {
+        bitCast(value, U(wide << 16));
+    }
+
+    // wide = 16-bit patterns of value in 32-bit lanes, rounded to nearest even, NaN stays NaN
+    template<typename U, typename F>
+    static MATRIX_INLINE void narrow(U &wide, const F &value) {
+        U f;
+        bitCast(f, value);
+        const U rounded = (f + 0x7fffu + ((f >> 16) & 1u)) >> 16;
+        const U quietNan = (f >> 16) | 0x40u;
+        wide = (f & 0x7fffffffu) > 0x7f800000u ? quietNan : rounded;
+    }
+};
+
+
+struct Half {
+    std::uint16_t bits;
+
+    Half() = default;
+    explicit Half(float value) {
+        std::uint32_t wide;
+        narrow(wide, value);
+        bits = std::uint16_t(wide);
+    }
+
+    explicit operator float() const {
+        float value;
+        widen(value, std::uint32_t(bits));
+        return value;
+    }
+
+    // Same contract as BFloat16::widen. Subnormals are rebuilt with a float subtraction instead of a bit scan
+    template<typename F, typename U>
+    static MATRIX_INLINE void widen(F &value, const U &wide) {
+        const U magnitude = (wide & 0x7fffu) << 13;      // exponent and mantissa at float's positions
+        const U exponent = wide & 0x7c00u;
+
+        F subnormal;
+        bitCast(subnormal, U(magnitude + (113u << 23)));
+        subnormal -= 0x1p-14f;
+        U subnormalBits;
+        bitCast(subnormalBits, subnormal);
+
+        const U normal = magnitude + (112u << 23);       // rebias 15 -> 127
+        const U special = magnitude + (224u << 23);      // infinity and NaN: exponent 31 -> 255
+        U bits = exponent == 0 ? subnormalBits : exponent == 0x7c00u ? special : normal;
+        bits |= (wide & 0x8000u) << 16;
+        bitCast(value, bits);
+    }
+
+    // Same contract as BFloat16::narrow, values beyond 65504 round to infinity
+    template<typename U, typename F>
+    static MATRIX_INLINE void narrow(U &wide, const F &value) {
+        U f;
+        bitCast(f, value);
+        const U sign = f & 0x80000000u;
+        f ^= sign;
+
+        const U infinity = U{} + 0x7c00u, quietNan = U{} + 0x7e00u;
+        const U overflow = f > (255u << 23) ? quietNan : infinity;
+
+        // Below 2^-14 the result is subnormal: adding 0.5 lines the mantissa up so the float add does the rounding
+        F shifted;
+        bitCast(shifted, f);
+        shifted += 0.5f;
+        U subnormal;
+        bitCast(subnormal, shifted);
+        subnormal -= 126u << 23;
+
+        const U odd = (f >> 13) & 1u;
+        const U normal = (f + (std::uint32_t(15 - 127) << 23) + 0xfffu + odd) >> 13;
+
+        wide = f >= (143u << 23) ? overflow : f < (113u << 23) ? subnormal : normal;
+        wide |= sign >> 16;
+    }
+};
+
+
+template<typename T>
+inline constexpr bool IS_HALF_FLOAT = std::is_same_v<T, BFloat16> || std::is_same_v<T, Half>;
+
+
+template<typename T>
+struct ElementTraits;
+
+template<>
+struct ElementTraits<double> {
+    typedef double Accumulator;
+    typedef double Result;
+    static constexpr const char *NAME = "f64";
+};
+
+template<>
+struct ElementTraits<float> {
+    typedef float Accumulator;
+    typedef float Result;
+    static constexpr const char *NAME = "f32";
+};
+
+template<>
+struct ElementTraits<BFloat16> {
+    typedef float Accumulator;
+    typedef BFloat16 Result;
+    static constexpr const char *NAME = "bf16";
+};
+
+template<>
+struct ElementTraits<Half> {
+    typedef float Accumulator;
+    typedef Half Result;
+    static constexpr const char *NAME = "f16";
+};
+
+template<>
+struct ElementTraits<std::int8_t> {
+    typedef std::int32_t Accumulator;
+    typedef std::int32_t Result;
+    static constexpr const char *NAME = "i8";
+};
+
+template<>
+struct ElementTraits<std::int32_t> {
+    typedef std::int32_t Accumulator;
+    typedef std::int32_t Result;
+    static constexpr const char *NAME = "i32";
+};
+
+
+// One element converted to To, through float for the 16-bit types. Integers are truncated, see quantize()
+template<typename To, typename From>
+MATRIX_INLINE To convertElement(const From &value) {
+    if constexpr (std::is_same_v<To, From>) {
+        return value;
+    } else if constexpr (IS_HALF_FLOAT<To>) {
+        return To(float(convertElement<float>(value)));
+    } else if constexpr (IS_HALF_FLOAT<From>) {
+        return static_cast<To>(float(value));
+    } else {
+        return static_cast<To>(value);
+    }
+}
+
+
+// value = narrow converted lane by lane. Integers widen at most 2x per step: GCC lowers a direct int8 -> int32
+// conversion one lane at a time, but each 2x step to a single sign-extending move
+template<typename V, typename N>
+MATRIX_INLINE void widenVector(V &value, const N &narrow) {
+    typedef SimdElement<N> From;
+    constexpr int W = int(sizeof(N) / sizeof(From));
+
+    if constexpr (std::is_integral_v<From> && 2 * sizeof(From) < sizeof(SimdElement<V>)) {
+        typedef std::conditional_t<sizeof(From) == 1, std::int16_t, std::int32_t> Signed;
+        typedef std::conditional_t<std::is_signed_v<From>, Signed, std::make_unsigned_t<Signed>> Step;
+        typedef typename SimdVector<Step, W>::type Wider;
+        widenVector(value, __builtin_convertvector(narrow, Wider));
+    } else {
+        value = __builtin_convertvector(narrow, V);
+    }
+}
+
+
+/**
+ *  value (a vector of the accumulator type, or a single accumulator) = the elements at source, widened.
+ *  Same-type loads are a plain loadVector; everything else is widenVector, via float for the 16-bit types.
+ */
+template<typename V, typename T>
+MATRIX_INLINE void loadConverted(V &value, const T *source) {
+    typedef SimdElement<V> E;
+    constexpr int W = int(sizeof(V) / sizeof(E));
+
+    if constexpr (std::is_same_v<E, T>) {
+        loadVector(value, source);
+    } else if constexpr (std::is_same_v<V, E>) {
+        value = convertElement<E>(*source);
+    } else if constexpr (IS_HALF_FLOAT<T>) {
+        typedef typename SimdVector<std::uint16_t, W>::type Narrow;
+        typedef typename SimdVector<std::uint32_t, W>::type Wide;
+        typedef typename SimdVector<float, W>::type Float;
+        Narrow raw;
+        loadVector(raw, source);
+        Float widened;
+        T::widen(widened, __builtin_convertvector(raw, Wide));
+        value = __builtin_convertvector(widened, V);
+    } else {
+        typename SimdVector<T, W>::type raw;
+        loadVector(raw, source);
+        widenVector(value, raw);
+    }
+}
+
+// The elements of value (accumulator vector or scalar), rounded to T, stored at destination
+template<typename T, typename V>
+MATRIX_INLINE void storeConverted(T *destination, const V &value) {
+    typedef SimdElement<V> E;
+    constexpr int W = int(sizeof(V) / sizeof(E));
+
+    if constexpr (std::is_same_v<E, T>) {
+        storeVector(destination, value);
+    } else if constexpr (std::is_same_v<V, E>) {
+        *destination = convertElement<T>(value);
+    } else if constexpr (IS_HALF_FLOAT<T>) {
+        typedef typename SimdVector<std::uint16_t, W>::type Narrow;
+        typedef typename SimdVector<std::uint32_t, W>::type Wide;
+        typedef typename SimdVector<float, W>::type Float;
+        Wide bits;
+        T::narrow(bits, __builtin_convertvector(value, Float));
+        storeVector(destination, __builtin_convertvector(bits, Narrow));
+    } else {
+        storeVector(destination, __builtin_convertvector(value, typename SimdVector<T, W>::type));
+    }
+}
+
+
+/**
+ *  Scale that maps source onto T: for integer T the largest magnitude goes to the largest value of T, so
+ *  quantize(source, scale) uses the whole range; floating-point types need no scale (1).
+ */
+template<typename T>
+double quantizationScale(ConstMatrixView source) {
+    if constexpr (!std::is_integral_v<T>) {
+        return 1.0;
+    } else {
+        double largest = 0;
+        for (std::size_t row = 0; row < source.getRows(); row++) {
+            for (std::size_t col = 0; col < source.getCols(); col++) { largest = std::max(largest, std::fabs(source(row, col))); }
+        }
+        return largest == 0 ? 1.0 : largest / double(std::numeric_limits<T>::max());
+    }
+}
+
+// source / scale as T: rounded to nearest (and saturated) for integers, rounded to the format otherwise
+template<typename T>
+BasicMatrix<T> quantize(ConstMatrixView source, double scale = 1.0) {
+    BasicMatrix<T> result(source.getRows(), source.getCols());
+    for (std::size_t row = 0; row < source.getRows(); row++) {
+        for (std::size_t col = 0; col < source.getCols(); col++) {
+            const double value = source(row, col) / scale;
+            if constexpr (std::is_integral_v<T>) {
+                const double limit = double(std::numeric_limits<T>::max());
+                result(row, col) = T(std::lround(std::clamp(value, -limit, limit)));
+            } else {
+                result(row, col) = convertElement<T>(value);
+            }
+        }
+    }
+    return result;
+}
+
+// scale * source as doubles, the inverse of quantize()
+template<typename T>
+Matrix dequantize(BasicConstMatrixView<T> source, double scale = 1.0) {
+    Matrix result(source.getRows(), source.getCols());
+    for (std::size_t row = 0; row < source.getRows(); row++) {
+        for (std::size_t col = 0; col < source.getCols(); col++) {
+            result(row, col) = scale * convertElement<double>(source(row, col));
+        }
+    }
+    return result;
+}
+
+#endif //MATRIX_MULTIPROCESSING_ELEMENTTYPES_H
@@ -0,0 +1,281 @@
+#ifndef MATRIX_MULTIPROCESSING_ELEMENTWISE_H
+#define MATRIX_MULTIPROCESSING_ELEMENTWISE_H
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include "ElementTypes.h"
+#include "Matrix.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+/**
+ *  Fused element-wise kernels: out = op(a, b) and sum(out) in a single pass over memory.
+ *
+ *  The sum is spread over ELEMENTWISE_LANES independent Kahan-compensated accumulators, element (row, col) always
+ *  going to lane col % ELEMENTWISE_LANES. Independent lanes break the serial += dependency so the loop vectorizes,
+ *  and compensation keeps the error flat as matrices grow. Each tile of rows folds its lanes with a fixed pairwise
+ *  tree, and tiles are combined in row order with Kahan again.
+ *
+ *  Tiles are a fixed number of rows (ELEMENTWISE_TILE_ELEMENTS / cols), and every SIMD level uses the same lane
+ *  layout and operation order, so the sum is bit-for-bit the same for any thread count. Add, subtract and scale
+ *  also agree across SIMD levels; multiply-add can differ in the last bit where the compiler contracts to FMA.
+ *
+ *  The basic*() entry points take matrices of any element type (ElementTypes.h): each vector is widened to the
+ *  accumulator type Acc, the op runs in Acc, and the result is rounded to the output's type as it is stored.
+ *  The sum is always kept in double lanes, whatever Acc is.
+ */
+
+static constexpr std::size_t ELEMENTWISE_LANES = 32;
+static constexpr std::size_t ELEMENTWISE_TILE_ELEMENTS = 16384;
+
+
+// Ops are applied to both vectors and single elements. Operands and result go by reference, like loadVector,
+// so no wide vector is passed by value outside an AVX function (-Wpsabi). alpha is cast to the element type
+struct AddOp {
+    template<typename T>
+    MATRIX_INLINE void operator()(T &result, const T &a, const T &b) const { result = a + b; }
+};
+
+struct SubtractOp {
+    template<typename T>
+    MATRIX_INLINE void operator()(T &result, const T &a, const T &b) const { result = a - b; }
+};
+
+// alpha * a, b is ignored
+struct ScaleOp {
+    double alpha;
+
+    template<typename T>
+    MATRIX_INLINE void operator()(T &result, const T &a, const T &) const { result = SimdElement<T>(alpha) * a; }
+};
+
+// alpha * a + b
+struct MultiplyAddOp {
+    double alpha;
+
+    template<typename T>
+    MATRIX_INLINE void operator()(T &result, const T &a, const T &b) const { result = SimdElement<T>(alpha) * a + b; }
+};
+
+// -a, b is ignored
+struct NegateOp {
+    template<typename T>
+    MATRIX_INLINE void operator()(T &result, const T &a, const T &) const { result = -a; }
+};
+
+
+// Kahan running sum, value() folds the compensation back in
+struct CompensatedSum {
+    double sum = 0;
+    double compensation = 0;
+
+    void add(double value) {
+        double corrected = value - compensation;
+        double total = sum + corrected;
+        compensation = (total - sum) - corrected;
+        sum = total;
+    }
+
+    double value() const { return sum - compensation; }
+};
+
+
+template<typename V>
+MATRIX_INLINE void kahanAdd(V &sum, V &compensation, const V &value) {
+    V corrected = value - compensation;
+    V total = sum + corrected;
+    compensation = (total - sum) - corrected;
+    sum = total;
+}
+
+
+/**
+ *  A source is anything the tile kernel can read element-wise: getRows(), getCols() and
+ *  load(T &value, row, col), which fills a vector (or a single element) starting at (row, col).
+ *  MatrixSource reads memory, BinarySource combines two matrices with an op; Expressions.h builds deeper trees.
+ */
+template<typename E>
+struct BasicMatrixSource {
+    BasicConstMatrixView<E> matrix;
+
+    std::size_t getRows() const { return matrix.getRows(); }
+    std::size_t getCols() const { return matrix.getCols(); }
+
+    template<typename T>
+    MATRIX_INLINE void load(T &value, std::size_t row, std::size_t col) const {
+        loadConverted(value, matrix.rowData(row) + col);
+    }
+};
+
+typedef BasicMatrixSource<double> MatrixSource;
+
+template<typename Op, typename E = double>
+struct BinarySource {
+    Op op;
+    BasicMatrixSource<E> left;
+    BasicMatrixSource<E> right;
+
+    std::size_t getRows() const { return left.getRows(); }
+    std::size_t getCols() const { return left.getCols(); }
+
+    template<typename T>
+    MATRIX_INLINE void load(T &value, std::size_t row, std::size_t col) const {
+        T x, y;
+        left.load(x, row, col);
+        right.load(y, row, col);
+        op(value, x, y);
+    }
+};
+
+
+// out[rowBegin:rowEnd] = source computed in Acc (only if Store), returns the sum of those rows
+template<typename Source, bool Store, int W, typename Acc, typename R>
+MATRIX_INLINE double elementwiseTile(const Source &source, BasicMatrixView<R> out, std::size_t rowBegin,
+                                     std::size_t rowEnd) {
+    typedef typename SimdVector<Acc, W>::type V;
+    typedef typename SimdVector<double, W>::type S;
+    constexpr std::size_t NV = ELEMENTWISE_LANES / W;
+    const std::size_t cols = source.getCols();
+
+    S sum[NV], compensation[NV];
+    MATRIX_UNROLL
+    for (std::size_t j = 0; j < NV; j++) { sum[j] = compensation[j] = S{}; }
+
+    for (std::size_t row = rowBegin; row < rowEnd; row++) {
+        R *result = Store ? out.rowData(row) : nullptr;
+
+        std::size_t col = 0;
+        for (; col + ELEMENTWISE_LANES <= cols; col += ELEMENTWISE_LANES) {
+            MATRIX_UNROLL
+            for (std::size_t j = 0; j < NV; j++) {
+                V value;
+                source.load(value, row, col + j * W);
+                if (Store) { storeConverted(result + col + j * W, value); }
+                kahanAdd(sum[j], compensation[j], __builtin_convertvector(value, S));
+            }
+        }
+
+        // Ragged end of the row: zero-padded so it goes through the same lanes as a full block
+        if (col < cols) {
+            alignas(MATRIX_ALIGNMENT) Acc tail[ELEMENTWISE_LANES] = {};
+            for (std::size_t i = 0; col + i < cols; i++) { source.load(tail[i], row, col + i); }
+            if (Store) {
+                for (std::size_t i = 0; col + i < cols; i++) { result[col + i] = convertElement<R>(tail[i]); }
+            }
+
+            MATRIX_UNROLL
+            for (std::size_t j = 0; j < NV; j++) {
+                V value;
+                loadVector(value, tail + j * W);
+                kahanAdd(sum[j], compensation[j], __builtin_convertvector(value, S));
+            }
+        }
+    }
+
+    alignas(MATRIX_ALIGNMENT) double lanes[ELEMENTWISE_LANES];
+    for (std::size_t j = 0; j < NV; j++) { storeVector(lanes + j * W, S(sum[j] - compensation[j])); }
+    for (std::size_t width = ELEMENTWISE_LANES / 2; width >= 1; width /= 2) {
+        for (std::size_t i = 0; i < width; i++) { lanes[i] += lanes[i + width]; }
+    }
+    return lanes[0];
+}
+
+
+template<typename Source, bool Store, typename Acc, typename R>
+double elementwiseTileScalar(const Source &source, BasicMatrixView<R> out, std::size_t rowBegin, std::size_t rowEnd) {
+    return elementwiseTile<Source, Store, 1, Acc>(source, out, rowBegin, rowEnd);
+}
+
+#ifdef MATRIX_X86_SIMD
+template<typename Source, bool Store, typename Acc, typename R>
+MATRIX_TARGET_AVX2 double elementwiseTileAvx2(const Source &source, BasicMatrixView<R> out, std::size_t rowBegin,
+                                              std::size_t rowEnd) {
+    return elementwiseTile<Source, Store, 32 / sizeof(Acc), Acc>(source, out, rowBegin, rowEnd);
+}
+
+template<typename Source, bool Store, typename Acc, typename R>
+MATRIX_TARGET_AVX512 double elementwiseTileAvx512(const Source &source, BasicMatrixView<R> out, std::size_t rowBegin,
+                                                  std::size_t rowEnd) {
+    return elementwiseTile<Source, Store, 64 / sizeof(Acc), Acc>(source, out, rowBegin, rowEnd);
+}
+#endif
+
+
+inline std::size_t elementwiseRowsPerTile(std::size_t cols) {
+    return std::max<std::size_t>(1, ELEMENTWISE_TILE_ELEMENTS / std::max<std::size_t>(1, cols));
+}
+
+
+/**
+ *  Evaluates source over all rows in fixed-size tiles on the pool, writing to out if Store, returns the sum.
+ *  The kernels are memory bound, so tiles are scheduled statically: every thread gets the same rows on every
+ *  call, which are the rows it first-touched if the matrices came from allocateFirstTouch (Numa.h).
+ */
+template<typename Source, bool Store, typename Acc = double, typename R = double>
+double elementwiseRun(ThreadPool &pool, const Source &source, BasicMatrixView<R> out, SimdLevel level) {
+    if (Store && (out.getRows() != source.getRows() || out.getCols() != source.getCols())) {
+        throw std::invalid_argument("Element-wise result has a different shape than its operands");
+    }
+
+    auto tileKernel = elementwiseTileScalar<Source, Store, Acc, R>;
+#ifdef MATRIX_X86_SIMD
+    if (level == SimdLevel::AVX512) { tileKernel = elementwiseTileAvx512<Source, Store, Acc, R>; }
+    else if (level == SimdLevel::AVX2) { tileKernel = elementwiseTileAvx2<Source, Store, Acc, R>; }
+#else
+    (void) level;
+#endif
+
+    const std::size_t rowsPerTile = elementwiseRowsPerTile(source.getCols());
+    CompensatedSum total = pool.parallelReduce(source.getRows(), rowsPerTile, CompensatedSum(),
+        [&](std::size_t begin, std::size_t end) {
+            CompensatedSum tile;
+            tile.add(tileKernel(source, out, begin, end));
+            return tile;
+        },
+        [](CompensatedSum sum, const CompensatedSum &tile) {
+            sum.add(tile.value());
+            return sum;
+        }, Schedule::STATIC);
+    return total.value();
+}
+
+
+// out = op(a, b) computed in Acc, returns sum(out) before rounding to R
+template<typename Acc, typename Op, typename E, typename R>
+double basicElementwise(ThreadPool &pool, const Op &op, BasicConstMatrixView<E> a, BasicConstMatrixView<E> b,
+                        BasicMatrixView<R> out, SimdLevel level = activeSimdLevel()) {
+    if (b.getRows() != a.getRows() || b.getCols() != a.getCols()) {
+        throw std::invalid_argument("Element-wise operands have different shapes");
+    }
+    return elementwiseRun<BinarySource<Op, E>, true, Acc>(pool, BinarySource<Op, E>{op, {a}, {b}}, out, level);
+}
+
+// out = a converted element by element through Acc, returns sum(a)
+template<typename Acc, typename E, typename R>
+double convertInto(ThreadPool &pool, BasicConstMatrixView<E> a, BasicMatrixView<R> out,
+                   SimdLevel level = activeSimdLevel()) {
+    return elementwiseRun<BasicMatrixSource<E>, true, Acc>(pool, BasicMatrixSource<E>{a}, out, level);
+}
+
+// sum(a) with a widened to Acc, same lanes and order as the fused kernels
+template<typename Acc, typename E>
+double basicSumOf(ThreadPool &pool, BasicConstMatrixView<E> a, SimdLevel level = activeSimdLevel()) {
+    return elementwiseRun<BasicMatrixSource<E>, false, Acc>(pool, BasicMatrixSource<E>{a}, BasicMatrixView<Acc>(), level);
+}
+
+// out = op(a, b), returns sum(out)
+template<typename Op>
+double elementwise(ThreadPool &pool, const Op &op, ConstMatrixView a, ConstMatrixView b, MatrixView out,
+                   SimdLevel level = activeSimdLevel()) {
+    return basicElementwise<double>(pool, op, a, b, out, level);
+}
+
+// sum(a), same lanes and order as the fused kernels
+inline double sumOf(ThreadPool &pool, ConstMatrixView a, SimdLevel level = activeSimdLevel()) {
+    return basicSumOf<double>(pool, a, level);
+}
+
+#endif //MATRIX_MULTIPROCESSING_ELEMENTWISE_H
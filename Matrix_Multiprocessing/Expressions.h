@@ -0,0 +1,152 @@
+#ifndef MATRIX_MULTIPROCESSING_EXPRESSIONS_H
+#define MATRIX_MULTIPROCESSING_EXPRESSIONS_H
+
+#pragma once
+
+#include <stdexcept>
+#include <type_traits>
+#include "Elementwise.h"
+#include "Matrix.h"
+#include "ThreadPool.h"
+
+/**
+ *  Lazy element-wise matrix expressions.
+ *
+ *  Operators on matrices and views build a tree of small value-type nodes instead of computing anything:
+ *
+ *      double sum = assign(d, a + b - c * 2.0);
+ *
+ *  runs a single pass over the rows through the fused element-wise kernel (Elementwise.h): every vector of d is
+ *  computed from a, b and c in registers, with no temporaries and each operand read once. Nodes are Elementwise
+ *  sources, so expressions get the same SIMD dispatch, thread tiling and deterministic compensated sum.
+ *
+ *  Nodes store views, not matrices: the operands must outlive the expression. Writing into an operand is fine,
+ *  every element is read before it is written.
+ */
+
+template<typename Derived>
+struct MatrixExpression {
+    const Derived &self() const { return static_cast<const Derived &>(*this); }
+
+    std::size_t getRows() const { return self().getRows(); }
+    std::size_t getCols() const { return self().getCols(); }
+};
+
+
+// Leaf: a matrix in memory
+struct MatrixTerm : MatrixExpression<MatrixTerm> {
+    MatrixSource source;
+
+    explicit MatrixTerm(ConstMatrixView matrix) : source{matrix} { }
+
+    std::size_t getRows() const { return source.getRows(); }
+    std::size_t getCols() const { return source.getCols(); }
+
+    template<typename T>
+    MATRIX_INLINE void load(T &value, std::size_t row, std::size_t col) const { source.load(value, row, col); }
+};
+
+
+// op(left, right), an Elementwise.h op
+template<typename Op, typename Left, typename Right>
+struct BinaryExpression : MatrixExpression<BinaryExpression<Op, Left, Right>> {
+    Op op;
+    Left left;
+    Right right;
+
+    BinaryExpression(Op op, Left left, Right right) : op(op), left(left), right(right) {
+        if (left.getRows() != right.getRows() || left.getCols() != right.getCols()) {
+            throw std::invalid_argument("Matrix expression operands have different shapes");
+        }
+    }
+
+    std::size_t getRows() const { return left.getRows(); }
+    std::size_t getCols() const { return left.getCols(); }
+
+    template<typename T>
+    MATRIX_INLINE void load(T &value, std::size_t row, std::size_t col) const {
+        T x, y;
+        left.load(x, row, col);
+        right.load(y, row, col);
+        op(value, x, y);
+    }
+};
+
+
+// op(inner), for ops that ignore their second operand (scale, negate)
+template<typename Op, typename Inner>
+struct UnaryExpression : MatrixExpression<UnaryExpression<Op, Inner>> {
+    Op op;
+    Inner inner;
+
+    UnaryExpression(Op op, Inner inner) : op(op), inner(inner) { }
+
+    std::size_t getRows() const { return inner.getRows(); }
+    std::size_t getCols() const { return inner.getCols(); }
+
+    template<typename T>
+    MATRIX_INLINE void load(T &value, std::size_t row, std::size_t col) const {
+        T x;
+        inner.load(x, row, col);
+        op(value, x, x);
+    }
+};
+
+
+// Anything that can appear in an expression: matrices, views and other expressions
+inline MatrixTerm asExpression(const Matrix &matrix) { return MatrixTerm(matrix.view()); }
+inline MatrixTerm asExpression(ConstMatrixView view) { return MatrixTerm(view); }
+inline MatrixTerm asExpression(MatrixView view) { return MatrixTerm(view); }
+
+template<typename Derived>
+const Derived &asExpression(const MatrixExpression<Derived> &expression) { return expression.self(); }
+
+template<typename T>
+concept MatrixOperand = requires(const T &operand) { asExpression(operand); };
+
+template<typename T>
+using ExpressionOf = std::decay_t<decltype(asExpression(std::declval<const T &>()))>;
+
+
+template<MatrixOperand Left, MatrixOperand Right>
+BinaryExpression<AddOp, ExpressionOf<Left>, ExpressionOf<Right>> operator+(const Left &left, const Right &right) {
+    return {AddOp(), asExpression(left), asExpression(right)};
+}
+
+template<MatrixOperand Left, MatrixOperand Right>
+BinaryExpression<SubtractOp, ExpressionOf<Left>, ExpressionOf<Right>> operator-(const Left &left, const Right &right) {
+    return {SubtractOp(), asExpression(left), asExpression(right)};
+}
+
+template<MatrixOperand Inner>
+UnaryExpression<ScaleOp, ExpressionOf<Inner>> operator*(const Inner &inner, double alpha) {
+    return {ScaleOp{alpha}, asExpression(inner)};
+}
+
+template<MatrixOperand Inner>
+UnaryExpression<ScaleOp, ExpressionOf<Inner>> operator*(double alpha, const Inner &inner) {
+    return {ScaleOp{alpha}, asExpression(inner)};
+}
+
+template<MatrixOperand Inner>
+UnaryExpression<NegateOp, ExpressionOf<Inner>> operator-(const Inner &inner) {
+    return {NegateOp(), asExpression(inner)};
+}
+
+
+// out = expression in one fused pass, returns sum(out)
+template<typename Derived>
+double assign(MatrixView out, const MatrixExpression<Derived> &expression, ThreadPool &pool = ThreadPool::global(),
+              SimdLevel level = activeSimdLevel()) {
+    return elementwiseRun<Derived, true>(pool, expression.self(), out, level);
+}
+
+// New matrix holding the expression's value
+template<typename Derived>
+Matrix evaluate(const MatrixExpression<Derived> &expression, ThreadPool &pool = ThreadPool::global()) {
+    Matrix result(expression.getRows(), expression.getCols());
+    assign(result.view(), expression, pool);
+    return result;
+}
+
+#endif //MATRIX_MULTIPROCESSING_EXPRESSIONS_H
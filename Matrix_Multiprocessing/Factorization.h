@@ -0,0 +1,347 @@
+#ifndef MATRIX_MULTIPROCESSING_FACTORIZATION_H
+#define MATRIX_MULTIPROCESSING_FACTORIZATION_H
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "Gemm.h"
+#include "Matrix.h"
+#include "TaskGraph.h"
+#include "ThreadPool.h"
+#include "Transpose.h"
+
+/**
+ *  Dense LU and Cholesky factorizations and multi-right-hand-side solves.
+ *
+ *  Both are blocked in FACTOR_BLOCK columns, so almost all the work is gemm, and both are scheduled as a task
+ *  graph (TaskGraph.h) instead of step by step:
+ *
+ *      LU (right-looking, partial pivoting): per step k, PANEL(k) factors column block k, and UPDATE(k, j) applies
+ *      its row swaps, triangular solve and gemm update to column block j > k. PANEL(k + 1) only waits for
+ *      UPDATE(k, k + 1), so the next panel is factored while the rest of step k's trailing update still runs
+ *      (lookahead), instead of the panel being a serial bottleneck between two parallel updates.
+ *
+ *      Cholesky (tiled, A = L * L^T, lower): POTRF(k) factors diagonal tile k, TRSM(i, k) the tiles below it,
+ *      and UPDATE(i, j, k) subtracts L(i, k) * L(j, k)^T from tile (i, j). Every task waits for exactly the
+ *      tiles it reads, so steps overlap freely.
+ *
+ *  Solves work on whole blocks of right-hand sides: the triangular solves are blocked the same way, with the
+ *  off-diagonal updates done by gemm over all columns of B at once.
+ */
+
+static constexpr std::size_t FACTOR_BLOCK = 128;
+
+
+struct LuFactorization {
+    Matrix lu;                          // L below the diagonal (unit diagonal implied), U on and above it
+    std::vector<std::size_t> pivots;    // row i was swapped with row pivots[i] at step i, in order
+};
+
+struct CholeskyFactorization {
+    Matrix lower;                       // L, zero above the diagonal
+    Matrix upper;                       // L^T, kept for the backward solve
+};
+
+
+// Swaps rows [first, last) with their pivots, in order, within columns [col, col + cols)
+inline void applyPivots(MatrixView a, const std::vector<std::size_t> &pivots, std::size_t first, std::size_t last,
+                        std::size_t col, std::size_t cols) {
+    for (std::size_t row = first; row < last; row++) {
+        if (pivots[row] == row) { continue; }
+        double *x = a.rowData(row) + col, *y = a.rowData(pivots[row]) + col;
+        for (std::size_t j = 0; j < cols; j++) { std::swap(x[j], y[j]); }
+    }
+}
+
+
+// b = l^-1 * b for a unit lower triangular l, by row operations
+inline void unitLowerSolve(ConstMatrixView l, MatrixView b) {
+    for (std::size_t i = 1; i < b.getRows(); i++) {
+        double *x = b.rowData(i);
+        for (std::size_t p = 0; p < i; p++) {
+            const double factor = l(i, p), *y = b.rowData(p);
+            for (std::size_t col = 0; col < b.getCols(); col++) { x[col] -= factor * y[col]; }
+        }
+    }
+}
+
+
+/**
+ *  LU with partial pivoting of columns [col, col + width), rows col .. end, swaps confined to those columns.
+ *  Recursive: the left half is factored, its swaps and L are applied to the right half (triangular solve and
+ *  gemm), then the right half is factored. Only LU_PANEL_LEAF-wide slices are done column by column, so most
+ *  of the panel's work is gemm instead of rank-1 updates streaming the whole tall panel once per column.
+ */
+static constexpr std::size_t LU_PANEL_LEAF = 16;
+
+inline void luPanel(MatrixView a, std::vector<std::size_t> &pivots, std::size_t col, std::size_t width) {
+    const std::size_t n = a.getRows(), end = col + width;
+    if (width > LU_PANEL_LEAF) {
+        const std::size_t half = width / 2, mid = col + half;
+        luPanel(a, pivots, col, half);
+        applyPivots(a, pivots, col, mid, mid, end - mid);
+        unitLowerSolve(a.block(col, col, half, half), a.block(col, mid, half, end - mid));
+        if (mid < n) {
+            gemm(a.block(mid, col, n - mid, half), a.block(col, mid, half, end - mid), a.block(mid, mid, n - mid, end - mid),
+                 -1.0, 1.0);
+        }
+        luPanel(a, pivots, mid, end - mid);
+        applyPivots(a, pivots, mid, end, col, half);
+        return;
+    }
+
+    for (std::size_t j = col; j < end; j++) {
+        std::size_t pivot = j;
+        for (std::size_t row = j + 1; row < n; row++) {
+            if (std::fabs(a(row, j)) > std::fabs(a(pivot, j))) { pivot = row; }
+        }
+        if (a(pivot, j) == 0) { throw std::runtime_error("Matrix is singular"); }
+        pivots[j] = pivot;
+        if (pivot != j) {
+            for (std::size_t c = col; c < end; c++) { std::swap(a(j, c), a(pivot, c)); }
+        }
+
+        const double inverse = 1.0 / a(j, j);
+        const double *top = a.rowData(j);
+        for (std::size_t row = j + 1; row < n; row++) {
+            double *current = a.rowData(row);
+            const double factor = current[j] *= inverse;
+            for (std::size_t c = j + 1; c < end; c++) { current[c] -= factor * top[c]; }
+        }
+    }
+}
+
+
+/**
+ *  b = t^-1 * b for a square triangular t, blocked: diagonal blocks by substitution (row operations, parallel
+ *  over the columns of b), off-diagonal blocks by gemm.
+ */
+inline void triangularSolve(ConstMatrixView t, MatrixView b, bool lower, bool unitDiagonal, ThreadPool &pool) {
+    const std::size_t n = t.getRows(), cols = b.getCols();
+    const std::size_t blocks = (n + FACTOR_BLOCK - 1) / FACTOR_BLOCK;
+    const std::size_t grain = std::max<std::size_t>(64, (cols + pool.getConcurrency() - 1) / pool.getConcurrency());
+
+    for (std::size_t step = 0; step < blocks; step++) {
+        const std::size_t block = lower ? step : blocks - 1 - step;
+        const std::size_t begin = block * FACTOR_BLOCK, size = std::min(FACTOR_BLOCK, n - begin);
+
+        pool.parallelFor(cols, grain, [&](std::size_t colBegin, std::size_t colEnd) {
+            for (std::size_t i = 0; i < size; i++) {
+                const std::size_t row = lower ? begin + i : begin + size - 1 - i;
+                double *x = b.rowData(row);
+                const std::size_t from = lower ? begin : row + 1, to = lower ? row : begin + size;
+                for (std::size_t p = from; p < to; p++) {
+                    const double factor = t(row, p), *y = b.rowData(p);
+                    for (std::size_t col = colBegin; col < colEnd; col++) { x[col] -= factor * y[col]; }
+                }
+                if (!unitDiagonal) {
+                    const double inverse = 1.0 / t(row, row);
+                    for (std::size_t col = colBegin; col < colEnd; col++) { x[col] *= inverse; }
+                }
+            }
+        });
+
+        // Rows not solved yet lose this block's contribution
+        if (lower && begin + size < n) {
+            gemmParallel(pool, t.block(begin + size, begin, n - begin - size, size), b.block(begin, 0, size, cols),
+                         b.block(begin + size, 0, n - begin - size, cols), -1.0, 1.0);
+        } else if (!lower && begin > 0) {
+            gemmParallel(pool, t.block(0, begin, begin, size), b.block(begin, 0, size, cols), b.block(0, 0, begin, cols),
+                         -1.0, 1.0);
+        }
+    }
+}
+
+
+// P * A = L * U, see LuFactorization. Throws std::runtime_error if A is singular
+inline LuFactorization luFactor(ConstMatrixView a, ThreadPool &pool = ThreadPool::global()) {
+    if (a.getRows() != a.getCols()) { throw std::invalid_argument("LU factorization needs a square matrix"); }
+    const std::size_t n = a.getRows(), blocks = (n + FACTOR_BLOCK - 1) / FACTOR_BLOCK;
+    LuFactorization result{Matrix::copyOf(a), std::vector<std::size_t>(n)};
+    MatrixView lu = result.lu.view();
+    std::vector<std::size_t> &pivots = result.pivots;
+
+    auto width = [n](std::size_t block) { return std::min(FACTOR_BLOCK, n - block * FACTOR_BLOCK); };
+
+    TaskGraph graph;
+    std::vector<std::size_t> panel(blocks), lastUpdate(blocks);
+    for (std::size_t k = 0; k < blocks; k++) {
+        const std::size_t k0 = k * FACTOR_BLOCK, kw = width(k);
+        panel[k] = graph.add([&, k0, kw]() { luPanel(lu, pivots, k0, kw); });
+        if (k > 0) { graph.dependsOn(panel[k], lastUpdate[k]); }
+
+        for (std::size_t j = k + 1; j < blocks; j++) {
+            const std::size_t j0 = j * FACTOR_BLOCK, jw = width(j);
+            std::size_t update = graph.add([&, k0, kw, j0, jw]() {
+                applyPivots(lu, pivots, k0, k0 + kw, j0, jw);
+                unitLowerSolve(lu.block(k0, k0, kw, kw), lu.block(k0, j0, kw, jw));     // U12 = L11^-1 * A12
+
+                // A22 -= L21 * U12
+                if (k0 + kw < n) {
+                    gemm(lu.block(k0 + kw, k0, n - k0 - kw, kw), lu.block(k0, j0, kw, jw),
+                         lu.block(k0 + kw, j0, n - k0 - kw, jw), -1.0, 1.0);
+                }
+            });
+            graph.dependsOn(update, panel[k]);
+            if (k > 0) { graph.dependsOn(update, lastUpdate[j]); }
+            lastUpdate[j] = update;
+        }
+    }
+    graph.run(pool);
+
+    // Later steps' row swaps, applied to the L columns of earlier steps
+    pool.parallelFor(blocks, 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t block = begin; block < end; block++) {
+            const std::size_t first = (block + 1) * FACTOR_BLOCK;
+            if (first < n) { applyPivots(lu, pivots, first, n, block * FACTOR_BLOCK, width(block)); }
+        }
+    });
+    return result;
+}
+
+
+// X with A * X = B, for every column of B at once
+inline Matrix luSolve(const LuFactorization &factorization, ConstMatrixView b, ThreadPool &pool = ThreadPool::global()) {
+    const ConstMatrixView lu = factorization.lu.view();
+    if (b.getRows() != lu.getRows()) { throw std::invalid_argument("Right-hand side has the wrong number of rows"); }
+
+    Matrix x = Matrix::copyOf(b);
+    applyPivots(x.view(), factorization.pivots, 0, lu.getRows(), 0, b.getCols());
+    triangularSolve(lu, x.view(), true, true, pool);
+    triangularSolve(lu, x.view(), false, false, pool);
+    return x;
+}
+
+
+// Unblocked Cholesky of diagonal tile (lower part), zeroes the part above the diagonal
+inline void choleskyTile(MatrixView tile) {
+    const std::size_t size = tile.getRows();
+    for (std::size_t j = 0; j < size; j++) {
+        const double *rowJ = tile.rowData(j);
+        double diagonal = rowJ[j];
+        for (std::size_t p = 0; p < j; p++) { diagonal -= rowJ[p] * rowJ[p]; }
+        if (!(diagonal > 0)) { throw std::runtime_error("Matrix is not positive definite"); }
+        const double root = std::sqrt(diagonal), inverse = 1.0 / root;
+        tile(j, j) = root;
+
+        for (std::size_t i = j + 1; i < size; i++) {
+            double *rowI = tile.rowData(i);
+            double value = rowI[j];
+            for (std::size_t p = 0; p < j; p++) { value -= rowI[p] * rowJ[p]; }
+            rowI[j] = value * inverse;
+        }
+        for (std::size_t col = j + 1; col < size; col++) { tile(j, col) = 0; }
+    }
+}
+
+// tile = tile * U^-1 for the diagonal tile's U = L^T, by row operations on U's rows
+inline void choleskySolveTile(ConstMatrixView upper, MatrixView tile) {
+    const std::size_t size = tile.getCols();
+    for (std::size_t row = 0; row < tile.getRows(); row++) {
+        double *x = tile.rowData(row);
+        for (std::size_t p = 0; p < size; p++) {
+            const double *u = upper.rowData(p);
+            const double value = x[p] /= u[p];
+            for (std::size_t j = p + 1; j < size; j++) { x[j] -= value * u[j]; }
+        }
+    }
+}
+
+
+// A = L * L^T for a symmetric positive definite A (only its lower triangle is read)
+inline CholeskyFactorization choleskyFactor(ConstMatrixView a, ThreadPool &pool = ThreadPool::global()) {
+    if (a.getRows() != a.getCols()) { throw std::invalid_argument("Cholesky factorization needs a square matrix"); }
+    const std::size_t n = a.getRows(), tiles = (n + FACTOR_BLOCK - 1) / FACTOR_BLOCK;
+    CholeskyFactorization result{Matrix::copyOf(a), Matrix(n, n)};
+    MatrixView lower = result.lower.view(), upper = result.upper.view();
+
+    auto tile = [&](MatrixView matrix, std::size_t i, std::size_t j) {
+        const std::size_t row = i * FACTOR_BLOCK, col = j * FACTOR_BLOCK;
+        return matrix.block(row, col, std::min(FACTOR_BLOCK, n - row), std::min(FACTOR_BLOCK, n - col));
+    };
+
+    TaskGraph graph;
+    std::vector<std::size_t> potrf(tiles), trsm(tiles * tiles), update(tiles * tiles * tiles);
+    auto updateId = [&](std::size_t i, std::size_t j, std::size_t k) -> std::size_t & {
+        return update[(k * tiles + i) * tiles + j];
+    };
+
+    for (std::size_t k = 0; k < tiles; k++) {
+        potrf[k] = graph.add([&, k]() {
+            choleskyTile(tile(lower, k, k));
+            transpose(tile(lower, k, k), tile(upper, k, k), pool);
+        });
+        if (k > 0) { graph.dependsOn(potrf[k], updateId(k, k, k - 1)); }
+
+        for (std::size_t i = k + 1; i < tiles; i++) {
+            trsm[i * tiles + k] = graph.add([&, i, k]() {
+                choleskySolveTile(tile(upper, k, k), tile(lower, i, k));
+                transpose(tile(lower, i, k), tile(upper, k, i), pool);
+            });
+            graph.dependsOn(trsm[i * tiles + k], potrf[k]);
+            if (k > 0) { graph.dependsOn(trsm[i * tiles + k], updateId(i, k, k - 1)); }
+        }
+
+        // A(i, j) -= L(i, k) * L(j, k)^T for the trailing lower tiles
+        for (std::size_t i = k + 1; i < tiles; i++) {
+            for (std::size_t j = k + 1; j <= i; j++) {
+                updateId(i, j, k) = graph.add([&, i, j, k]() {
+                    gemm(tile(lower, i, k), tile(upper, k, j), tile(lower, i, j), -1.0, 1.0);
+                });
+                graph.dependsOn(updateId(i, j, k), trsm[i * tiles + k]);
+                if (j != i) { graph.dependsOn(updateId(i, j, k), trsm[j * tiles + k]); }
+                if (k > 0) { graph.dependsOn(updateId(i, j, k), updateId(i, j, k - 1)); }
+            }
+        }
+    }
+    graph.run(pool);
+
+    for (std::size_t i = 0; i < tiles; i++) {
+        for (std::size_t j = i + 1; j < tiles; j++) { tile(lower, i, j).fill(0); }
+    }
+    return result;
+}
+
+
+// X with A * X = B, for every column of B at once
+inline Matrix choleskySolve(const CholeskyFactorization &factorization, ConstMatrixView b,
+                            ThreadPool &pool = ThreadPool::global()) {
+    if (b.getRows() != factorization.lower.getRows()) {
+        throw std::invalid_argument("Right-hand side has the wrong number of rows");
+    }
+    Matrix x = Matrix::copyOf(b);
+    triangularSolve(factorization.lower, x.view(), true, false, pool);
+    triangularSolve(factorization.upper, x.view(), false, false, pool);
+    return x;
+}
+
+
+/**
+ *  ||A * X - B|| / (||A|| * ||X|| * n * epsilon) in the infinity norm, the usual backward-error check
+ *  (HPL calls a solve correct below 16).
+ */
+inline double scaledResidual(ConstMatrixView a, ConstMatrixView x, ConstMatrixView b,
+                             ThreadPool &pool = ThreadPool::global()) {
+    Matrix residual = Matrix::copyOf(b);
+    gemmParallel(pool, a, x, residual.view(), 1.0, -1.0);
+
+    auto norm = [](ConstMatrixView matrix) {
+        double worst = 0;
+        for (std::size_t row = 0; row < matrix.getRows(); row++) {
+            double sum = 0;
+            for (std::size_t col = 0; col < matrix.getCols(); col++) { sum += std::fabs(matrix(row, col)); }
+            worst = std::max(worst, sum);
+        }
+        return worst;
+    };
+    const double scale = norm(a) * norm(x) * double(a.getRows()) * std::numeric_limits<double>::epsilon();
+    return scale > 0 ? norm(residual) / scale : norm(residual);
+}
+
+#endif //MATRIX_MULTIPROCESSING_FACTORIZATION_H
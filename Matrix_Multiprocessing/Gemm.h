@@ -0,0 +1,354 @@
+#ifndef MATRIX_MULTIPROCESSING_GEMM_H
+#define MATRIX_MULTIPROCESSING_GEMM_H
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include "ElementTypes.h"
+#include "Matrix.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+/**
+ *  General matrix multiply: C = alpha * A * B + beta * C
+ *
+ *  Follows the usual blocked (Goto / BLIS) structure:
+ *      - B is cut into KC x NC blocks (sized for L3) and packed into NR-wide column panels
+ *      - A is cut into MC x KC blocks (sized for L2) and packed into MR-high row panels, alpha folded in
+ *      - a register-tiled MR x NR micro-kernel walks one A panel against one B panel (the B panel stays in L1)
+ *  Packing makes every micro-kernel read contiguous and aligned, and zero-pads the ragged edges so the
+ *  micro-kernel always computes a full tile.
+ *
+ *  The micro-kernel and its blocking sizes are chosen at runtime from the CPU's SIMD level (see Simd.h).
+ *
+ *  Everything is a template over the type T the micro-kernel computes in (double, float or int32); A and B can
+ *  be stored in any narrower type (ElementTypes.h), packing converts them. gemm() and gemmParallel() are the
+ *  double entry points, basicGemm() and basicGemmParallel() the generic ones.
+ */
+
+template<typename T>
+struct BasicGemmKernel {
+    SimdLevel level;
+    std::size_t mr;
+    std::size_t nr;
+    std::size_t mc;
+    std::size_t kc;
+    std::size_t nc;
+
+    // c (m x n tile, m <= mr, n <= nr) = packed a panel * packed b panel + beta * c, c is not read when beta == 0
+    void (*microKernel)(std::size_t kc, const T *a, const T *b, T *c, std::size_t ldc, T beta, std::size_t m,
+                        std::size_t n);
+};
+
+typedef BasicGemmKernel<double> GemmKernel;
+
+
+// Writes an MR x NR accumulator tile (row-major, NR wide) back to c
+template<std::size_t MR, std::size_t NR, typename T>
+MATRIX_INLINE void gemmStoreEdgeTile(const T *tile, T *c, std::size_t ldc, T beta, std::size_t m, std::size_t n) {
+    for (std::size_t i = 0; i < m; i++) {
+        for (std::size_t j = 0; j < n; j++) {
+            T value = tile[i * NR + j];
+            c[i * ldc + j] = beta == 0 ? value : value + beta * c[i * ldc + j];
+        }
+    }
+}
+
+
+// Plain C++ micro-kernel, used when no SIMD level is available
+template<typename T>
+void gemmMicroKernelScalar(std::size_t kc, const T *a, const T *b, T *c, std::size_t ldc, T beta, std::size_t m,
+                           std::size_t n) {
+    constexpr std::size_t MR = 4, NR = 4;
+    T acc[MR * NR] = {};
+
+    for (std::size_t p = 0; p < kc; p++) {
+        MATRIX_UNROLL
+        for (std::size_t i = 0; i < MR; i++) {
+            MATRIX_UNROLL
+            for (std::size_t j = 0; j < NR; j++) { acc[i * NR + j] += a[p * MR + i] * b[p * NR + j]; }
+        }
+    }
+    gemmStoreEdgeTile<MR, NR>(acc, c, ldc, beta, m, n);
+}
+
+
+// Vector micro-kernel: MR rows x NV vectors of W elements, all accumulators held in registers
+template<std::size_t MR, std::size_t NV, int W, typename T>
+MATRIX_INLINE void gemmMicroKernelSimd(std::size_t kc, const T *a, const T *b, T *c, std::size_t ldc, T beta,
+                                       std::size_t m, std::size_t n) {
+    typedef typename SimdVector<T, W>::type V;
+    constexpr std::size_t NR = NV * W;
+
+    V acc[MR][NV];
+    MATRIX_UNROLL
+    for (std::size_t i = 0; i < MR; i++) {
+        MATRIX_UNROLL
+        for (std::size_t j = 0; j < NV; j++) { acc[i][j] = V{}; }
+    }
+
+    for (std::size_t p = 0; p < kc; p++) {
+        V bv[NV];
+        MATRIX_UNROLL
+        for (std::size_t j = 0; j < NV; j++) { bv[j] = *reinterpret_cast<const V *>(b + p * NR + j * W); }
+
+        MATRIX_UNROLL
+        for (std::size_t i = 0; i < MR; i++) {
+            V av = V{} + a[p * MR + i];
+            MATRIX_UNROLL
+            for (std::size_t j = 0; j < NV; j++) { acc[i][j] += av * bv[j]; }
+        }
+    }
+
+    if (m == MR && n == NR) {
+        MATRIX_UNROLL
+        for (std::size_t i = 0; i < MR; i++) {
+            MATRIX_UNROLL
+            for (std::size_t j = 0; j < NV; j++) {
+                T *out = c + i * ldc + j * W;
+                if (beta != 0) {
+                    V previous;
+                    loadVector(previous, out);
+                    acc[i][j] += beta * previous;
+                }
+                storeVector(out, acc[i][j]);
+            }
+        }
+        return;
+    }
+
+    alignas(MATRIX_ALIGNMENT) T tile[MR * NR];
+    for (std::size_t i = 0; i < MR; i++) {
+        for (std::size_t j = 0; j < NV; j++) { storeVector(tile + i * NR + j * W, acc[i][j]); }
+    }
+    gemmStoreEdgeTile<MR, NR>(tile, c, ldc, beta, m, n);
+}
+
+
+#ifdef MATRIX_X86_SIMD
+// 6 x 2 vectors (6 x 8 doubles, 6 x 16 floats), 12 ymm accumulators
+template<typename T>
+MATRIX_TARGET_AVX2 void gemmMicroKernelAvx2(std::size_t kc, const T *a, const T *b, T *c, std::size_t ldc, T beta,
+                                            std::size_t m, std::size_t n) {
+    gemmMicroKernelSimd<6, 2, 32 / sizeof(T)>(kc, a, b, c, ldc, beta, m, n);
+}
+
+// 12 x 2 vectors (12 x 16 doubles, 12 x 32 floats), 24 zmm accumulators
+template<typename T>
+MATRIX_TARGET_AVX512 void gemmMicroKernelAvx512(std::size_t kc, const T *a, const T *b, T *c, std::size_t ldc, T beta,
+                                                std::size_t m, std::size_t n) {
+    gemmMicroKernelSimd<12, 2, 64 / sizeof(T)>(kc, a, b, c, ldc, beta, m, n);
+}
+#endif
+
+
+// Same MC / KC for every T: narrower elements only make the packed blocks smaller than the caches they target
+template<typename T = double>
+BasicGemmKernel<T> gemmKernelFor(SimdLevel level) {
+#ifdef MATRIX_X86_SIMD
+    if (level == SimdLevel::AVX512) {
+        return {SimdLevel::AVX512, 12, 2 * 64 / sizeof(T), 144, 192, 4096, gemmMicroKernelAvx512<T>};
+    }
+    if (level == SimdLevel::AVX2) { return {SimdLevel::AVX2, 6, 2 * 32 / sizeof(T), 96, 256, 4096, gemmMicroKernelAvx2<T>}; }
+#endif
+    return {SimdLevel::SCALAR, 4, 4, 128, 256, 4096, gemmMicroKernelScalar<T>};
+}
+
+template<typename T = double>
+const BasicGemmKernel<T> &selectGemmKernel() {
+    static const BasicGemmKernel<T> kernel = gemmKernelFor<T>(activeSimdLevel());
+    return kernel;
+}
+
+
+// Reusable 64-byte aligned scratch space for packed panels
+template<typename T>
+class BasicPackBuffer {
+private:
+    struct FreeDeleter {
+        void operator()(T *pointer) const { std::free(pointer); }
+    };
+
+    std::unique_ptr<T[], FreeDeleter> data;
+    std::size_t capacity = 0;
+
+public:
+    T *reserve(std::size_t count) {
+        if (count > capacity) {
+            std::size_t bytes = (count * sizeof(T) + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+            void *buffer = std::aligned_alloc(MATRIX_ALIGNMENT, bytes);
+            if (buffer == nullptr) { throw std::bad_alloc(); }
+            data.reset(static_cast<T *>(buffer));
+            capacity = count;
+        }
+        return data.get();
+    }
+};
+
+typedef BasicPackBuffer<double> PackBuffer;
+
+
+// Packs A[0:mc, 0:kc] into MR-high panels, panel layout a[p * MR + i], converted to T and scaled by alpha
+template<typename TA, typename T>
+void gemmPackA(BasicConstMatrixView<TA> a, std::size_t mr, T alpha, T *packed) {
+    for (std::size_t i0 = 0; i0 < a.getRows(); i0 += mr) {
+        std::size_t rows = std::min(mr, a.getRows() - i0);
+        for (std::size_t p = 0; p < a.getCols(); p++) {
+            for (std::size_t i = 0; i < rows; i++) { packed[i] = alpha * convertElement<T>(a(i0 + i, p)); }
+            for (std::size_t i = rows; i < mr; i++) { packed[i] = 0; }
+            packed += mr;
+        }
+    }
+}
+
+
+// Packs B[0:kc, 0:nc] into NR-wide panels, panel layout b[p * NR + j], converted to T
+template<typename TB, typename T>
+void gemmPackB(BasicConstMatrixView<TB> b, std::size_t nr, T *packed) {
+    for (std::size_t j0 = 0; j0 < b.getCols(); j0 += nr) {
+        std::size_t cols = std::min(nr, b.getCols() - j0);
+        for (std::size_t p = 0; p < b.getRows(); p++) {
+            const TB *source = b.rowData(p) + j0;
+            for (std::size_t j = 0; j < cols; j++) { packed[j] = convertElement<T>(source[j]); }
+            for (std::size_t j = cols; j < nr; j++) { packed[j] = 0; }
+            packed += nr;
+        }
+    }
+}
+
+
+// Multiplies one packed MC x KC block of A against one packed KC x NC block of B into C
+template<typename T>
+void gemmMacroKernel(const BasicGemmKernel<T> &kernel, const T *packedA, const T *packedB, BasicMatrixView<T> c,
+                     std::size_t kc, T beta) {
+    for (std::size_t j0 = 0; j0 < c.getCols(); j0 += kernel.nr) {
+        std::size_t n = std::min(kernel.nr, c.getCols() - j0);
+        const T *bPanel = packedB + (j0 / kernel.nr) * kc * kernel.nr;
+
+        for (std::size_t i0 = 0; i0 < c.getRows(); i0 += kernel.mr) {
+            std::size_t m = std::min(kernel.mr, c.getRows() - i0);
+            const T *aPanel = packedA + (i0 / kernel.mr) * kc * kernel.mr;
+            kernel.microKernel(kc, aPanel, bPanel, c.rowData(i0) + j0, c.getStride(), beta, m, n);
+        }
+    }
+}
+
+
+template<typename A, typename B, typename C>
+void checkGemmShapes(const A &a, const B &b, const C &c) {
+    if (a.getCols() != b.getRows() || c.getRows() != a.getRows() || c.getCols() != b.getCols()) {
+        throw std::invalid_argument("Matrix multiply shape mismatch: (" + std::to_string(a.getRows()) + "x" +
+                                    std::to_string(a.getCols()) + ") * (" + std::to_string(b.getRows()) + "x" +
+                                    std::to_string(b.getCols()) + ") -> (" + std::to_string(c.getRows()) + "x" +
+                                    std::to_string(c.getCols()) + ")");
+    }
+}
+
+
+// C = beta * C, used when there is nothing to multiply
+template<typename T>
+void gemmScale(BasicMatrixView<T> c, T beta) {
+    for (std::size_t row = 0; row < c.getRows(); row++) {
+        T *out = c.rowData(row);
+        for (std::size_t col = 0; col < c.getCols(); col++) { out[col] = beta == 0 ? 0 : beta * out[col]; }
+    }
+}
+
+
+// Blocked, packed, SIMD C = alpha * A * B + beta * C, computed in T
+template<typename T, typename TA, typename TB>
+void basicGemm(BasicConstMatrixView<TA> a, BasicConstMatrixView<TB> b, BasicMatrixView<T> c, T alpha = T(1),
+               T beta = T(0), const BasicGemmKernel<T> &kernel = selectGemmKernel<T>()) {
+    checkGemmShapes(a, b, c);
+    const std::size_t m = a.getRows(), n = b.getCols(), k = a.getCols();
+    if (m == 0 || n == 0) { return; }
+    if (k == 0 || alpha == 0) { gemmScale(c, beta); return; }
+
+    thread_local BasicPackBuffer<T> packA, packB;
+    T *packedA = packA.reserve((kernel.mc + kernel.mr) * kernel.kc);
+    T *packedB = packB.reserve((kernel.nc + kernel.nr) * kernel.kc);
+
+    for (std::size_t jc = 0; jc < n; jc += kernel.nc) {
+        std::size_t nc = std::min(kernel.nc, n - jc);
+
+        for (std::size_t pc = 0; pc < k; pc += kernel.kc) {
+            std::size_t kc = std::min(kernel.kc, k - pc);
+            gemmPackB(b.block(pc, jc, kc, nc), kernel.nr, packedB);
+
+            // Only the first slice of k applies beta, later slices accumulate onto it
+            T betaBlock = pc == 0 ? beta : T(1);
+
+            for (std::size_t ic = 0; ic < m; ic += kernel.mc) {
+                std::size_t mc = std::min(kernel.mc, m - ic);
+                gemmPackA(a.block(ic, pc, mc, kc), kernel.mr, alpha, packedA);
+                gemmMacroKernel(kernel, packedA, packedB, c.block(ic, jc, mc, nc), kc, betaBlock);
+            }
+        }
+    }
+}
+
+inline void gemm(ConstMatrixView a, ConstMatrixView b, MatrixView c, double alpha = 1.0, double beta = 0.0,
+                 const GemmKernel &kernel = selectGemmKernel()) {
+    basicGemm(a, b, c, alpha, beta, kernel);
+}
+
+
+/**
+ *  basicGemm() split over a thread pool. C is cut into MC-row tiles (and into NR-aligned column tiles when there are
+ *  too few rows to keep every thread busy); each tile is an independent gemm with its own packed buffers, so
+ *  threads never write the same cache line of C. B panels are packed once per tile rather than shared.
+ */
+template<typename T, typename TA, typename TB>
+void basicGemmParallel(ThreadPool &pool, BasicConstMatrixView<TA> a, BasicConstMatrixView<TB> b, BasicMatrixView<T> c,
+                       T alpha = T(1), T beta = T(0), const BasicGemmKernel<T> &kernel = selectGemmKernel<T>()) {
+    checkGemmShapes(a, b, c);
+    const std::size_t m = a.getRows(), n = b.getCols(), k = a.getCols();
+    const std::size_t targetTiles = pool.getConcurrency() * 4;
+    if (pool.getConcurrency() == 1 || m * n * k < 64 * 64 * 64) {
+        basicGemm(a, b, c, alpha, beta, kernel);
+        return;
+    }
+
+    const std::size_t rowTile = kernel.mc;
+    const std::size_t rowTiles = (m + rowTile - 1) / rowTile;
+    std::size_t colTiles = 1;
+    if (rowTiles < targetTiles) {
+        colTiles = std::min((n + kernel.nr - 1) / kernel.nr, (targetTiles + rowTiles - 1) / rowTiles);
+    }
+    const std::size_t colTile = ((n + colTiles - 1) / colTiles + kernel.nr - 1) / kernel.nr * kernel.nr;
+    colTiles = (n + colTile - 1) / colTile;
+
+    pool.parallelFor(rowTiles * colTiles, 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t tile = begin; tile < end; tile++) {
+            std::size_t row = (tile / colTiles) * rowTile, col = (tile % colTiles) * colTile;
+            std::size_t rows = std::min(rowTile, m - row), cols = std::min(colTile, n - col);
+            basicGemm(a.block(row, 0, rows, k), b.block(0, col, k, cols), c.block(row, col, rows, cols), alpha, beta,
+                      kernel);
+        }
+    });
+}
+
+inline void gemmParallel(ThreadPool &pool, ConstMatrixView a, ConstMatrixView b, MatrixView c, double alpha = 1.0,
+                         double beta = 0.0, const GemmKernel &kernel = selectGemmKernel()) {
+    basicGemmParallel(pool, a, b, c, alpha, beta, kernel);
+}
+
+
+// Reference triple loop, C = A * B
+inline void gemmNaive(ConstMatrixView a, ConstMatrixView b, MatrixView c) {
+    checkGemmShapes(a, b, c);
+    for (std::size_t i = 0; i < a.getRows(); i++) {
+        for (std::size_t j = 0; j < b.getCols(); j++) {
+            double sum = 0;
+            for (std::size_t p = 0; p < a.getCols(); p++) { sum += a(i, p) * b(p, j); }
+            c(i, j) = sum;
+        }
+    }
+}
+
+#endif //MATRIX_MULTIPROCESSING_GEMM_H
@@ -0,0 +1,196 @@
+#ifndef MATRIX_MULTIPROCESSING_MATRIX_H
+#define MATRIX_MULTIPROCESSING_MATRIX_H
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+/**
+ *  Runtime-sized, row-major matrix storage.
+ *
+ *  Matrix owns a 64-byte aligned heap buffer and is move-only, so large matrices never live on the stack and are
+ *  never copied by accident. Every row starts on a 64-byte boundary: the row stride is the column count rounded
+ *  up to a whole cache line. MatrixView / ConstMatrixView are non-owning (data, rows, cols, stride) windows into a
+ *  Matrix or any other row-major buffer (such as the fixed-size C arrays), and block() cuts sub-matrices
+ *  without copying.
+ *
+ *  All three are templates over the element type (BasicMatrix<T> and its views); Matrix, MatrixView and
+ *  ConstMatrixView are the double instances everything defaults to. See ElementTypes.h for the narrower types.
+ */
+
+static constexpr std::size_t MATRIX_ALIGNMENT = 64;
+
+
+template<typename T>
+class BasicConstMatrixView {
+protected:
+    const T *data = nullptr;
+    std::size_t rows = 0;
+    std::size_t cols = 0;
+    std::size_t stride = 0;
+
+public:
+    typedef T value_type;
+
+    BasicConstMatrixView() = default;
+
+    BasicConstMatrixView(const T *data, std::size_t rows, std::size_t cols, std::size_t stride)
+        : data(data), rows(rows), cols(cols), stride(stride) {
+    }
+
+    std::size_t getRows() const { return rows; }
+    std::size_t getCols() const { return cols; }
+    std::size_t getStride() const { return stride; }
+    const T *getData() const { return data; }
+
+    const T &operator()(std::size_t row, std::size_t col) const { return data[row * stride + col]; }
+    const T *rowData(std::size_t row) const { return data + row * stride; }
+
+    BasicConstMatrixView block(std::size_t row, std::size_t col, std::size_t numRows, std::size_t numCols) const {
+        return {data + row * stride + col, numRows, numCols, stride};
+    }
+};
+
+
+template<typename T>
+class BasicMatrixView {
+protected:
+    T *data = nullptr;
+    std::size_t rows = 0;
+    std::size_t cols = 0;
+    std::size_t stride = 0;
+
+public:
+    typedef T value_type;
+
+    BasicMatrixView() = default;
+
+    BasicMatrixView(T *data, std::size_t rows, std::size_t cols, std::size_t stride)
+        : data(data), rows(rows), cols(cols), stride(stride) {
+    }
+
+    operator BasicConstMatrixView<T>() const { return {data, rows, cols, stride}; }
+
+    std::size_t getRows() const { return rows; }
+    std::size_t getCols() const { return cols; }
+    std::size_t getStride() const { return stride; }
+    T *getData() const { return data; }
+
+    T &operator()(std::size_t row, std::size_t col) const { return data[row * stride + col]; }
+    T *rowData(std::size_t row) const { return data + row * stride; }
+
+    BasicMatrixView block(std::size_t row, std::size_t col, std::size_t numRows, std::size_t numCols) const {
+        return {data + row * stride + col, numRows, numCols, stride};
+    }
+
+    void fill(T value) const {
+        for (std::size_t row = 0; row < rows; row++) {
+            T *out = rowData(row);
+            for (std::size_t col = 0; col < cols; col++) { out[col] = value; }
+        }
+    }
+
+    void copyFrom(BasicConstMatrixView<T> source) const {
+        if (source.getRows() != rows || source.getCols() != cols) {
+            throw std::invalid_argument("Matrix copy shape mismatch");
+        }
+        for (std::size_t row = 0; row < rows; row++) {
+            std::memcpy(rowData(row), source.rowData(row), cols * sizeof(T));
+        }
+    }
+};
+
+
+template<typename T>
+class BasicMatrix {
+private:
+    struct AlignedDeleter {
+        void operator()(T *pointer) const { std::free(pointer); }
+    };
+
+    std::unique_ptr<T[], AlignedDeleter> data;
+    std::size_t rows = 0;
+    std::size_t cols = 0;
+    std::size_t stride = 0;
+
+    static std::size_t paddedStride(std::size_t cols) {
+        const std::size_t perLine = MATRIX_ALIGNMENT / sizeof(T);
+        return (cols + perLine - 1) / perLine * perLine;
+    }
+
+    BasicMatrix(std::size_t rows, std::size_t cols, bool zero) : rows(rows), cols(cols), stride(paddedStride(cols)) {
+        std::size_t bytes = rows * stride * sizeof(T);
+        if (bytes == 0) { return; }
+
+        void *buffer = std::aligned_alloc(MATRIX_ALIGNMENT, bytes);
+        if (buffer == nullptr) { throw std::bad_alloc(); }
+        if (zero) { std::memset(buffer, 0, bytes); }
+        data.reset(static_cast<T *>(buffer));
+    }
+
+public:
+    typedef T value_type;
+
+    BasicMatrix() = default;
+
+    // Zero-initialized rows x cols matrix
+    BasicMatrix(std::size_t rows, std::size_t cols) : BasicMatrix(rows, cols, true) { }
+
+    BasicMatrix(BasicMatrix &&) noexcept = default;
+    BasicMatrix &operator=(BasicMatrix &&) noexcept = default;
+
+    // Copies have to be explicit, see clone()
+    BasicMatrix(const BasicMatrix &) = delete;
+    BasicMatrix &operator=(const BasicMatrix &) = delete;
+
+    ~BasicMatrix() = default;
+
+    static BasicMatrix copyOf(BasicConstMatrixView<T> source) {
+        BasicMatrix matrix(source.getRows(), source.getCols());
+        matrix.view().copyFrom(source);
+        return matrix;
+    }
+
+    BasicMatrix clone() const { return copyOf(view()); }
+
+    /**
+     *  Matrix whose memory has not been written yet, so no page is placed until something touches it.
+     *  Contents are indeterminate: fill it before reading (see allocateFirstTouch in Numa.h).
+     */
+    static BasicMatrix uninitialized(std::size_t rows, std::size_t cols) { return BasicMatrix(rows, cols, false); }
+
+    std::size_t getRows() const { return rows; }
+    std::size_t getCols() const { return cols; }
+    std::size_t getStride() const { return stride; }
+    T *getData() { return data.get(); }
+    const T *getData() const { return data.get(); }
+
+    T &operator()(std::size_t row, std::size_t col) { return data[row * stride + col]; }
+    const T &operator()(std::size_t row, std::size_t col) const { return data[row * stride + col]; }
+
+    BasicMatrixView<T> view() { return {data.get(), rows, cols, stride}; }
+    BasicConstMatrixView<T> view() const { return {data.get(), rows, cols, stride}; }
+    operator BasicMatrixView<T>() { return view(); }
+    operator BasicConstMatrixView<T>() const { return view(); }
+
+    BasicMatrixView<T> block(std::size_t row, std::size_t col, std::size_t numRows, std::size_t numCols) {
+        return view().block(row, col, numRows, numCols);
+    }
+
+    BasicConstMatrixView<T> block(std::size_t row, std::size_t col, std::size_t numRows, std::size_t numCols) const {
+        return view().block(row, col, numRows, numCols);
+    }
+};
+
+
+typedef BasicConstMatrixView<double> ConstMatrixView;
+typedef BasicMatrixView<double> MatrixView;
+typedef BasicMatrix<double> Matrix;
+
+#endif //MATRIX_MULTIPROCESSING_MATRIX_H
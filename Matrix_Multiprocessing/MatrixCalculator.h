@@ -0,0 +1,278 @@
+#ifndef MATRIX_MULTIPROCESSING_MATRIXCALCULATOR_H
+#define MATRIX_MULTIPROCESSING_MATRIXCALCULATOR_H
+
+#pragma once
+
+#include <iostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "ElementTypes.h"
+#include "Elementwise.h"
+#include "Expressions.h"
+#include "Factorization.h"
+#include "Gemm.h"
+#include "MatrixFile.h"
+#include "Matrix.h"
+#include "Strassen.h"
+#include "ThreadPool.h"
+#include "Timing.h"
+#include "Transpose.h"
+
+
+class Configuration {
+public:
+    static constexpr int NUM_ROWS = 5;
+    static constexpr int NUM_COLS = 5;
+};
+
+
+// How matrixMultiply computes the product
+enum class MultiplyAlgorithm {
+    BLOCKED,        // gemm, exact to the usual floating-point rounding
+    STRASSEN        // Strassen-Winograd above the tuned crossover, faster for large squares, slightly less accurate
+};
+
+
+/**
+ *  Operands of element type T, arithmetic in Acc, results in ElementTraits<T>::Result (see ElementTypes.h),
+ *  e.g. BasicMatrixCalculator<BFloat16> stores and returns bf16 but adds and multiplies in float, and
+ *  BasicMatrixCalculator<float, double> accumulates floats in double. MatrixCalculator is the all-double one;
+ *  evaluate, transpose, solve, Strassen and file output are only there.
+ */
+template<typename T, typename Acc = typename ElementTraits<T>::Accumulator>
+class BasicMatrixCalculator {
+public:
+    typedef typename ElementTraits<T>::Result Result;
+
+private:
+    static constexpr bool IS_DOUBLE = std::is_same_v<T, double> && std::is_same_v<Acc, double>;
+
+    // Wall, CPU and (optional) hardware counter timing of the last operation
+    OperationTimer timer;
+    bool countingHardware = false;
+
+    BasicMatrix<T> leftMatrix;
+    BasicMatrix<T> rightMatrix;
+    BasicMatrix<Result> resultMatrix;
+
+    // Product at Acc precision before it is rounded to Result, only used when the two types differ
+    BasicMatrix<Acc> productMatrix;
+
+    // What the operations read: the owned matrices above, or borrowed memory (e.g. a MappedMatrix)
+    BasicConstMatrixView<T> leftOperand;
+    BasicConstMatrixView<T> rightOperand;
+
+    double matrixSum = 0;
+
+    ThreadPool *pool = &ThreadPool::global();
+    MultiplyAlgorithm multiplyAlgorithm = MultiplyAlgorithm::BLOCKED;
+
+    void resizeResult(std::size_t rows, std::size_t cols) {
+        if (resultMatrix.getRows() != rows || resultMatrix.getCols() != cols) {
+            resultMatrix = BasicMatrix<Result>(rows, cols);
+        }
+    }
+
+    void checkOperands() const {
+        if (leftOperand.getRows() != rightOperand.getRows() || leftOperand.getCols() != rightOperand.getCols()) {
+            throw std::invalid_argument("Matrix operands have different shapes");
+        }
+    }
+
+public:
+    // No destructor needed - smart pointers handle cleanup automatically
+    ~BasicMatrixCalculator() = default;
+
+    // Fixed-size calculator, Configuration::NUM_ROWS x Configuration::NUM_COLS
+    BasicMatrixCalculator() : BasicMatrixCalculator(Configuration::NUM_ROWS, Configuration::NUM_COLS) { }
+
+    /**
+     *  Runtime-sized calculator, the matrices live on the heap so any size fits. Only the copying setMatrices
+     *  needs operands of this shape: pass (0, 0) when they are moved in or borrowed, so nothing is allocated
+     *  and zeroed only to be replaced, the result is sized by the first operation.
+     */
+    BasicMatrixCalculator(std::size_t rows, std::size_t cols)
+        : leftMatrix(rows, cols), rightMatrix(rows, cols), resultMatrix(rows, cols),
+          leftOperand(leftMatrix.view()), rightOperand(rightMatrix.view()) { }
+
+    BasicMatrixCalculator(BasicMatrixCalculator &&) = default;
+    BasicMatrixCalculator &operator=(BasicMatrixCalculator &&) = default;
+
+
+    // Initialize the class matrices with default values
+    void initalizeMatrices() {
+        leftMatrix.view().fill(convertElement<T>(0.0));
+        rightMatrix.view().fill(convertElement<T>(0.0));
+        resultMatrix.view().fill(convertElement<Result>(0.0));
+    }
+
+
+    // Set the values inside the matrices (fixed-size path)
+    void setMatrices(const double leftMatrix[Configuration::NUM_ROWS][Configuration::NUM_COLS],
+                     const double rightMatrix[Configuration::NUM_ROWS][Configuration::NUM_COLS]) requires IS_DOUBLE {
+        setMatrices(ConstMatrixView(&leftMatrix[0][0], Configuration::NUM_ROWS, Configuration::NUM_COLS,
+                                    Configuration::NUM_COLS),
+                    ConstMatrixView(&rightMatrix[0][0], Configuration::NUM_ROWS, Configuration::NUM_COLS,
+                                    Configuration::NUM_COLS));
+    }
+
+    // Copy the operands in from any views with this calculator's shape
+    void setMatrices(BasicConstMatrixView<T> left, BasicConstMatrixView<T> right) {
+        this->leftMatrix.view().copyFrom(left);
+        this->rightMatrix.view().copyFrom(right);
+        leftOperand = leftMatrix.view();
+        rightOperand = rightMatrix.view();
+    }
+
+    // Take ownership of the operands without copying, the shapes are checked by the operation that uses them
+    void setMatrices(BasicMatrix<T> &&left, BasicMatrix<T> &&right) {
+        this->leftMatrix = std::move(left);
+        this->rightMatrix = std::move(right);
+        leftOperand = leftMatrix.view();
+        rightOperand = rightMatrix.view();
+    }
+
+    // Read the operands in place without copying, they must outlive every operation that uses them
+    void useMatrices(BasicConstMatrixView<T> left, BasicConstMatrixView<T> right) {
+        leftOperand = left;
+        rightOperand = right;
+    }
+
+    // result = op(left, right), matrixSum accumulates the sum of the result from the same pass
+    template<typename Op>
+    void matrixElementwise(const Op &op) {
+        checkOperands();
+        resizeResult(leftOperand.getRows(), leftOperand.getCols());
+        timer.start();
+        matrixSum += basicElementwise<Acc>(*pool, op, leftOperand, rightOperand, resultMatrix.view());
+        timer.stop();
+    }
+
+    void matrixAdd() { matrixElementwise(AddOp()); }
+    void matrixSubtract() { matrixElementwise(SubtractOp()); }
+
+    // result = alpha * left
+    void matrixScale(double alpha) { matrixElementwise(ScaleOp{alpha}); }
+
+    // result = alpha * left + right
+    void matrixMultiplyAdd(double alpha) { matrixElementwise(MultiplyAddOp{alpha}); }
+
+
+    // result = expression in one fused pass, e.g. matrixEvaluate(getLeft() + getRight() * 2.0)
+    template<typename Derived>
+    void matrixEvaluate(const MatrixExpression<Derived> &expression) requires IS_DOUBLE {
+        resizeResult(expression.getRows(), expression.getCols());
+        timer.start();
+        matrixSum += assign(resultMatrix.view(), expression, *pool);
+        timer.stop();
+    }
+
+    // result = transpose(left)
+    void matrixTranspose() requires IS_DOUBLE {
+        resizeResult(leftOperand.getCols(), leftOperand.getRows());
+        timer.start();
+        transpose(leftOperand, resultMatrix.view(), *pool);
+        matrixSum += sumOf(*pool, resultMatrix.view());
+        timer.stop();
+    }
+
+    // result = left * right, left must have as many columns as right has rows
+    void matrixMultiply() {
+        if (leftOperand.getCols() != rightOperand.getRows()) {
+            throw std::invalid_argument("Matrix operands cannot be multiplied: inner dimensions differ");
+        }
+        resizeResult(leftOperand.getRows(), rightOperand.getCols());
+
+        timer.start();
+        if constexpr (IS_DOUBLE) {
+            if (multiplyAlgorithm == MultiplyAlgorithm::STRASSEN) {
+                strassen(leftOperand, rightOperand, resultMatrix.view(), *pool);
+            } else {
+                gemmParallel(*pool, leftOperand, rightOperand, resultMatrix.view());
+            }
+            matrixSum += sumOf(*pool, resultMatrix.view());
+        } else if constexpr (std::is_same_v<Result, Acc>) {
+            basicGemmParallel<Acc>(*pool, leftOperand, rightOperand, resultMatrix.view());
+            matrixSum += basicSumOf<Acc>(*pool, std::as_const(resultMatrix).view());
+        } else {
+            // Accumulate the whole product in Acc, round once
+            if (productMatrix.getRows() != getRows() || productMatrix.getCols() != getCols()) {
+                productMatrix = BasicMatrix<Acc>::uninitialized(getRows(), getCols());
+            }
+            basicGemmParallel<Acc>(*pool, leftOperand, rightOperand, productMatrix.view());
+            matrixSum += convertInto<Acc>(*pool, std::as_const(productMatrix).view(), resultMatrix.view());
+        }
+        timer.stop();
+    } // end matrixMultiply
+
+    // result = X with left * X = right (LU with partial pivoting), right may hold many right-hand sides
+    void matrixSolve() requires IS_DOUBLE {
+        if (leftOperand.getRows() != leftOperand.getCols() || rightOperand.getRows() != leftOperand.getRows()) {
+            throw std::invalid_argument("Matrix operands do not form a square linear system");
+        }
+        timer.start();
+        resultMatrix = luSolve(luFactor(leftOperand, *pool), rightOperand, *pool);
+        matrixSum += sumOf(*pool, resultMatrix.view());
+        timer.stop();
+    }
+
+    // Wall-clock seconds of the last operation
+    double getElapsedTime() const { return timer.getSample().wallSeconds; }
+    double getStartTime() const { return timer.getStartSeconds(); }
+    const TimingSample &getTiming() const { return timer.getSample(); }
+
+    /**
+     *  Also count cycles and cache misses, summed over the calling thread and the pool's workers, returns false if
+     *  the counters are unavailable. Workers are counted whatever they run, so share the pool with nothing else.
+     */
+    bool enableHardwareCounters() {
+        countingHardware = true;
+        std::vector<int> threadIds{0};
+        for (int threadId: pool->getWorkerThreadIds()) { threadIds.push_back(threadId); }
+        return timer.enableCounters(threadIds);
+    }
+
+    double getSum() const { return matrixSum; }
+
+    // Pool the kernels run on, the shared machine-sized pool by default
+    void setThreadPool(ThreadPool &threadPool) {
+        pool = &threadPool;
+        if (countingHardware) { enableHardwareCounters(); }
+    }
+    ThreadPool &getThreadPool() const { return *pool; }
+
+    void setMultiplyAlgorithm(MultiplyAlgorithm algorithm) requires IS_DOUBLE { multiplyAlgorithm = algorithm; }
+
+    std::size_t getRows() const { return resultMatrix.getRows(); }
+    std::size_t getCols() const { return resultMatrix.getCols(); }
+    BasicConstMatrixView<Result> getResult() const { return resultMatrix.view(); }
+
+    // Moves the result out instead of copying it, the next operation allocates a new one
+    BasicMatrix<Result> takeResult() {
+        BasicMatrix<Result> result = std::move(resultMatrix);
+        resultMatrix = BasicMatrix<Result>();
+        return result;
+    }
+    BasicConstMatrixView<T> getLeft() const { return leftOperand; }
+    BasicConstMatrixView<T> getRight() const { return rightOperand; }
+
+    // Stream the result to a binary matrix file (see MatrixFile.h)
+    void writeResult(const std::string &filename) const requires IS_DOUBLE { saveMatrix(filename, resultMatrix.view()); }
+
+    void printMatrixResult() const {
+        // Resetting the output stream
+        std::cout.unsetf(std::ios::fixed);
+
+        for (std::size_t i = 0; i < resultMatrix.getRows(); i++) {
+            for (std::size_t j = 0; j < resultMatrix.getCols(); j++) {
+                std::cout << convertElement<double>(resultMatrix(i, j)) << " ";
+            }
+            std::cout << std::endl;
+        }
+    }
+};
+
+typedef BasicMatrixCalculator<double> MatrixCalculator;
+
+#endif //MATRIX_MULTIPROCESSING_MATRIXCALCULATOR_H
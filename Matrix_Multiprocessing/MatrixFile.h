@@ -0,0 +1,299 @@
+#ifndef MATRIX_MULTIPROCESSING_MATRIXFILE_H
+#define MATRIX_MULTIPROCESSING_MATRIXFILE_H
+
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Matrix.h"
+
+/**
+ *  Binary matrix file (.mat), little-endian:
+ *
+ *      offset  size  field
+ *           0     8  magic "MATRIXF1"
+ *           8     4  version (1)
+ *          12     4  element size in bytes (8, double)
+ *          16     8  rows
+ *          24     8  cols
+ *          32     8  stride, elements per stored row (>= cols)
+ *          40     8  data offset (64)
+ *          48    16  reserved, zero
+ *          64        rows * stride doubles, row-major
+ *
+ *  The header is one cache line and the stride is padded like Matrix's, so once the file is mapped every row
+ *  starts on a 64-byte boundary and the data can be used in place through a ConstMatrixView.
+ */
+
+static constexpr char MATRIX_FILE_MAGIC[8] = {'M', 'A', 'T', 'R', 'I', 'X', 'F', '1'};
+static constexpr std::uint32_t MATRIX_FILE_VERSION = 1;
+static constexpr std::uint64_t MATRIX_FILE_HEADER_SIZE = 64;
+
+struct MatrixFileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t elementSize;
+    std::uint64_t rows;
+    std::uint64_t cols;
+    std::uint64_t stride;
+    std::uint64_t dataOffset;
+    std::uint8_t reserved[16];
+};
+
+static_assert(sizeof(MatrixFileHeader) == MATRIX_FILE_HEADER_SIZE, "Matrix file header must be 64 bytes");
+
+// Header and data are written and mapped as they are in memory, so only a little-endian host matches the format
+static_assert(std::endian::native == std::endian::little, "Matrix files are little-endian, this host is not");
+
+
+inline MatrixFileHeader makeMatrixFileHeader(std::uint64_t rows, std::uint64_t cols) {
+    const std::uint64_t perLine = MATRIX_ALIGNMENT / sizeof(double);
+    MatrixFileHeader header{};
+    std::memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+    header.version = MATRIX_FILE_VERSION;
+    header.elementSize = sizeof(double);
+    header.rows = rows;
+    header.cols = cols;
+    header.stride = (cols + perLine - 1) / perLine * perLine;
+    header.dataOffset = MATRIX_FILE_HEADER_SIZE;
+    return header;
+}
+
+
+/**
+ *  Read-only memory mapping of a .mat file. Pages are loaded by the kernel on first touch, nothing is copied,
+ *  and the view stays valid for as long as the MappedMatrix is alive.
+ */
+class MappedMatrix {
+private:
+    void *mapping = nullptr;
+    std::size_t mappingSize = 0;
+    MatrixFileHeader header{};
+
+    void release() {
+        if (mapping != nullptr) { munmap(mapping, mappingSize); }
+        mapping = nullptr;
+        mappingSize = 0;
+    }
+
+public:
+    explicit MappedMatrix(const std::string &filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd == -1) { throw std::runtime_error("Cannot open matrix file: " + filename); }
+
+        struct stat info{};
+        if (fstat(fd, &info) != 0 || std::uint64_t(info.st_size) < MATRIX_FILE_HEADER_SIZE) {
+            close(fd);
+            throw std::runtime_error("Not a matrix file (too short): " + filename);
+        }
+
+        mappingSize = std::size_t(info.st_size);
+        mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            mapping = nullptr;
+            throw std::runtime_error("Cannot map matrix file: " + filename);
+        }
+
+        std::memcpy(&header, mapping, sizeof(header));
+        // rows * stride * 8 can overflow for a corrupt header, so compare against what the file holds instead.
+        // A huge stride is rejected first, then stride * 8 is safe; stride 0 (no columns) needs no data
+        const std::uint64_t available = header.dataOffset <= mappingSize ? mappingSize - header.dataOffset : 0;
+        const bool dataFits = header.dataOffset <= mappingSize &&
+                              (header.stride == 0 || (header.stride <= available / sizeof(double) &&
+                                                      header.rows <= available / (header.stride * sizeof(double))));
+        if (std::memcmp(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != MATRIX_FILE_VERSION || header.elementSize != sizeof(double) ||
+            header.stride < header.cols || header.dataOffset % MATRIX_ALIGNMENT != 0 || !dataFits) {
+            release();
+            throw std::runtime_error("Invalid or truncated matrix file: " + filename);
+        }
+
+        madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+    }
+
+    MappedMatrix(MappedMatrix &&other) noexcept
+        : mapping(other.mapping), mappingSize(other.mappingSize), header(other.header) {
+        other.mapping = nullptr;
+        other.mappingSize = 0;
+    }
+
+    MappedMatrix &operator=(MappedMatrix &&other) noexcept {
+        if (this != &other) {
+            release();
+            mapping = other.mapping;
+            mappingSize = other.mappingSize;
+            header = other.header;
+            other.mapping = nullptr;
+            other.mappingSize = 0;
+        }
+        return *this;
+    }
+
+    MappedMatrix(const MappedMatrix &) = delete;
+    MappedMatrix &operator=(const MappedMatrix &) = delete;
+
+    ~MappedMatrix() { release(); }
+
+    std::size_t getRows() const { return header.rows; }
+    std::size_t getCols() const { return header.cols; }
+
+    ConstMatrixView view() const {
+        const double *data = reinterpret_cast<const double *>(static_cast<const char *>(mapping) + header.dataOffset);
+        return {data, header.rows, header.cols, header.stride};
+    }
+
+    operator ConstMatrixView() const { return view(); }
+};
+
+
+/**
+ *  Writes a .mat file one row at a time, so results never have to exist in memory all at once.
+ *  The row count can be left open (0) and is patched into the header by close().
+ */
+class MatrixFileWriter {
+private:
+    std::ofstream file;
+    std::string filename;
+    MatrixFileHeader header{};
+    std::uint64_t expectedRows = 0;
+    std::uint64_t rowCount = 0;
+    std::vector<double> padding;
+
+public:
+    // expectedRows == 0 means "count the rows as they come"
+    MatrixFileWriter(const std::string &filename, std::size_t cols, std::size_t expectedRows = 0)
+        : file(filename, std::ios::binary | std::ios::trunc), filename(filename), expectedRows(expectedRows) {
+        if (!file) { throw std::runtime_error("Cannot create matrix file: " + filename); }
+        if (cols == 0) { throw std::invalid_argument("Matrix file needs at least one column"); }
+
+        header = makeMatrixFileHeader(expectedRows, cols);
+        padding.assign(header.stride - header.cols, 0.0);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+
+    MatrixFileWriter(const MatrixFileWriter &) = delete;
+    MatrixFileWriter &operator=(const MatrixFileWriter &) = delete;
+
+    ~MatrixFileWriter() {
+        // Errors cannot be reported from a destructor, call close() to see them
+        try { close(); } catch (...) { }
+    }
+
+    std::size_t getCols() const { return header.cols; }
+    std::uint64_t getRowCount() const { return rowCount; }
+
+    // Appends one row of getCols() values
+    void appendRow(const double *values) {
+        if (!file.is_open()) { throw std::runtime_error("Matrix file already closed: " + filename); }
+        if (expectedRows != 0 && rowCount == expectedRows) {
+            throw std::runtime_error("Too many rows written to matrix file: " + filename);
+        }
+        file.write(reinterpret_cast<const char *>(values), std::streamsize(header.cols * sizeof(double)));
+        file.write(reinterpret_cast<const char *>(padding.data()), std::streamsize(padding.size() * sizeof(double)));
+        rowCount++;
+    }
+
+    void appendRows(ConstMatrixView rows) {
+        if (rows.getCols() != header.cols) { throw std::invalid_argument("Row width does not match matrix file"); }
+        for (std::size_t row = 0; row < rows.getRows(); row++) { appendRow(rows.rowData(row)); }
+    }
+
+    void close() {
+        if (!file.is_open()) { return; }
+        if (expectedRows != 0 && rowCount != expectedRows) {
+            file.close();
+            throw std::runtime_error("Matrix file " + filename + " closed after " + std::to_string(rowCount) +
+                                     " of " + std::to_string(expectedRows) + " rows");
+        }
+
+        header.rows = rowCount;
+        file.seekp(0);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.close();
+        if (!file) { throw std::runtime_error("Failed writing matrix file: " + filename); }
+    }
+};
+
+
+inline void saveMatrix(const std::string &filename, ConstMatrixView matrix) {
+    MatrixFileWriter writer(filename, matrix.getCols(), matrix.getRows());
+    writer.appendRows(matrix);
+    writer.close();
+}
+
+
+/**
+ *  Converts a text matrix (one row per line, values separated by commas and/or whitespace) into a .mat file,
+ *  streaming line by line. Blank lines and lines starting with '#' are skipped. Returns the number of rows.
+ */
+inline std::uint64_t convertTextToMatrix(const std::string &input, const std::string &output) {
+    std::ifstream text(input);
+    if (!text) { throw std::runtime_error("Cannot open text matrix: " + input); }
+
+    std::unique_ptr<MatrixFileWriter> writer;
+    std::vector<double> values;
+    std::string line;
+    std::uint64_t lineNumber = 0;
+
+    while (std::getline(text, line)) {
+        lineNumber++;
+        if (line.empty() || line[0] == '#' || line.find_first_not_of(" \t\r,") == std::string::npos) { continue; }
+
+        values.clear();
+        const char *cursor = line.c_str();
+        while (*cursor != '\0') {
+            while (*cursor == ',' || *cursor == ' ' || *cursor == '\t' || *cursor == '\r') { cursor++; }
+            if (*cursor == '\0') { break; }
+
+            char *end = nullptr;
+            double value = std::strtod(cursor, &end);
+            if (end == cursor) {
+                throw std::runtime_error(input + ":" + std::to_string(lineNumber) + ": not a number");
+            }
+            values.push_back(value);
+            cursor = end;
+        }
+
+        if (!writer) { writer = std::make_unique<MatrixFileWriter>(output, values.size()); }
+        if (values.size() != writer->getCols()) {
+            throw std::runtime_error(input + ":" + std::to_string(lineNumber) + ": expected " +
+                                     std::to_string(writer->getCols()) + " values, found " +
+                                     std::to_string(values.size()));
+        }
+        writer->appendRow(values.data());
+    }
+
+    if (!writer) { throw std::runtime_error("Text matrix has no rows: " + input); }
+    writer->close();
+    return writer->getRowCount();
+}
+
+
+// Writes a matrix as CSV, full precision so the text round-trips
+inline void writeMatrixText(const std::string &output, ConstMatrixView matrix) {
+    std::ofstream text(output);
+    if (!text) { throw std::runtime_error("Cannot create text matrix: " + output); }
+    text.precision(17);
+    for (std::size_t row = 0; row < matrix.getRows(); row++) {
+        for (std::size_t col = 0; col < matrix.getCols(); col++) {
+            if (col > 0) { text << ','; }
+            text << matrix(row, col);
+        }
+        text << '\n';
+    }
+    if (!text) { throw std::runtime_error("Failed writing text matrix: " + output); }
+}
+
+#endif //MATRIX_MULTIPROCESSING_MATRIXFILE_H
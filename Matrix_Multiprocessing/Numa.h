@@ -0,0 +1,143 @@
+#ifndef MATRIX_MULTIPROCESSING_NUMA_H
+#define MATRIX_MULTIPROCESSING_NUMA_H
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "Elementwise.h"
+#include "Matrix.h"
+#include "ThreadPool.h"
+#ifdef MATRIX_USE_LIBNUMA
+#include <numa.h>
+#endif
+
+/**
+ *  NUMA-aware placement for large matrices.
+ *
+ *  Linux places a page on the node of the thread that first writes it. A matrix zeroed by one thread therefore
+ *  lives on one node, and on a multi-socket machine every other socket reads it over the interconnect.
+ *  allocateFirstTouch instead leaves the memory untouched and lets each pool thread zero exactly the rows that
+ *  the statically scheduled element-wise kernels (Schedule::STATIC) will later give that same thread, so each
+ *  tile is local to the core that processes it. Pin the pool's workers (ThreadPool(n, true) or
+ *  MATRIX_PIN_THREADS=1) or the scheduler may move a thread away from its pages.
+ *
+ *  Build with -DMATRIX_USE_LIBNUMA -lnuma to also bind each part explicitly to its worker's node, which holds
+ *  even when the pages were already touched. On single-node machines all of this is harmless and changes nothing.
+ */
+
+// Parses a sysfs cpulist such as "0-3,8,10-11"
+inline std::vector<int> parseCpuList(const std::string &list) {
+    std::vector<int> cpus;
+    const char *cursor = list.c_str();
+    while (*cursor != '\0' && *cursor != '\n') {
+        char *end = nullptr;
+        long first = std::strtol(cursor, &end, 10);
+        if (end == cursor) { break; }
+        long last = first;
+        cursor = end;
+        if (*cursor == '-') {
+            last = std::strtol(cursor + 1, &end, 10);
+            cursor = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++) { cpus.push_back(int(cpu)); }
+        if (*cursor == ',') { cursor++; }
+    }
+    return cpus;
+}
+
+
+// CPUs of every NUMA node, read once from sysfs. A machine without the sysfs tree counts as a single node
+class NumaTopology {
+private:
+    std::vector<std::vector<int>> nodeCpus;
+
+    NumaTopology() {
+        std::ifstream online("/sys/devices/system/node/online");
+        std::string list;
+        if (online && std::getline(online, list)) {
+            for (int node: parseCpuList(list)) {
+                std::ifstream cpus("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+                std::string cpuList;
+                std::getline(cpus, cpuList);
+                if (nodeCpus.size() <= std::size_t(node)) { nodeCpus.resize(node + 1); }
+                nodeCpus[node] = parseCpuList(cpuList);
+            }
+        }
+        if (nodeCpus.empty()) { nodeCpus.resize(1); }
+    }
+
+public:
+    static const NumaTopology &get() {
+        static NumaTopology topology;
+        return topology;
+    }
+
+    std::size_t getNodeCount() const { return nodeCpus.size(); }
+    const std::vector<int> &getCpus(std::size_t node) const { return nodeCpus[node]; }
+
+    // Node of a CPU, -1 if unknown
+    int nodeOf(int cpu) const {
+        for (std::size_t node = 0; node < nodeCpus.size(); node++) {
+            for (int candidate: nodeCpus[node]) {
+                if (candidate == cpu) { return int(node); }
+            }
+        }
+        return -1;
+    }
+};
+
+
+#ifdef MATRIX_USE_LIBNUMA
+// Binds the whole pages inside each static part of out to the node of the worker that owns the part
+inline void bindStaticParts(MatrixView out, std::size_t rowsPerTile, ThreadPool &pool) {
+    if (numa_available() < 0) { return; }
+    const std::size_t page = std::size_t(sysconf(_SC_PAGESIZE));
+    const std::size_t tiles = (out.getRows() + rowsPerTile - 1) / rowsPerTile;
+
+    for (std::size_t part = 1; part < pool.getConcurrency(); part++) {
+        int node = NumaTopology::get().nodeOf(pool.getPartCpu(part));
+        auto [firstTile, lastTile] = pool.staticPart(tiles, part);
+        if (node < 0 || firstTile == lastTile) { continue; }
+
+        std::size_t begin = reinterpret_cast<std::size_t>(out.rowData(firstTile * rowsPerTile));
+        std::size_t end = reinterpret_cast<std::size_t>(out.rowData(std::min(out.getRows(), lastTile * rowsPerTile)));
+        begin = (begin + page - 1) / page * page;
+        end = end / page * page;
+        if (begin < end) { numa_tonode_memory(reinterpret_cast<void *>(begin), end - begin, node); }
+    }
+}
+#endif
+
+
+/**
+ *  Zeroes out (padding included) with the same static tile partition as the element-wise kernels, so every row
+ *  is first touched by the thread that will process it. out must be a whole Matrix view, not a block().
+ */
+inline void firstTouch(MatrixView out, ThreadPool &pool = ThreadPool::global()) {
+    const std::size_t rowsPerTile = elementwiseRowsPerTile(out.getCols());
+    const std::size_t tiles = (out.getRows() + rowsPerTile - 1) / rowsPerTile;
+#ifdef MATRIX_USE_LIBNUMA
+    bindStaticParts(out, rowsPerTile, pool);
+#endif
+
+    pool.parallelForStatic(tiles, [&](std::size_t begin, std::size_t end) {
+        std::size_t rowBegin = begin * rowsPerTile, rowEnd = std::min(out.getRows(), end * rowsPerTile);
+        std::memset(out.rowData(rowBegin), 0, (rowEnd - rowBegin) * out.getStride() * sizeof(double));
+    });
+}
+
+// Zero-initialized matrix whose pages are placed by the pool threads that will process them
+inline Matrix allocateFirstTouch(std::size_t rows, std::size_t cols, ThreadPool &pool = ThreadPool::global()) {
+    Matrix matrix = Matrix::uninitialized(rows, cols);
+    firstTouch(matrix.view(), pool);
+    return matrix;
+}
+
+#endif //MATRIX_MULTIPROCESSING_NUMA_H
@@ -0,0 +1,346 @@
+#ifndef MATRIX_MULTIPROCESSING_PIPELINE_H
+#define MATRIX_MULTIPROCESSING_PIPELINE_H
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <iomanip>
+#include <istream>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "Matrix.h"
+#include "MatrixCalculator.h"
+#include "MatrixFile.h"
+#include "ThreadPool.h"
+#include "Timing.h"
+
+/**
+ *  Batch service for matrix jobs: a manifest is run through three stages, each on its own thread,
+ *
+ *      load (parse a manifest line, read the operands) -> compute (MatrixCalculator on the pool) -> store (write)
+ *
+ *  connected by BoundedQueues, so reading job N + 1 and writing job N - 1 overlap computing job N. The queues
+ *  give back-pressure: when compute falls behind, its queue fills and load blocks instead of reading ahead
+ *  without limit, so at most 2 * queueDepth + 3 jobs' matrices are in memory at once.
+ *
+ *  Manifest, one job per line, blank lines and '#' comments skipped; the manifest is read as it arrives, so
+ *  jobs can be streamed on stdin:
+ *
+ *      add|subtract|multiply|solve  left.mat right.mat  out.mat
+ *      transpose                    in.mat              out.mat
+ *
+ *  A job that fails (unreadable file, wrong shapes) is reported and the rest still run. PipelineReport has a
+ *  latency histogram per stage and per queue plus the time each stage was blocked on a full queue or starved on
+ *  an empty one, which is what points at the bottleneck.
+ */
+
+// FIFO with a fixed capacity, push() blocks while it is full and pop() while it is empty
+template<typename T>
+class BoundedQueue {
+private:
+    mutable std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    std::deque<T> items;
+    std::size_t capacity;
+    bool closed = false;
+
+    double pushWaitSeconds = 0;     // producers blocked on a full queue
+    double popWaitSeconds = 0;      // consumers blocked on an empty queue
+    std::size_t highWater = 0;
+
+    static double since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+public:
+    explicit BoundedQueue(std::size_t capacity) : capacity(std::max<std::size_t>(1, capacity)) { }
+
+    // Returns false (and drops item) if the queue was closed
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (items.size() >= capacity && !closed) {
+            auto start = std::chrono::steady_clock::now();
+            notFull.wait(lock, [this]() { return items.size() < capacity || closed; });
+            pushWaitSeconds += since(start);
+        }
+        if (closed) { return false; }
+        items.push_back(std::move(item));
+        highWater = std::max(highWater, items.size());
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // Next item, or nothing once the queue is closed and drained
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (items.empty() && !closed) {
+            auto start = std::chrono::steady_clock::now();
+            notEmpty.wait(lock, [this]() { return !items.empty() || closed; });
+            popWaitSeconds += since(start);
+        }
+        if (items.empty()) { return std::nullopt; }
+        std::optional<T> item(std::move(items.front()));
+        items.pop_front();
+        notFull.notify_one();
+        return item;
+    }
+
+    // No more pushes; pop() still returns what is queued
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+    double getPushWaitSeconds() const { std::lock_guard<std::mutex> lock(mutex); return pushWaitSeconds; }
+    double getPopWaitSeconds() const { std::lock_guard<std::mutex> lock(mutex); return popWaitSeconds; }
+    std::size_t getHighWater() const { std::lock_guard<std::mutex> lock(mutex); return highWater; }
+};
+
+
+struct PipelineJob {
+    std::size_t number = 0;             // manifest order, from 1
+    std::string operation;
+    std::string leftPath;
+    std::string rightPath;              // empty for transpose
+    std::string outputPath;
+
+    Matrix left;
+    Matrix right;
+    Matrix result;
+    double sum = 0;
+
+    std::string error;                  // set by the stage that failed, later stages pass the job on
+    double stageSeconds[3] = {};        // load, compute, store
+    std::chrono::steady_clock::time_point accepted;     // manifest line read
+    std::chrono::steady_clock::time_point queued;       // entered the current queue
+};
+
+
+struct PipelineStageReport {
+    std::string name;
+    LatencyHistogram service;           // time the stage spent on each job
+    LatencyHistogram queued;            // time each job waited in the queue in front of the stage
+    double blockedSeconds = 0;          // waiting for room in the next queue (back-pressure)
+    double starvedSeconds = 0;          // waiting for input
+    std::size_t queueHighWater = 0;     // fullest the queue in front of the stage got
+};
+
+
+struct PipelineReport {
+    std::size_t jobs = 0;
+    std::size_t failed = 0;
+    std::size_t queueDepth = 0;
+    double wallSeconds = 0;
+    PipelineStageReport stages[3];      // load, compute, store
+    LatencyHistogram endToEnd;          // manifest line read to result written
+
+    // Stage with the most busy time, the one to speed up
+    const PipelineStageReport &getBottleneck() const {
+        return *std::max_element(std::begin(stages), std::end(stages), [](const auto &a, const auto &b) {
+            return a.service.getTotalSeconds() < b.service.getTotalSeconds();
+        });
+    }
+
+    std::string describe() const {
+        std::ostringstream out;
+        out << std::setprecision(3) << "Pipeline: " << jobs << " jobs (" << failed << " failed) in " << wallSeconds
+            << " s, queue depth " << queueDepth << std::endl;
+        for (const PipelineStageReport &stage: stages) {
+            out << "  " << std::left << std::setw(8) << stage.name << std::right << stage.service.describe()
+                << "; busy " << stage.service.getTotalSeconds() << " s, blocked " << stage.blockedSeconds
+                << " s, starved " << stage.starvedSeconds << " s" << std::endl;
+        }
+        for (const PipelineStageReport &stage: stages) {
+            if (stage.queued.getCount() == 0) { continue; }
+            out << "  queued for " << stage.name << ": " << stage.queued.describe() << ", high water "
+                << stage.queueHighWater << std::endl;
+        }
+        out << "  end to end: " << endToEnd.describe() << std::endl;
+
+        double serialSeconds = 0;
+        for (const PipelineStageReport &stage: stages) { serialSeconds += stage.service.getTotalSeconds(); }
+        out << "  bottleneck: " << getBottleneck().name << ", stages back to back would take " << serialSeconds << " s";
+        return out.str();
+    }
+};
+
+
+class MatrixPipeline {
+private:
+    std::size_t queueDepth;
+    ThreadPool *pool;
+
+    static double since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static bool isBinary(const std::string &operation) {
+        return operation == "add" || operation == "subtract" || operation == "multiply" || operation == "solve";
+    }
+
+    // Fills the job's operation and paths from a manifest line
+    static void parseJob(const std::string &line, PipelineJob &job) {
+        std::istringstream fields(line);
+        std::string extra;
+        fields >> job.operation >> job.leftPath;
+        if (isBinary(job.operation)) {
+            fields >> job.rightPath >> job.outputPath;
+        } else if (job.operation == "transpose") {
+            fields >> job.outputPath;
+        } else {
+            throw std::invalid_argument("Unknown operation '" + job.operation + "'");
+        }
+        if (job.outputPath.empty() || fields >> extra) {
+            throw std::invalid_argument("Expected '" + job.operation + (isBinary(job.operation) ? " left right" : " in") +
+                                        " out', got '" + line + "'");
+        }
+    }
+
+    // Operands are copied out of the mapping, so the files are read here and not page-faulted in by compute
+    static void loadJob(PipelineJob &job) {
+        job.left = Matrix::copyOf(MappedMatrix(job.leftPath));
+        if (!job.rightPath.empty()) { job.right = Matrix::copyOf(MappedMatrix(job.rightPath)); }
+    }
+
+    void computeJob(PipelineJob &job) const {
+        MatrixCalculator calculator(0, 0);
+        calculator.setThreadPool(*pool);
+        calculator.setMatrices(std::move(job.left), std::move(job.right));
+        if (job.operation == "add") {
+            calculator.matrixAdd();
+        } else if (job.operation == "subtract") {
+            calculator.matrixSubtract();
+        } else if (job.operation == "multiply") {
+            calculator.matrixMultiply();
+        } else if (job.operation == "solve") {
+            calculator.matrixSolve();
+        } else {
+            calculator.matrixTranspose();
+        }
+        job.result = calculator.takeResult();
+        job.sum = calculator.getSum();
+    }
+
+public:
+    // queueDepth: jobs that may wait between two stages
+    explicit MatrixPipeline(std::size_t queueDepth = 2, ThreadPool &pool = ThreadPool::global())
+        : queueDepth(std::max<std::size_t>(1, queueDepth)), pool(&pool) { }
+
+    // Runs every job in manifest, one line per finished job goes to log
+    PipelineReport run(std::istream &manifest, std::ostream &log) {
+        PipelineReport report;
+        report.queueDepth = queueDepth;
+        report.stages[0].name = "load";
+        report.stages[1].name = "compute";
+        report.stages[2].name = "store";
+        PipelineStageReport &load = report.stages[0], &compute = report.stages[1], &store = report.stages[2];
+
+        BoundedQueue<PipelineJob> computeQueue(queueDepth), storeQueue(queueDepth);
+        const auto start = std::chrono::steady_clock::now();
+
+        std::thread loader([&]() {
+            std::string line;
+            std::size_t number = 0;
+            while (true) {
+                auto waitStart = std::chrono::steady_clock::now();
+                if (!std::getline(manifest, line)) { break; }
+                load.starvedSeconds += since(waitStart);
+
+                const std::size_t first = line.find_first_not_of(" \t\r");
+                if (first == std::string::npos || line[first] == '#') { continue; }
+
+                PipelineJob job;
+                job.number = ++number;
+                job.accepted = std::chrono::steady_clock::now();
+                try {
+                    parseJob(line, job);
+                    loadJob(job);
+                } catch (const std::exception &error) {
+                    job.error = error.what();
+                }
+                job.stageSeconds[0] = since(job.accepted);
+                load.service.record(job.stageSeconds[0]);
+
+                job.queued = std::chrono::steady_clock::now();
+                computeQueue.push(std::move(job));
+            }
+            computeQueue.close();
+        });
+
+        std::thread computer([&]() {
+            while (std::optional<PipelineJob> job = computeQueue.pop()) {
+                compute.queued.record(since(job->queued));
+                auto serviceStart = std::chrono::steady_clock::now();
+                if (job->error.empty()) {
+                    try {
+                        computeJob(*job);
+                    } catch (const std::exception &error) {
+                        job->error = error.what();
+                    }
+                }
+                job->stageSeconds[1] = since(serviceStart);
+                compute.service.record(job->stageSeconds[1]);
+
+                job->queued = std::chrono::steady_clock::now();
+                storeQueue.push(std::move(*job));
+            }
+            storeQueue.close();
+        });
+
+        // Store runs on the calling thread
+        while (std::optional<PipelineJob> job = storeQueue.pop()) {
+            store.queued.record(since(job->queued));
+            auto serviceStart = std::chrono::steady_clock::now();
+            if (job->error.empty()) {
+                try {
+                    saveMatrix(job->outputPath, job->result);
+                } catch (const std::exception &error) {
+                    job->error = error.what();
+                }
+            }
+            job->result = Matrix();
+            job->stageSeconds[2] = since(serviceStart);
+            store.service.record(job->stageSeconds[2]);
+            report.endToEnd.record(since(job->accepted));
+
+            report.jobs++;
+            std::ostringstream line;
+            line << std::setprecision(3) << "job " << job->number << " " << job->operation << ": ";
+            if (job->error.empty()) {
+                line << job->outputPath << ", total value " << std::setprecision(6) << job->sum << std::setprecision(3)
+                     << " (load " << job->stageSeconds[0] * 1e3 << " ms, compute " << job->stageSeconds[1] * 1e3
+                     << " ms, store " << job->stageSeconds[2] * 1e3 << " ms)";
+            } else {
+                report.failed++;
+                line << "failed: " << job->error;
+            }
+            log << line.str() << std::endl;
+        }
+        loader.join();
+        computer.join();
+
+        report.wallSeconds = since(start);
+        load.blockedSeconds = computeQueue.getPushWaitSeconds();
+        compute.starvedSeconds = computeQueue.getPopWaitSeconds();
+        compute.queueHighWater = computeQueue.getHighWater();
+        compute.blockedSeconds = storeQueue.getPushWaitSeconds();
+        store.starvedSeconds = storeQueue.getPopWaitSeconds();
+        store.queueHighWater = storeQueue.getHighWater();
+        return report;
+    }
+};
+
+#endif //MATRIX_MULTIPROCESSING_PIPELINE_H
@@ -0,0 +1,147 @@
+#ifndef MATRIX_MULTIPROCESSING_SIMD_H
+#define MATRIX_MULTIPROCESSING_SIMD_H
+
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+/**
+ *  Runtime SIMD dispatch helpers.
+ *
+ *  Kernels are written once as MATRIX_INLINE templates over GCC/Clang vector extensions and instantiated inside
+ *  small wrapper functions marked MATRIX_TARGET_AVX2 / MATRIX_TARGET_AVX512. The templates inline into the
+ *  wrappers and are compiled for that instruction set, so the program builds without -mavx flags and still runs
+ *  on CPUs that lack AVX: activeSimdLevel() picks the best level the CPU supports at runtime.
+ *
+ *  Set MATRIX_SIMD=scalar|avx2|avx512 in the environment to force a lower level, e.g. for benchmarks.
+ */
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define MATRIX_X86_SIMD 1
+#define MATRIX_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define MATRIX_TARGET_AVX512 __attribute__((target("avx512f,avx512dq")))
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MATRIX_INLINE inline __attribute__((always_inline))
+#else
+#define MATRIX_INLINE inline
+#endif
+
+// Fully unroll the fixed-size register tile loops so accumulators stay in registers
+#if defined(__clang__)
+#define MATRIX_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__)
+#define MATRIX_UNROLL _Pragma("GCC unroll 16")
+#else
+#define MATRIX_UNROLL
+#endif
+
+
+enum class SimdLevel {
+    SCALAR = 0,
+    AVX2 = 1,
+    AVX512 = 2
+};
+
+
+inline const char *simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX512: return "avx512";
+        case SimdLevel::AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+
+// Best level this CPU supports
+inline SimdLevel detectSimdLevel() {
+#ifdef MATRIX_X86_SIMD
+    static const SimdLevel detected = []() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) { return SimdLevel::AVX512; }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) { return SimdLevel::AVX2; }
+        return SimdLevel::SCALAR;
+    }();
+    return detected;
+#else
+    return SimdLevel::SCALAR;
+#endif
+}
+
+
+// Level kernels should use: the detected level, optionally lowered by MATRIX_SIMD
+inline SimdLevel activeSimdLevel() {
+    static const SimdLevel active = []() {
+        SimdLevel level = detectSimdLevel();
+        const char *forced = std::getenv("MATRIX_SIMD");
+        if (forced == nullptr) { return level; }
+
+        std::string name(forced);
+        SimdLevel requested = name == "avx512" ? SimdLevel::AVX512 : name == "avx2" ? SimdLevel::AVX2 : SimdLevel::SCALAR;
+        return requested < level ? requested : level;
+    }();
+    return active;
+}
+
+
+// Vector of W elements of T, W * sizeof(T) bytes wide
+template<typename T, int W>
+struct SimdVector {
+    typedef T type __attribute__((vector_size(W * sizeof(T))));
+};
+
+// Element type of a vector, or the type itself for a plain scalar
+template<typename T>
+struct SimdElementOf {
+    typedef T type;
+};
+
+template<typename T> requires requires(T vector) { vector[0]; }
+struct SimdElementOf<T> {
+    typedef std::remove_cvref_t<decltype(std::declval<T>()[0])> type;
+};
+
+template<typename T>
+using SimdElement = typename SimdElementOf<T>::type;
+
+// Unaligned loads and stores, memcpy compiles to a single vector move. The load fills an out parameter because
+// returning a wide vector by value from a function compiled without AVX changes the ABI (-Wpsabi)
+template<typename V, typename T>
+MATRIX_INLINE void loadVector(V &value, const T *source) {
+    std::memcpy(&value, source, sizeof(V));
+}
+
+template<typename V, typename T>
+MATRIX_INLINE void storeVector(T *destination, const V &value) {
+    std::memcpy(destination, &value, sizeof(V));
+}
+
+/**
+ *  Non-temporal store of one full vector of doubles to an address aligned to its size: the line goes to memory without
+ *  being read first or kept in cache, which pays off for large outputs that are not read again soon. Written
+ *  as inline assembly, so it can sit in the generic templates and is only assembled once they are inlined into
+ *  the AVX wrappers. Call streamFence() before other threads may read the data.
+ */
+template<typename V, typename T>
+MATRIX_INLINE void streamVector(T *destination, const V &value) {
+#ifdef MATRIX_X86_SIMD
+    if constexpr (sizeof(V) == 32 || sizeof(V) == 64) {
+        asm("vmovntpd %1, %0" : "=m"(*reinterpret_cast<V *>(destination)) : "v"(value));
+        return;
+    }
+#endif
+    storeVector(destination, value);
+}
+
+inline void streamFence() {
+#ifdef MATRIX_X86_SIMD
+    __builtin_ia32_sfence();
+#endif
+}
+
+#endif //MATRIX_MULTIPROCESSING_SIMD_H
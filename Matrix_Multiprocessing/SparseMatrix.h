@@ -0,0 +1,429 @@
+#ifndef MATRIX_MULTIPROCESSING_SPARSEMATRIX_H
+#define MATRIX_MULTIPROCESSING_SPARSEMATRIX_H
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "Matrix.h"
+#include "ThreadPool.h"
+
+/**
+ *  Compressed sparse matrices.
+ *
+ *  CsrMatrix (compressed sparse row) stores, for every row, the column index and value of each non-zero, rows
+ *  back to back; rowPointers[row] .. rowPointers[row + 1] is the slice for that row. CscMatrix is the same by
+ *  column. Indices within a row (column) are strictly increasing and explicit zeros are never stored.
+ *
+ *  Parallel kernels split rows into chunks of roughly equal non-zero count rather than equal row count, so a
+ *  few very dense rows (power-law matrices) do not leave one thread with all the work.
+ */
+
+typedef std::uint32_t SparseIndex;
+
+
+class CscMatrix;
+
+
+class CsrMatrix {
+private:
+    std::size_t rows = 0;
+    std::size_t cols = 0;
+    std::vector<std::size_t> rowPointers{0};
+    std::vector<SparseIndex> columnIndices;
+    std::vector<double> values;
+
+public:
+    CsrMatrix() = default;
+
+    // rows x cols matrix of zeros
+    CsrMatrix(std::size_t rows, std::size_t cols) : rows(rows), cols(cols), rowPointers(rows + 1, 0) {
+        if (cols > std::size_t(UINT32_MAX)) { throw std::invalid_argument("Sparse matrix has too many columns"); }
+    }
+
+    // Takes prepared arrays, checks that they describe a valid matrix
+    CsrMatrix(std::size_t rows, std::size_t cols, std::vector<std::size_t> rowPointers,
+              std::vector<SparseIndex> columnIndices, std::vector<double> values)
+        : rows(rows), cols(cols), rowPointers(std::move(rowPointers)), columnIndices(std::move(columnIndices)),
+          values(std::move(values)) {
+        if (this->rowPointers.size() != rows + 1 || this->rowPointers.front() != 0 ||
+            this->rowPointers.back() != this->values.size() || this->columnIndices.size() != this->values.size()) {
+            throw std::invalid_argument("Inconsistent CSR arrays");
+        }
+        for (std::size_t row = 0; row < rows; row++) {
+            if (this->rowPointers[row] > this->rowPointers[row + 1]) {
+                throw std::invalid_argument("CSR row pointers not increasing");
+            }
+            for (std::size_t i = this->rowPointers[row]; i < this->rowPointers[row + 1]; i++) {
+                if (this->columnIndices[i] >= cols || (i > this->rowPointers[row] && this->columnIndices[i] <= this->columnIndices[i - 1])) {
+                    throw std::invalid_argument("CSR column indices out of range or not increasing");
+                }
+            }
+        }
+    }
+
+    // Keeps the elements whose magnitude is above tolerance
+    static CsrMatrix fromDense(ConstMatrixView dense, double tolerance = 0.0) {
+        CsrMatrix sparse(dense.getRows(), dense.getCols());
+        for (std::size_t row = 0; row < dense.getRows(); row++) {
+            const double *values = dense.rowData(row);
+            for (std::size_t col = 0; col < dense.getCols(); col++) {
+                if (std::fabs(values[col]) > tolerance) {
+                    sparse.columnIndices.push_back(SparseIndex(col));
+                    sparse.values.push_back(values[col]);
+                }
+            }
+            sparse.rowPointers[row + 1] = sparse.values.size();
+        }
+        return sparse;
+    }
+
+    Matrix toDense() const {
+        Matrix dense(rows, cols);
+        for (std::size_t row = 0; row < rows; row++) {
+            for (std::size_t i = rowPointers[row]; i < rowPointers[row + 1]; i++) { dense(row, columnIndices[i]) = values[i]; }
+        }
+        return dense;
+    }
+
+    inline CscMatrix toCsc() const;
+
+    std::size_t getRows() const { return rows; }
+    std::size_t getCols() const { return cols; }
+    std::size_t getNonZeros() const { return values.size(); }
+    double getDensity() const { return rows * cols == 0 ? 0 : double(values.size()) / (double(rows) * double(cols)); }
+
+    const std::vector<std::size_t> &getRowPointers() const { return rowPointers; }
+    const std::vector<SparseIndex> &getColumnIndices() const { return columnIndices; }
+    const std::vector<double> &getValues() const { return values; }
+};
+
+
+class CscMatrix {
+private:
+    std::size_t rows = 0;
+    std::size_t cols = 0;
+    std::vector<std::size_t> columnPointers{0};
+    std::vector<SparseIndex> rowIndices;
+    std::vector<double> values;
+
+public:
+    CscMatrix() = default;
+
+    // Takes prepared arrays, checks that they describe a valid matrix
+    CscMatrix(std::size_t rows, std::size_t cols, std::vector<std::size_t> columnPointers,
+              std::vector<SparseIndex> rowIndices, std::vector<double> values)
+        : rows(rows), cols(cols), columnPointers(std::move(columnPointers)), rowIndices(std::move(rowIndices)),
+          values(std::move(values)) {
+        if (rows > std::size_t(UINT32_MAX)) { throw std::invalid_argument("Sparse matrix has too many rows"); }
+        if (this->columnPointers.size() != cols + 1 || this->columnPointers.front() != 0 ||
+            this->columnPointers.back() != this->values.size() || this->rowIndices.size() != this->values.size()) {
+            throw std::invalid_argument("Inconsistent CSC arrays");
+        }
+        for (std::size_t col = 0; col < cols; col++) {
+            if (this->columnPointers[col] > this->columnPointers[col + 1]) {
+                throw std::invalid_argument("CSC column pointers not increasing");
+            }
+            for (std::size_t i = this->columnPointers[col]; i < this->columnPointers[col + 1]; i++) {
+                if (this->rowIndices[i] >= rows || (i > this->columnPointers[col] && this->rowIndices[i] <= this->rowIndices[i - 1])) {
+                    throw std::invalid_argument("CSC row indices out of range or not increasing");
+                }
+            }
+        }
+    }
+
+    static CscMatrix fromDense(ConstMatrixView dense, double tolerance = 0.0) {
+        return CsrMatrix::fromDense(dense, tolerance).toCsc();
+    }
+
+    // Same transpose-of-layout as CsrMatrix::toCsc, with the roles of rows and columns swapped
+    CsrMatrix toCsr() const {
+        std::vector<std::size_t> rowPointers(rows + 1, 0);
+        for (SparseIndex row: rowIndices) { rowPointers[row + 1]++; }
+        for (std::size_t row = 0; row < rows; row++) { rowPointers[row + 1] += rowPointers[row]; }
+
+        std::vector<SparseIndex> columnIndices(values.size());
+        std::vector<double> rowValues(values.size());
+        std::vector<std::size_t> next(rowPointers.begin(), rowPointers.end() - 1);
+        for (std::size_t col = 0; col < cols; col++) {
+            for (std::size_t i = columnPointers[col]; i < columnPointers[col + 1]; i++) {
+                std::size_t slot = next[rowIndices[i]]++;
+                columnIndices[slot] = SparseIndex(col);
+                rowValues[slot] = values[i];
+            }
+        }
+        return CsrMatrix(rows, cols, std::move(rowPointers), std::move(columnIndices), std::move(rowValues));
+    }
+
+    Matrix toDense() const { return toCsr().toDense(); }
+
+    std::size_t getRows() const { return rows; }
+    std::size_t getCols() const { return cols; }
+    std::size_t getNonZeros() const { return values.size(); }
+
+    const std::vector<std::size_t> &getColumnPointers() const { return columnPointers; }
+    const std::vector<SparseIndex> &getRowIndices() const { return rowIndices; }
+    const std::vector<double> &getValues() const { return values; }
+};
+
+
+CscMatrix CsrMatrix::toCsc() const {
+    // Counting sort by column: columns visited in row order, so row indices come out increasing
+    std::vector<std::size_t> columnPointers(cols + 1, 0);
+    for (SparseIndex col: columnIndices) { columnPointers[col + 1]++; }
+    for (std::size_t col = 0; col < cols; col++) { columnPointers[col + 1] += columnPointers[col]; }
+
+    std::vector<SparseIndex> rowIndices(values.size());
+    std::vector<double> columnValues(values.size());
+    std::vector<std::size_t> next(columnPointers.begin(), columnPointers.end() - 1);
+    for (std::size_t row = 0; row < rows; row++) {
+        for (std::size_t i = rowPointers[row]; i < rowPointers[row + 1]; i++) {
+            std::size_t slot = next[columnIndices[i]]++;
+            rowIndices[slot] = SparseIndex(row);
+            columnValues[slot] = values[i];
+        }
+    }
+    return CscMatrix(rows, cols, std::move(columnPointers), std::move(rowIndices), std::move(columnValues));
+}
+
+
+/**
+ *  Splits [0, pointers.size() - 1) into at most `parts` contiguous ranges holding about the same number of
+ *  entries (plus one per row, so long runs of empty rows are still shared out). Returns the boundaries.
+ */
+inline std::vector<std::size_t> balancedRanges(const std::vector<std::size_t> &pointers, std::size_t parts) {
+    const std::size_t count = pointers.size() - 1;
+    const double total = double(pointers.back() + count);
+    parts = std::max<std::size_t>(1, std::min(parts, count));
+
+    std::vector<std::size_t> bounds{0};
+    std::size_t index = 0;
+    for (std::size_t part = 1; part < parts; part++) {
+        double target = total * double(part) / double(parts);
+        while (index < count && double(pointers[index] + index) < target) { index++; }
+        if (index > bounds.back()) { bounds.push_back(index); }
+    }
+    bounds.push_back(count);
+    return bounds;
+}
+
+
+// y = A * x
+inline std::vector<double> multiply(const CsrMatrix &a, const std::vector<double> &x,
+                                    ThreadPool &pool = ThreadPool::global()) {
+    if (x.size() != a.getCols()) { throw std::invalid_argument("SpMV vector length does not match the matrix"); }
+
+    std::vector<double> y(a.getRows(), 0.0);
+    const std::vector<std::size_t> &pointers = a.getRowPointers();
+    const SparseIndex *columns = a.getColumnIndices().data();
+    const double *values = a.getValues().data();
+
+    std::vector<std::size_t> bounds = balancedRanges(pointers, pool.getConcurrency() * 8);
+    pool.parallelFor(bounds.size() - 1, 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t part = begin; part < end; part++) {
+            for (std::size_t row = bounds[part]; row < bounds[part + 1]; row++) {
+                double sum = 0;
+                for (std::size_t i = pointers[row]; i < pointers[row + 1]; i++) { sum += values[i] * x[columns[i]]; }
+                y[row] = sum;
+            }
+        }
+    });
+    return y;
+}
+
+
+// y = A * x by columns: each chunk of columns scatters into its own y, the partial ys are added in chunk order
+inline std::vector<double> multiply(const CscMatrix &a, const std::vector<double> &x,
+                                    ThreadPool &pool = ThreadPool::global()) {
+    if (x.size() != a.getCols()) { throw std::invalid_argument("SpMV vector length does not match the matrix"); }
+
+    const std::vector<std::size_t> &pointers = a.getColumnPointers();
+    const SparseIndex *rowIndices = a.getRowIndices().data();
+    const double *values = a.getValues().data();
+
+    std::vector<std::size_t> bounds = balancedRanges(pointers, pool.getConcurrency());
+    std::vector<std::vector<double>> partials(bounds.size() - 1);
+    pool.parallelFor(partials.size(), 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t part = begin; part < end; part++) {
+            std::vector<double> &y = partials[part];
+            y.assign(a.getRows(), 0.0);
+            for (std::size_t col = bounds[part]; col < bounds[part + 1]; col++) {
+                for (std::size_t i = pointers[col]; i < pointers[col + 1]; i++) { y[rowIndices[i]] += values[i] * x[col]; }
+            }
+        }
+    });
+
+    std::vector<double> y(a.getRows(), 0.0);
+    for (const std::vector<double> &partial: partials) {
+        for (std::size_t row = 0; row < y.size(); row++) { y[row] += partial[row]; }
+    }
+    return y;
+}
+
+
+/**
+ *  Runs a two-pass row-wise construction of a CSR result: countRow(row) returns the number of non-zeros of
+ *  that row, fillRow(row, columns, values) writes exactly that many. Both passes are parallel over
+ *  non-zero-balanced row chunks; `work` gives the per-row cost used for balancing.
+ */
+template<typename CountRow, typename FillRow>
+CsrMatrix buildCsrByRows(std::size_t rows, std::size_t cols, const std::vector<std::size_t> &work, ThreadPool &pool,
+                         CountRow &&countRow, FillRow &&fillRow) {
+    std::vector<std::size_t> bounds = balancedRanges(work, pool.getConcurrency() * 8);
+    std::vector<std::size_t> rowPointers(rows + 1, 0);
+
+    pool.parallelFor(bounds.size() - 1, 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t part = begin; part < end; part++) {
+            for (std::size_t row = bounds[part]; row < bounds[part + 1]; row++) { rowPointers[row + 1] = countRow(row); }
+        }
+    });
+    for (std::size_t row = 0; row < rows; row++) { rowPointers[row + 1] += rowPointers[row]; }
+
+    std::vector<SparseIndex> columnIndices(rowPointers.back());
+    std::vector<double> values(rowPointers.back());
+    pool.parallelFor(bounds.size() - 1, 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t part = begin; part < end; part++) {
+            for (std::size_t row = bounds[part]; row < bounds[part + 1]; row++) {
+                fillRow(row, columnIndices.data() + rowPointers[row], values.data() + rowPointers[row]);
+            }
+        }
+    });
+    return CsrMatrix(rows, cols, std::move(rowPointers), std::move(columnIndices), std::move(values));
+}
+
+
+// A + B, merging the sorted column lists of each row. Entries that cancel to exactly zero are dropped
+inline CsrMatrix add(const CsrMatrix &a, const CsrMatrix &b, ThreadPool &pool = ThreadPool::global()) {
+    if (a.getRows() != b.getRows() || a.getCols() != b.getCols()) {
+        throw std::invalid_argument("Sparse operands have different shapes");
+    }
+
+    const std::vector<std::size_t> &aPointers = a.getRowPointers(), &bPointers = b.getRowPointers();
+    const SparseIndex *aColumns = a.getColumnIndices().data(), *bColumns = b.getColumnIndices().data();
+    const double *aValues = a.getValues().data(), *bValues = b.getValues().data();
+
+    // Calls emit(column, value) for every non-zero of row (a + b), in column order
+    auto mergeRow = [&](std::size_t row, auto &&emit) {
+        std::size_t i = aPointers[row], j = bPointers[row];
+        const std::size_t iEnd = aPointers[row + 1], jEnd = bPointers[row + 1];
+        while (i < iEnd || j < jEnd) {
+            if (j == jEnd || (i < iEnd && aColumns[i] < bColumns[j])) {
+                emit(aColumns[i], aValues[i]);
+                i++;
+            } else if (i == iEnd || bColumns[j] < aColumns[i]) {
+                emit(bColumns[j], bValues[j]);
+                j++;
+            } else {
+                double sum = aValues[i] + bValues[j];
+                if (sum != 0) { emit(aColumns[i], sum); }
+                i++;
+                j++;
+            }
+        }
+    };
+
+    std::vector<std::size_t> work(aPointers.size());
+    for (std::size_t row = 0; row < work.size(); row++) { work[row] = aPointers[row] + bPointers[row]; }
+
+    return buildCsrByRows(a.getRows(), a.getCols(), work, pool,
+        [&](std::size_t row) {
+            std::size_t count = 0;
+            mergeRow(row, [&count](SparseIndex, double) { count++; });
+            return count;
+        },
+        [&](std::size_t row, SparseIndex *columns, double *values) {
+            mergeRow(row, [&columns, &values](SparseIndex column, double value) {
+                *columns++ = column;
+                *values++ = value;
+            });
+        });
+}
+
+
+/**
+ *  Per-thread sparse accumulator for Gustavson's SpGEMM: a dense value array over B's columns plus the list of
+ *  columns touched by the current row, so clearing costs only what was used.
+ */
+class SparseAccumulator {
+private:
+    std::vector<double> values;
+    std::vector<std::size_t> marks;
+    std::vector<SparseIndex> touched;
+    std::size_t generation = 0;
+
+public:
+    void start(std::size_t cols) {
+        if (values.size() < cols) {
+            values.assign(cols, 0.0);
+            marks.assign(cols, 0);
+        }
+        generation++;
+        touched.clear();
+    }
+
+    void add(SparseIndex column, double value) {
+        if (marks[column] != generation) {
+            marks[column] = generation;
+            values[column] = value;
+            touched.push_back(column);
+        } else {
+            values[column] += value;
+        }
+    }
+
+    std::vector<SparseIndex> &getTouched() { return touched; }
+    double get(SparseIndex column) const { return values[column]; }
+};
+
+
+// Row i of A * B is the sum of rows k of B scaled by A(i, k) (Gustavson). Symbolic pass counts, numeric pass fills
+inline CsrMatrix multiply(const CsrMatrix &a, const CsrMatrix &b, ThreadPool &pool = ThreadPool::global()) {
+    if (a.getCols() != b.getRows()) { throw std::invalid_argument("SpGEMM inner dimensions differ"); }
+
+    const std::vector<std::size_t> &aPointers = a.getRowPointers(), &bPointers = b.getRowPointers();
+    const SparseIndex *aColumns = a.getColumnIndices().data(), *bColumns = b.getColumnIndices().data();
+    const double *aValues = a.getValues().data(), *bValues = b.getValues().data();
+
+    // Accumulates row of A * B, touched columns sorted so the result is canonical CSR
+    auto accumulateRow = [&](std::size_t row, SparseAccumulator &accumulator) -> std::vector<SparseIndex> & {
+        accumulator.start(b.getCols());
+        for (std::size_t i = aPointers[row]; i < aPointers[row + 1]; i++) {
+            const SparseIndex k = aColumns[i];
+            const double scale = aValues[i];
+            for (std::size_t j = bPointers[k]; j < bPointers[k + 1]; j++) { accumulator.add(bColumns[j], scale * bValues[j]); }
+        }
+        std::vector<SparseIndex> &touched = accumulator.getTouched();
+        std::sort(touched.begin(), touched.end());
+        return touched;
+    };
+
+    // Work per row is the number of multiply-adds it does
+    std::vector<std::size_t> work(aPointers.size(), 0);
+    for (std::size_t row = 0; row < a.getRows(); row++) {
+        std::size_t flops = 0;
+        for (std::size_t i = aPointers[row]; i < aPointers[row + 1]; i++) { flops += bPointers[aColumns[i] + 1] - bPointers[aColumns[i]]; }
+        work[row + 1] = work[row] + flops;
+    }
+
+    thread_local SparseAccumulator accumulator;
+    return buildCsrByRows(a.getRows(), b.getCols(), work, pool,
+        [&](std::size_t row) {
+            std::vector<SparseIndex> &touched = accumulateRow(row, accumulator);
+            return std::size_t(std::count_if(touched.begin(), touched.end(),
+                [](SparseIndex column) { return accumulator.get(column) != 0; }));
+        },
+        [&](std::size_t row, SparseIndex *columns, double *values) {
+            for (SparseIndex column: accumulateRow(row, accumulator)) {
+                double value = accumulator.get(column);
+                if (value == 0) { continue; }
+                *columns++ = column;
+                *values++ = value;
+            }
+        });
+}
+
+#endif //MATRIX_MULTIPROCESSING_SPARSEMATRIX_H
@@ -0,0 +1,388 @@
+#ifndef MATRIX_MULTIPROCESSING_STRASSEN_H
+#define MATRIX_MULTIPROCESSING_STRASSEN_H
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Elementwise.h"
+#include "Gemm.h"
+#include "Matrix.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+/**
+ *  Strassen-Winograd multiplication, C = A * B, on top of the blocked gemm.
+ *
+ *  Each level splits A, B and C into quadrants and forms C from 7 half-size products instead of 8, plus 15
+ *  quadrant additions (Winograd's variant). Levels recurse while every dimension is at least the crossover and
+ *  then hand over to gemm. Odd dimensions are peeled: the even core goes through Strassen and the last row,
+ *  column and inner slice are fixed up with gemm.
+ *
+ *  Serial levels use the two-temporary schedule of Boyer, Dumas, Pernet and Zhou (products land directly in C's
+ *  quadrants), the top level(s) keep all seven operands and products in temporaries so the products can run as
+ *  independent tasks on the pool. All temporaries of the whole recursion are carved from one arena sized up
+ *  front (strassenWorkspace), so no level allocates. Each top-level call checks its arena out of a shared free
+ *  list (StrassenWorkspace) rather than using a thread_local one: a thread waiting inside strassen() helps the
+ *  pool, and the task it picks up may be another strassen() call.
+ *
+ *  The crossover depends on the machine and its gemm kernel: strassenCrossover() measures it once
+ *  (tuneStrassenCrossover) and caches it in a file, see strassenCachePath(). Strassen trades accuracy for speed:
+ *  the error bound grows with every level, so results differ from gemm in the last bits.
+ */
+
+static constexpr std::size_t STRASSEN_MIN_CROSSOVER = 64;
+
+
+// Bump allocator over one preallocated buffer, rows start on 64-byte boundaries
+class StrassenArena {
+private:
+    double *next = nullptr;
+    double *end = nullptr;
+
+    static std::size_t paddedStride(std::size_t cols) {
+        const std::size_t perLine = MATRIX_ALIGNMENT / sizeof(double);
+        return (cols + perLine - 1) / perLine * perLine;
+    }
+
+public:
+    StrassenArena(double *begin, std::size_t count) : next(begin), end(begin + count) { }
+
+    // Doubles take(rows, cols) uses
+    static std::size_t footprint(std::size_t rows, std::size_t cols) { return rows * paddedStride(cols); }
+
+    MatrixView take(std::size_t rows, std::size_t cols) {
+        const std::size_t count = footprint(rows, cols);
+        if (count > std::size_t(end - next)) { throw std::logic_error("Strassen workspace too small"); }
+        MatrixView view(next, rows, cols, paddedStride(cols));
+        next += count;
+        return view;
+    }
+
+    // Hands the next `count` doubles to a child recursion
+    StrassenArena split(std::size_t count) {
+        if (count > std::size_t(end - next)) { throw std::logic_error("Strassen workspace too small"); }
+        StrassenArena child(next, count);
+        next += count;
+        return child;
+    }
+};
+
+
+// Doubles of arena needed to multiply (m x k) * (k x n), parallelLevels top levels keep all temporaries
+inline std::size_t strassenWorkspace(std::size_t m, std::size_t k, std::size_t n, std::size_t crossover,
+                                     std::size_t parallelLevels) {
+    if (std::min({m, k, n}) < crossover) { return 0; }
+    const std::size_t m2 = m / 2, k2 = k / 2, n2 = n / 2;
+    const std::size_t child = strassenWorkspace(m2, k2, n2, crossover, parallelLevels > 0 ? parallelLevels - 1 : 0);
+
+    if (parallelLevels > 0) {
+        return 4 * StrassenArena::footprint(m2, k2) + 4 * StrassenArena::footprint(k2, n2) +
+               4 * StrassenArena::footprint(m2, n2) + 7 * child;
+    }
+    return StrassenArena::footprint(m2, std::max(k2, n2)) + StrassenArena::footprint(k2, n2) + child;
+}
+
+
+// out = a + b or a - b through the fused SIMD kernels (Elementwise.h), out may be a or b
+inline void strassenAdd(ThreadPool &pool, MatrixView out, ConstMatrixView a, ConstMatrixView b, double sign) {
+    if (sign > 0) {
+        elementwise(pool, AddOp(), a, b, out);
+    } else {
+        elementwise(pool, SubtractOp(), a, b, out);
+    }
+}
+
+
+struct StrassenQuadrants {
+    ConstMatrixView a11, a12, a21, a22, b11, b12, b21, b22;
+    MatrixView c11, c12, c21, c22;
+};
+
+
+inline void strassenRecurse(ThreadPool &pool, ConstMatrixView a, ConstMatrixView b, MatrixView c,
+                            std::size_t crossover, std::size_t parallelLevels, StrassenArena arena);
+
+
+// One level with every operand and product in its own temporary, the seven products run as pool tasks
+inline void strassenParallelLevel(ThreadPool &pool, const StrassenQuadrants &q, std::size_t crossover,
+                                  std::size_t parallelLevels, StrassenArena &arena) {
+    const std::size_t m2 = q.a11.getRows(), k2 = q.a11.getCols(), n2 = q.b11.getCols();
+    MatrixView s1 = arena.take(m2, k2), s2 = arena.take(m2, k2), s3 = arena.take(m2, k2), s4 = arena.take(m2, k2);
+    MatrixView t1 = arena.take(k2, n2), t2 = arena.take(k2, n2), t3 = arena.take(k2, n2), t4 = arena.take(k2, n2);
+    MatrixView p1 = arena.take(m2, n2), p5 = arena.take(m2, n2), p6 = arena.take(m2, n2), p7 = arena.take(m2, n2);
+
+    strassenAdd(pool, s1, q.a21, q.a22, 1.0);
+    strassenAdd(pool, s2, s1, q.a11, -1.0);
+    strassenAdd(pool, s3, q.a11, q.a21, -1.0);
+    strassenAdd(pool, s4, q.a12, s2, -1.0);
+    strassenAdd(pool, t1, q.b12, q.b11, -1.0);
+    strassenAdd(pool, t2, q.b22, t1, -1.0);
+    strassenAdd(pool, t3, q.b22, q.b12, -1.0);
+    strassenAdd(pool, t4, t2, q.b21, -1.0);
+
+    // P2, P3 and P4 go straight into C, the other four are needed by more than one quadrant
+    struct Product {
+        ConstMatrixView left, right;
+        MatrixView out;
+    };
+    const Product products[7] = {{q.a11, q.b11, p1}, {q.a12, q.b21, q.c11}, {s4, q.b22, q.c12}, {q.a22, t4, q.c21},
+                                 {s1, t1, p5}, {s2, t2, p6}, {s3, t3, p7}};
+
+    const std::size_t childWorkspace = strassenWorkspace(m2, k2, n2, crossover, parallelLevels - 1);
+    std::vector<StrassenArena> children;
+    for (int i = 0; i < 7; i++) { children.push_back(arena.split(childWorkspace)); }
+
+    pool.parallelFor(7, 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; i++) {
+            strassenRecurse(pool, products[i].left, products[i].right, products[i].out, crossover, parallelLevels - 1,
+                            children[i]);
+        }
+    });
+
+    // U2 = P1 + P6, U3 = U2 + P7; C11 = P1 + P2, C12 = U2 + P5 + P3, C21 = U3 - P4, C22 = U3 + P5
+    strassenAdd(pool, p6, p1, p6, 1.0);
+    strassenAdd(pool, p7, p6, p7, 1.0);
+    strassenAdd(pool, q.c11, q.c11, p1, 1.0);
+    strassenAdd(pool, q.c12, q.c12, p6, 1.0);
+    strassenAdd(pool, q.c12, q.c12, p5, 1.0);
+    strassenAdd(pool, q.c21, p7, q.c21, -1.0);
+    strassenAdd(pool, q.c22, p7, p5, 1.0);
+}
+
+
+// One level with two temporaries, X (m2 x max(k2, n2)) and Y (k2 x n2), products written into C's quadrants
+inline void strassenSerialLevel(ThreadPool &pool, const StrassenQuadrants &q, std::size_t crossover,
+                                StrassenArena &arena) {
+    const std::size_t m2 = q.a11.getRows(), k2 = q.a11.getCols(), n2 = q.b11.getCols();
+    MatrixView xBuffer = arena.take(m2, std::max(k2, n2)), y = arena.take(k2, n2);
+    MatrixView xs = xBuffer.block(0, 0, m2, k2), xp = xBuffer.block(0, 0, m2, n2);
+    StrassenArena child = arena.split(strassenWorkspace(m2, k2, n2, crossover, 0));
+
+    auto multiply = [&](ConstMatrixView left, ConstMatrixView right, MatrixView out) {
+        strassenRecurse(pool, left, right, out, crossover, 0, child);
+    };
+
+    strassenAdd(pool, xs, q.a11, q.a21, -1.0);       // S3
+    strassenAdd(pool, y, q.b22, q.b12, -1.0);        // T3
+    multiply(xs, y, q.c21);                                 // P7
+    strassenAdd(pool, xs, q.a21, q.a22, 1.0);        // S1
+    strassenAdd(pool, y, q.b12, q.b11, -1.0);        // T1
+    multiply(xs, y, q.c22);                                 // P5
+    strassenAdd(pool, xs, xs, q.a11, -1.0);          // S2 = S1 - A11
+    strassenAdd(pool, y, q.b22, y, -1.0);            // T2 = B22 - T1
+    multiply(xs, y, q.c12);                                 // P6
+    strassenAdd(pool, xs, q.a12, xs, -1.0);          // S4 = A12 - S2
+    multiply(xs, q.b22, q.c11);                             // P3
+    multiply(q.a11, q.b11, xp);                             // P1
+    strassenAdd(pool, q.c12, xp, q.c12, 1.0);        // U2 = P1 + P6
+    strassenAdd(pool, q.c21, q.c12, q.c21, 1.0);     // U3 = U2 + P7
+    strassenAdd(pool, q.c12, q.c12, q.c22, 1.0);     // U4 = U2 + P5
+    strassenAdd(pool, q.c22, q.c21, q.c22, 1.0);     // C22 = U3 + P5
+    strassenAdd(pool, q.c12, q.c12, q.c11, 1.0);     // C12 = U4 + P3
+    strassenAdd(pool, y, y, q.b21, -1.0);            // T4 = T2 - B21
+    multiply(q.a22, y, q.c11);                              // P4
+    strassenAdd(pool, q.c21, q.c21, q.c11, -1.0);    // C21 = U3 - P4
+    multiply(q.a12, q.b21, q.c11);                          // P2
+    strassenAdd(pool, q.c11, xp, q.c11, 1.0);        // C11 = P1 + P2
+}
+
+
+inline void strassenRecurse(ThreadPool &pool, ConstMatrixView a, ConstMatrixView b, MatrixView c,
+                            std::size_t crossover, std::size_t parallelLevels, StrassenArena arena) {
+    const std::size_t m = a.getRows(), k = a.getCols(), n = b.getCols();
+    if (std::min({m, k, n}) < crossover) {
+        gemmParallel(pool, a, b, c);
+        return;
+    }
+
+    // Even core through Strassen, odd edges peeled off
+    const std::size_t me = m & ~std::size_t(1), ke = k & ~std::size_t(1), ne = n & ~std::size_t(1);
+    const std::size_t m2 = me / 2, k2 = ke / 2, n2 = ne / 2;
+    StrassenQuadrants q{a.block(0, 0, m2, k2), a.block(0, k2, m2, k2), a.block(m2, 0, m2, k2), a.block(m2, k2, m2, k2),
+                        b.block(0, 0, k2, n2), b.block(0, n2, k2, n2), b.block(k2, 0, k2, n2), b.block(k2, n2, k2, n2),
+                        c.block(0, 0, m2, n2), c.block(0, n2, m2, n2), c.block(m2, 0, m2, n2), c.block(m2, n2, m2, n2)};
+
+    if (parallelLevels > 0) {
+        strassenParallelLevel(pool, q, crossover, parallelLevels, arena);
+    } else {
+        strassenSerialLevel(pool, q, crossover, arena);
+    }
+
+    if (ke < k) { gemmParallel(pool, a.block(0, ke, me, 1), b.block(ke, 0, 1, ne), c.block(0, 0, me, ne), 1.0, 1.0); }
+    if (ne < n) { gemmParallel(pool, a.block(0, 0, me, k), b.block(0, ne, k, 1), c.block(0, ne, me, 1)); }
+    if (me < m) { gemmParallel(pool, a.block(me, 0, 1, k), b, c.block(me, 0, 1, n)); }
+}
+
+
+// Arena of one top-level strassen() call, taken from and given back to a free list so buffers are reused
+class StrassenWorkspace {
+private:
+    static inline std::mutex freeMutex;
+    static inline std::vector<std::unique_ptr<PackBuffer>> freeBuffers;
+
+    std::unique_ptr<PackBuffer> buffer;
+
+public:
+    StrassenWorkspace() {
+        std::lock_guard<std::mutex> lock(freeMutex);
+        if (freeBuffers.empty()) {
+            buffer = std::make_unique<PackBuffer>();
+        } else {
+            buffer = std::move(freeBuffers.back());
+            freeBuffers.pop_back();
+        }
+    }
+
+    StrassenWorkspace(const StrassenWorkspace &) = delete;
+    StrassenWorkspace &operator=(const StrassenWorkspace &) = delete;
+
+    ~StrassenWorkspace() {
+        std::lock_guard<std::mutex> lock(freeMutex);
+        freeBuffers.push_back(std::move(buffer));
+    }
+
+    double *reserve(std::size_t count) { return buffer->reserve(count); }
+};
+
+
+// Levels that run their products as tasks: one is enough for up to 7 threads, two for up to 49
+inline std::size_t strassenParallelLevels(const ThreadPool &pool) {
+    const std::size_t threads = pool.getConcurrency();
+    return threads <= 1 ? 0 : threads <= 7 ? 1 : 2;
+}
+
+
+inline std::size_t strassenCrossover();
+
+// C = A * B with Strassen-Winograd above `crossover` (every dimension at least that big) and gemm below it
+inline void strassen(ConstMatrixView a, ConstMatrixView b, MatrixView c, ThreadPool &pool = ThreadPool::global(),
+                     std::size_t crossover = strassenCrossover()) {
+    checkGemmShapes(a, b, c);
+    crossover = std::max(crossover, STRASSEN_MIN_CROSSOVER);
+    const std::size_t parallelLevels = strassenParallelLevels(pool);
+
+    StrassenWorkspace workspace;
+    const std::size_t count = strassenWorkspace(a.getRows(), a.getCols(), b.getCols(), crossover, parallelLevels);
+    StrassenArena arena(count > 0 ? workspace.reserve(count) : nullptr, count);
+    strassenRecurse(pool, a, b, c, crossover, parallelLevels, arena);
+}
+
+
+struct StrassenSample {
+    std::size_t n;
+    double gemmSeconds;
+    double strassenSeconds;     // one Strassen level on top of gemm
+};
+
+struct StrassenTuning {
+    std::size_t crossover;
+    std::vector<StrassenSample> samples;
+};
+
+/**
+ *  Measures, single-threaded, one Strassen level against gemm for n x n products of growing n. The crossover is
+ *  the smallest n from which one level wins at every larger size tried; if it never wins, twice the largest size.
+ */
+inline StrassenTuning tuneStrassenCrossover(std::size_t maxSize = 2048) {
+    ThreadPool serial(1);
+    StrassenTuning tuning{0, {}};
+
+    for (std::size_t n = 128; n <= maxSize; n *= 2) {
+        Matrix a(n, n), b(n, n), c(n, n);
+        for (std::size_t row = 0; row < n; row++) {
+            for (std::size_t col = 0; col < n; col++) {
+                a(row, col) = double((row * 7 + col * 13) % 17) - 8.0;
+                b(row, col) = double((row * 5 + col * 11) % 19) - 9.0;
+            }
+        }
+
+        auto best = [](int repeats, auto &&function) {
+            double seconds = 1e300;
+            for (int run = 0; run < repeats; run++) {
+                auto start = std::chrono::steady_clock::now();
+                function();
+                seconds = std::min(seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            }
+            return seconds;
+        };
+        const int repeats = n <= 512 ? 5 : 2;
+        double gemmSeconds = best(repeats, [&]() { gemm(a, b, c); });
+        double strassenSeconds = best(repeats, [&]() { strassen(a, b, c, serial, n); });
+        tuning.samples.push_back({n, gemmSeconds, strassenSeconds});
+    }
+
+    tuning.crossover = tuning.samples.empty() ? maxSize * 2 : tuning.samples.back().n * 2;
+    for (auto sample = tuning.samples.rbegin(); sample != tuning.samples.rend(); ++sample) {
+        if (sample->strassenSeconds >= sample->gemmSeconds) { break; }
+        tuning.crossover = sample->n;
+    }
+    return tuning;
+}
+
+
+// MATRIX_STRASSEN_CACHE, else a file under $XDG_CACHE_HOME (or ~/.cache), empty if none of them is set
+inline std::string strassenCachePath() {
+    const std::string name = "matrix_multiprocessing_strassen.txt";
+    if (const char *path = std::getenv("MATRIX_STRASSEN_CACHE")) { return path; }
+    if (const char *cache = std::getenv("XDG_CACHE_HOME")) { return std::string(cache) + "/" + name; }
+    if (const char *home = std::getenv("HOME")) { return std::string(home) + "/.cache/" + name; }
+    return "";
+}
+
+// Cached crossover for this SIMD level, 0 if there is none. Lines are "<simd level> <crossover>"
+inline std::size_t loadStrassenCrossover(const std::string &path) {
+    std::ifstream file(path);
+    std::string level;
+    std::size_t crossover = 0;
+    while (file >> level >> crossover) {
+        if (level == simdLevelName(selectGemmKernel().level)) { return crossover; }
+    }
+    return 0;
+}
+
+// Best effort, a cache that cannot be written is only a slower start next time
+inline void saveStrassenCrossover(const std::string &path, std::size_t crossover) {
+    const std::string key = simdLevelName(selectGemmKernel().level);
+    std::ostringstream kept;
+    {
+        std::ifstream file(path);
+        std::string level;
+        std::size_t value = 0;
+        while (file >> level >> value) {
+            if (level != key) { kept << level << ' ' << value << '\n'; }
+        }
+    }
+    std::ofstream file(path, std::ios::trunc);
+    file << kept.str() << key << ' ' << crossover << '\n';
+}
+
+/**
+ *  Crossover for this machine: MATRIX_STRASSEN_CROSSOVER if set, else the cached value, else tuned now (a few
+ *  seconds, once) and cached.
+ */
+inline std::size_t strassenCrossover() {
+    static const std::size_t crossover = []() {
+        if (const char *forced = std::getenv("MATRIX_STRASSEN_CROSSOVER")) { return std::size_t(std::stoul(forced)); }
+
+        const std::string path = strassenCachePath();
+        std::size_t cached = path.empty() ? 0 : loadStrassenCrossover(path);
+        if (cached != 0) { return cached; }
+
+        std::size_t tuned = tuneStrassenCrossover().crossover;
+        if (!path.empty()) { saveStrassenCrossover(path, tuned); }
+        return tuned;
+    }();
+    return crossover;
+}
+
+#endif //MATRIX_MULTIPROCESSING_STRASSEN_H
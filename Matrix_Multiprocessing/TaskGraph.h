@@ -0,0 +1,88 @@
+#ifndef MATRIX_MULTIPROCESSING_TASKGRAPH_H
+#define MATRIX_MULTIPROCESSING_TASKGRAPH_H
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "ThreadPool.h"
+
+/**
+ *  Directed acyclic graph of tasks run on a ThreadPool.
+ *
+ *  Tasks are added with add() and ordered with dependsOn(); run() starts every task without prerequisites and
+ *  each finishing task posts the successors it was the last prerequisite of. A successor is posted from the
+ *  worker that unblocked it and workers pop their own newest task first, so a chain of dependent tasks (the
+ *  critical path of a factorization, say) tends to stay on one core and runs ahead of the bulk work.
+ *
+ *  If a task throws, the tasks that have not started yet are skipped and run() rethrows the first exception
+ *  once the graph has drained.
+ */
+class TaskGraph {
+private:
+    struct Node {
+        std::function<void()> work;
+        std::vector<std::size_t> successors;
+        std::size_t dependencies = 0;
+        std::atomic<std::size_t> waiting{0};
+    };
+
+    std::vector<std::unique_ptr<Node>> nodes;
+
+public:
+    // Adds a task, returns its id
+    std::size_t add(std::function<void()> work) {
+        nodes.push_back(std::make_unique<Node>());
+        nodes.back()->work = std::move(work);
+        return nodes.size() - 1;
+    }
+
+    // task starts only after prerequisite has finished
+    void dependsOn(std::size_t task, std::size_t prerequisite) {
+        nodes[prerequisite]->successors.push_back(task);
+        nodes[task]->dependencies++;
+    }
+
+    std::size_t size() const { return nodes.size(); }
+
+    // Runs every task, the calling thread helps. The graph can be run again afterwards
+    void run(ThreadPool &pool) {
+        std::atomic<std::size_t> remaining{nodes.size()};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        for (auto &node: nodes) { node->waiting = node->dependencies; }
+
+        std::function<void(std::size_t)> execute = [&](std::size_t id) {
+            Node &node = *nodes[id];
+            if (!failed) {
+                try {
+                    node.work();
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error) { error = std::current_exception(); }
+                    failed = true;
+                }
+            }
+            for (std::size_t successor: node.successors) {
+                if (--nodes[successor]->waiting == 0) { pool.post([&execute, successor]() { execute(successor); }); }
+            }
+            remaining--;
+        };
+
+        for (std::size_t id = 0; id < nodes.size(); id++) {
+            if (nodes[id]->dependencies == 0) { pool.post([&execute, id]() { execute(id); }); }
+        }
+        pool.helpUntil([&remaining]() { return remaining == 0; });
+
+        if (error) { std::rethrow_exception(error); }
+    }
+};
+
+#endif //MATRIX_MULTIPROCESSING_TASKGRAPH_H
@@ -0,0 +1,392 @@
+#ifndef MATRIX_MULTIPROCESSING_THREADPOOL_H
+#define MATRIX_MULTIPROCESSING_THREADPOOL_H
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ *  Persistent work-stealing thread pool.
+ *
+ *  Every worker owns a task deque: it pops its own newest task (LIFO, still warm in cache) and, when empty,
+ *  steals the oldest task from another worker (FIFO, usually the biggest remaining piece). Threads are started
+ *  once and reused, so splitting one matrix into tiles costs a queue push per tile instead of a thread spawn.
+ *
+ *  parallelFor / parallelReduce run on the calling thread too and keep running queued tasks while they wait,
+ *  so a pool of concurrency N has N - 1 workers and nested parallel calls cannot deadlock.
+ *
+ *  Schedule::STATIC instead gives part p of the range to the same thread every time (the caller takes part 0,
+ *  worker p - 1 part p, through a queue that is never stolen from). Memory-bound kernels use it together with
+ *  first-touch allocation (Numa.h) so each thread works on pages that live on its own NUMA node. Workers can be
+ *  pinned to cores so that mapping holds; set MATRIX_PIN_THREADS=1 to pin the global pool.
+ */
+enum class Schedule {
+    DYNAMIC,
+    STATIC
+};
+
+class ThreadPool {
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+        std::deque<std::function<void()>> pinnedTasks;     // only the owning worker runs these
+        std::atomic<std::size_t> pinnedPending{0};
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> workers;
+    std::vector<int> workerCpus;                            // -1 when not pinned
+    std::vector<int> workerThreadIds;                       // kernel thread ids, -1 where unknown
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<std::size_t> pending{0};
+    std::atomic<std::size_t> nextQueue{0};
+    bool stopping = false;
+
+    // How long helpUntil yields before it sleeps, and how long it sleeps between checks of its condition
+    static constexpr int HELP_SPIN_ROUNDS = 64;
+    static constexpr std::chrono::microseconds HELP_SLEEP{100};
+
+    // Which pool and queue the current thread works for, so nested submits stay local
+    static inline thread_local ThreadPool *currentPool = nullptr;
+    static inline thread_local std::size_t currentIndex = 0;
+
+    void push(std::function<void()> task) {
+        std::size_t index = currentPool == this ? currentIndex : nextQueue++ % queues.size();
+        {
+            std::lock_guard<std::mutex> lock(queues[index]->mutex);
+            queues[index]->tasks.push_back(std::move(task));
+        }
+        pending++;
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        wake.notify_one();
+    }
+
+    void pushPinned(std::size_t worker, std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+            queues[worker]->pinnedTasks.push_back(std::move(task));
+        }
+        queues[worker]->pinnedPending++;
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        wake.notify_all();
+    }
+
+    // Runs a task pinned to this worker, if there is one
+    bool runPinnedTask(std::size_t worker) {
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+            if (queues[worker]->pinnedTasks.empty()) { return false; }
+            task = std::move(queues[worker]->pinnedTasks.front());
+            queues[worker]->pinnedTasks.pop_front();
+        }
+        queues[worker]->pinnedPending--;
+        task();
+        return true;
+    }
+
+    // Runs one queued task, own queue first, then steals. Returns false if every queue was empty
+    bool runPendingTask(std::size_t home) {
+        std::function<void()> task;
+        for (std::size_t offset = 0; offset < queues.size() && !task; offset++) {
+            TaskQueue &queue = *queues[(home + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) { continue; }
+            if (offset == 0) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+        }
+        if (!task) { return false; }
+        pending--;
+        task();
+        return true;
+    }
+
+    void workerLoop(std::size_t index) {
+        currentPool = this;
+        currentIndex = index;
+        TaskQueue &own = *queues[index];
+        while (true) {
+            if (runPinnedTask(index) || runPendingTask(index)) { continue; }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this, &own]() { return pending > 0 || own.pinnedPending > 0 || stopping; });
+            if (stopping && pending == 0 && own.pinnedPending == 0) { return; }
+        }
+    }
+
+public:
+    // CPUs this process may run on, in order
+    static std::vector<int> allowedCpus() {
+        std::vector<int> cpus;
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &set)) { cpus.push_back(cpu); }
+            }
+        }
+#endif
+        return cpus;
+    }
+
+    // Kernel id of the calling thread (what perf_event_open takes as pid), -1 where there is none
+    static int currentThreadId() {
+#ifdef __linux__
+        return int(syscall(SYS_gettid));
+#else
+        return -1;
+#endif
+    }
+
+    // Pins the calling thread to one CPU, returns false if the OS refused
+    static bool pinCurrentThread(int cpu) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        (void) cpu;
+        return false;
+#endif
+    }
+
+    /**
+     *  concurrency counts the calling thread, so concurrency - 1 workers are started. With pinWorkers, worker i
+     *  is bound to the (i + 1)-th allowed CPU (wrapping around), leaving the first one to the caller.
+     */
+    explicit ThreadPool(std::size_t concurrency = std::thread::hardware_concurrency(), bool pinWorkers = false) {
+        std::size_t workerCount = concurrency > 1 ? concurrency - 1 : 0;
+        for (std::size_t i = 0; i < std::max<std::size_t>(workerCount, 1); i++) {
+            queues.push_back(std::make_unique<TaskQueue>());
+        }
+
+        std::vector<int> cpus = pinWorkers ? allowedCpus() : std::vector<int>();
+        for (std::size_t i = 0; i < workerCount; i++) {
+            workerCpus.push_back(cpus.empty() ? -1 : cpus[(i + 1) % cpus.size()]);
+        }
+        std::vector<std::future<int>> threadIds;
+        for (std::size_t i = 0; i < workerCount; i++) {
+            std::promise<int> started;
+            threadIds.push_back(started.get_future());
+            workers.emplace_back([this, i, started = std::move(started)]() mutable {
+                if (workerCpus[i] >= 0) { pinCurrentThread(workerCpus[i]); }
+                started.set_value(currentThreadId());
+                workerLoop(i);
+            });
+        }
+        for (std::future<int> &threadId: threadIds) { workerThreadIds.push_back(threadId.get()); }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker: workers) { worker.join(); }
+    }
+
+    // Shared pool sized to the machine, workers pinned if MATRIX_PIN_THREADS=1
+    static ThreadPool &global() {
+        static ThreadPool pool(std::thread::hardware_concurrency(), std::getenv("MATRIX_PIN_THREADS") != nullptr &&
+                                                                    std::string(std::getenv("MATRIX_PIN_THREADS")) == "1");
+        return pool;
+    }
+
+    std::size_t getConcurrency() const { return workers.size() + 1; }
+
+    // Kernel thread ids of the workers, in worker order
+    const std::vector<int> &getWorkerThreadIds() const { return workerThreadIds; }
+
+    // CPU requested for static part `part` (part 0 is the caller), -1 if unknown or not pinned
+    int getPartCpu(std::size_t part) const { return part == 0 || part > workerCpus.size() ? -1 : workerCpus[part - 1]; }
+
+    // Queue a task, exceptions reach the caller through the future. Without workers it runs immediately
+    template<typename Function>
+    auto submit(Function &&function) -> std::future<std::invoke_result_t<std::decay_t<Function>>> {
+        using Result = std::invoke_result_t<std::decay_t<Function>>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+        std::future<Result> future = task->get_future();
+
+        if (workers.empty()) {
+            (*task)();
+        } else {
+            push([task]() { (*task)(); });
+        }
+        return future;
+    }
+
+    // Queue a task with no future: it must not throw. Unlike submit it never runs inline, see helpUntil
+    void post(std::function<void()> task) { push(std::move(task)); }
+
+    /**
+     *  Runs queued tasks on the calling thread until done() holds, so waiting threads keep the pool busy. With
+     *  nothing to run it yields for a few rounds (the wait is usually short), then sleeps until a task is queued,
+     *  rechecking done() every HELP_SLEEP, so an idle waiter does not hold a core.
+     */
+    template<typename Predicate>
+    void helpUntil(Predicate &&done) {
+        const bool isWorker = currentPool == this;
+        std::size_t home = isWorker ? currentIndex : 0;
+        int idleRounds = 0;
+        while (!done()) {
+            if ((isWorker && runPinnedTask(home)) || runPendingTask(home)) {
+                idleRounds = 0;
+                continue;
+            }
+            if (++idleRounds < HELP_SPIN_ROUNDS) {
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait_for(lock, HELP_SLEEP, [this, isWorker, home]() {
+                return pending > 0 || (isWorker && queues[home]->pinnedPending > 0);
+            });
+        }
+    }
+
+    /**
+     *  Calls body(begin, end) over [0, count) in chunks of `grain`. The caller runs the first chunk and helps
+     *  with the rest. The first exception thrown by any chunk is rethrown once every chunk has finished.
+     */
+    template<typename Body>
+    void parallelFor(std::size_t count, std::size_t grain, Body &&body) {
+        grain = std::max<std::size_t>(grain, 1);
+        const std::size_t chunks = (count + grain - 1) / grain;
+        if (chunks <= 1 || workers.empty()) {
+            if (count > 0) { body(std::size_t(0), count); }
+            return;
+        }
+
+        std::atomic<std::size_t> remaining{chunks - 1};
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        auto runChunk = [&](std::size_t chunk) {
+            try {
+                body(chunk * grain, std::min(count, (chunk + 1) * grain));
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) { error = std::current_exception(); }
+            }
+        };
+
+        for (std::size_t chunk = 1; chunk < chunks; chunk++) {
+            push([&runChunk, &remaining, chunk]() {
+                runChunk(chunk);
+                remaining--;
+            });
+        }
+        runChunk(0);
+        helpUntil([&remaining]() { return remaining == 0; });
+
+        if (error) { std::rethrow_exception(error); }
+    }
+
+    // Range [begin, end) of static part `part` out of getConcurrency() parts of [0, count)
+    std::pair<std::size_t, std::size_t> staticPart(std::size_t count, std::size_t part) const {
+        const std::size_t parts = getConcurrency();
+        return {count * part / parts, count * (part + 1) / parts};
+    }
+
+    /**
+     *  Calls body(begin, end) once per thread with the fixed partition staticPart(count, part): the same part of
+     *  the same range always runs on the same thread. Nested calls from a worker run inline.
+     */
+    template<typename Body>
+    void parallelForStatic(std::size_t count, Body &&body) {
+        if (workers.empty() || currentPool == this || count <= 1) {
+            if (count > 0) { body(std::size_t(0), count); }
+            return;
+        }
+
+        std::atomic<std::size_t> remaining{workers.size()};
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        auto runPart = [&](std::size_t part) {
+            auto [begin, end] = staticPart(count, part);
+            try {
+                if (begin < end) { body(begin, end); }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) { error = std::current_exception(); }
+            }
+        };
+
+        for (std::size_t worker = 0; worker < workers.size(); worker++) {
+            pushPinned(worker, [&runPart, &remaining, worker]() {
+                runPart(worker + 1);
+                remaining--;
+            });
+        }
+        runPart(0);
+        helpUntil([&remaining]() { return remaining == 0; });
+
+        if (error) { std::rethrow_exception(error); }
+    }
+
+    /**
+     *  Reduces map(begin, end) over [0, count) in chunks of `grain`. Chunk results are combined in chunk order,
+     *  so for a fixed grain the result does not depend on thread count or scheduling.
+     */
+    template<typename T, typename Map, typename Combine>
+    T parallelReduce(std::size_t count, std::size_t grain, T identity, Map &&map, Combine &&combine,
+                     Schedule schedule = Schedule::DYNAMIC) {
+        grain = std::max<std::size_t>(grain, 1);
+        const std::size_t chunks = (count + grain - 1) / grain;
+        std::vector<T> partials(chunks, identity);
+
+        auto reduceChunks = [&](std::size_t begin, std::size_t end) {
+            for (std::size_t chunk = begin; chunk < end; chunk++) {
+                partials[chunk] = map(chunk * grain, std::min(count, (chunk + 1) * grain));
+            }
+        };
+        if (schedule == Schedule::STATIC) {
+            parallelForStatic(chunks, reduceChunks);
+        } else {
+            parallelFor(chunks, 1, reduceChunks);
+        }
+
+        T result = identity;
+        for (const T &partial: partials) { result = combine(result, partial); }
+        return result;
+    }
+};
+
+#endif //MATRIX_MULTIPROCESSING_THREADPOOL_H
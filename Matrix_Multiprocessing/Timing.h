@@ -0,0 +1,299 @@
+#ifndef MATRIX_MULTIPROCESSING_TIMING_H
+#define MATRIX_MULTIPROCESSING_TIMING_H
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <ctime>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ *  Timing and instrumentation for matrix operations.
+ *
+ *  clock() is process CPU time: with N busy threads it advances N times faster than the wall clock, so it
+ *  cannot compare single- and multi-threaded runs. OperationTimer records three clocks per operation:
+ *      - wall time (steady_clock), what the caller waited for
+ *      - CPU time of the calling thread (CLOCK_THREAD_CPUTIME_ID)
+ *      - CPU time of the whole process (CLOCK_PROCESS_CPUTIME_ID), includes pool workers
+ *  and, when enabled and permitted, hardware cycle and cache-miss counts from perf_event_open, summed over the
+ *  calling thread and the given pool workers (everything those threads run meanwhile, not just this operation).
+ *  If the counters cannot be opened (no PMU in a VM, perf_event_paranoid, non-Linux) they are
+ *  simply reported as unavailable.
+ */
+
+struct TimingSample {
+    double wallSeconds = 0;
+    double threadCpuSeconds = 0;
+    double processCpuSeconds = 0;
+
+    bool countersValid = false;
+    std::size_t countedThreads = 0;
+    std::uint64_t cycles = 0;
+    std::uint64_t cacheMisses = 0;
+
+    // Average number of busy cores over the operation
+    double getParallelism() const { return wallSeconds > 0 ? processCpuSeconds / wallSeconds : 0; }
+
+    std::string describe() const {
+        std::ostringstream out;
+        out << "wall " << wallSeconds << " s, thread CPU " << threadCpuSeconds << " s, process CPU "
+            << processCpuSeconds << " s (" << getParallelism() << " cores)";
+        if (countersValid) {
+            out << ", " << cycles << " cycles, " << cacheMisses << " cache misses (" << countedThreads
+                << (countedThreads == 1 ? " thread)" : " threads)");
+        }
+        return out.str();
+    }
+};
+
+
+inline double cpuClockSeconds(clockid_t clock) {
+    timespec now{};
+    if (clock_gettime(clock, &now) != 0) { return double(std::clock()) / CLOCKS_PER_SEC; }
+    return double(now.tv_sec) + double(now.tv_nsec) * 1e-9;
+}
+
+inline double threadCpuSeconds() { return cpuClockSeconds(CLOCK_THREAD_CPUTIME_ID); }
+inline double processCpuSeconds() { return cpuClockSeconds(CLOCK_PROCESS_CPUTIME_ID); }
+
+
+// Cycle and cache-miss counters of a set of threads, user space only, read as one sum
+class PerfCounters {
+private:
+    struct Group {
+        int cyclesFd = -1;
+        int missesFd = -1;
+    };
+
+    std::vector<int> threadIds;
+    std::vector<Group> groups;
+
+#ifdef __linux__
+    static int openCounter(std::uint64_t config, int threadId, int groupFd) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.disabled = groupFd == -1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        return int(syscall(__NR_perf_event_open, &attr, threadId, -1, groupFd, 0));
+    }
+#endif
+
+    void closeAll() {
+#ifdef __linux__
+        for (Group &group: groups) {
+            if (group.missesFd != -1) { close(group.missesFd); }
+            if (group.cyclesFd != -1) { close(group.cyclesFd); }
+        }
+#endif
+        groups.clear();
+    }
+
+public:
+    /**
+     *  One counter group per thread id, 0 is the calling thread. Unavailable unless every group opens,
+     *  a sum that silently misses a thread would be worse than none.
+     */
+    explicit PerfCounters(std::vector<int> threads = {0}) : threadIds(std::move(threads)) {
+#ifdef __linux__
+        for (int threadId: threadIds) {
+            Group group;
+            if (threadId >= 0) { group.cyclesFd = openCounter(PERF_COUNT_HW_CPU_CYCLES, threadId, -1); }
+            if (group.cyclesFd != -1) { group.missesFd = openCounter(PERF_COUNT_HW_CACHE_MISSES, threadId, group.cyclesFd); }
+            if (group.missesFd == -1) {
+                if (group.cyclesFd != -1) { close(group.cyclesFd); }
+                closeAll();
+                return;
+            }
+            groups.push_back(group);
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    ~PerfCounters() { closeAll(); }
+
+    bool isAvailable() const { return !groups.empty(); }
+
+    const std::vector<int> &getThreadIds() const { return threadIds; }
+
+    void start() {
+#ifdef __linux__
+        for (Group &group: groups) {
+            ioctl(group.cyclesFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(group.cyclesFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    // Stops counting and fills the counter fields of sample, leaves countersValid false on failure
+    void stop(TimingSample &sample) {
+#ifdef __linux__
+        for (Group &group: groups) { ioctl(group.cyclesFd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP); }
+
+        std::uint64_t cycles = 0, cacheMisses = 0;
+        for (Group &group: groups) {
+            std::uint64_t values[3] = {};   // number of events, cycles, cache misses
+            if (read(group.cyclesFd, values, sizeof(values)) != ssize_t(sizeof(values)) || values[0] != 2) { return; }
+            cycles += values[1];
+            cacheMisses += values[2];
+        }
+        if (groups.empty()) { return; }
+        sample.cycles = cycles;
+        sample.cacheMisses = cacheMisses;
+        sample.countedThreads = groups.size();
+        sample.countersValid = true;
+#else
+        (void) sample;
+#endif
+    }
+};
+
+
+/**
+ *  Times one operation at a time: start(), run it, stop(), then read getSample().
+ *  Hardware counters are opened lazily by enableCounters() since they cost two file descriptors per thread.
+ */
+class OperationTimer {
+private:
+    std::chrono::steady_clock::time_point wallStart{};
+    double threadCpuStart = 0;
+    double processCpuStart = 0;
+    TimingSample sample;
+
+    // Only used by the thread that calls start() and stop()
+    std::unique_ptr<PerfCounters> counters;
+
+public:
+    OperationTimer() = default;
+    OperationTimer(OperationTimer &&) noexcept = default;
+    OperationTimer &operator=(OperationTimer &&) noexcept = default;
+
+    // Counts the given threads (0 is the one calling start() and stop()), returns whether the counters opened
+    bool enableCounters(const std::vector<int> &threadIds = {0}) {
+        if (!counters || counters->getThreadIds() != threadIds) { counters = std::make_unique<PerfCounters>(threadIds); }
+        return counters->isAvailable();
+    }
+
+    void start() {
+        if (counters) { counters->start(); }
+        threadCpuStart = threadCpuSeconds();
+        processCpuStart = processCpuSeconds();
+        wallStart = std::chrono::steady_clock::now();
+    }
+
+    void stop() {
+        auto wallEnd = std::chrono::steady_clock::now();
+        TimingSample finished;
+        finished.wallSeconds = std::chrono::duration<double>(wallEnd - wallStart).count();
+        finished.threadCpuSeconds = threadCpuSeconds() - threadCpuStart;
+        finished.processCpuSeconds = processCpuSeconds() - processCpuStart;
+        if (counters) { counters->stop(finished); }
+        sample = finished;
+    }
+
+    const TimingSample &getSample() const { return sample; }
+
+    // Seconds since the steady_clock epoch at the last start()
+    double getStartSeconds() const { return std::chrono::duration<double>(wallStart.time_since_epoch()).count(); }
+};
+
+
+/**
+ *  Latency distribution with bounded memory: log-linear buckets, 4 per power of two from 1 us up to about
+ *  2^40 us (12 days), so any percentile is within 25% of the true value. Count, mean and max are exact.
+ *  Not synchronized, record from one thread (merge() the histograms of several).
+ */
+class LatencyHistogram {
+private:
+    static constexpr int SUB_BUCKETS = 4;
+    static constexpr int OCTAVES = 40;
+
+    std::array<std::uint64_t, OCTAVES * SUB_BUCKETS + 1> buckets{};
+    std::uint64_t count = 0;
+    double totalSeconds = 0;
+    double maxSeconds = 0;
+
+    static std::size_t bucketOf(double microseconds) {
+        if (!(microseconds >= 1)) { return 0; }
+        int exponent = 0;
+        double mantissa = std::frexp(microseconds, &exponent);     // microseconds = mantissa * 2^exponent, mantissa in [0.5, 1)
+        const int octave = exponent - 1, sub = int((2 * mantissa - 1) * SUB_BUCKETS);
+        return std::min<std::size_t>(std::size_t(octave * SUB_BUCKETS + sub + 1), OCTAVES * SUB_BUCKETS);
+    }
+
+    // Upper bound of a bucket in seconds
+    static double bucketLimit(std::size_t bucket) {
+        if (bucket == 0) { return 1e-6; }
+        const std::size_t octave = (bucket - 1) / SUB_BUCKETS, sub = (bucket - 1) % SUB_BUCKETS;
+        return std::ldexp(1.0 + double(sub + 1) / SUB_BUCKETS, int(octave)) * 1e-6;
+    }
+
+public:
+    void record(double seconds) {
+        buckets[bucketOf(seconds * 1e6)]++;
+        count++;
+        totalSeconds += seconds;
+        maxSeconds = std::max(maxSeconds, seconds);
+    }
+
+    void merge(const LatencyHistogram &other) {
+        for (std::size_t bucket = 0; bucket < buckets.size(); bucket++) { buckets[bucket] += other.buckets[bucket]; }
+        count += other.count;
+        totalSeconds += other.totalSeconds;
+        maxSeconds = std::max(maxSeconds, other.maxSeconds);
+    }
+
+    std::uint64_t getCount() const { return count; }
+    double getTotalSeconds() const { return totalSeconds; }
+    double getMeanSeconds() const { return count == 0 ? 0 : totalSeconds / double(count); }
+    double getMaxSeconds() const { return maxSeconds; }
+
+    // Smallest bucket limit at or above the given fraction (0..1) of the samples, capped at the exact max
+    double getPercentileSeconds(double fraction) const {
+        if (count == 0) { return 0; }
+        const std::uint64_t rank = std::max<std::uint64_t>(1, std::uint64_t(std::ceil(fraction * double(count))));
+        std::uint64_t seen = 0;
+        for (std::size_t bucket = 0; bucket < buckets.size(); bucket++) {
+            seen += buckets[bucket];
+            if (seen >= rank) { return std::min(bucketLimit(bucket), maxSeconds); }
+        }
+        return maxSeconds;
+    }
+
+    // "n 12, mean 3.1 ms, p50 2.5 ms, p90 5 ms, p99 6 ms, max 6.2 ms"
+    std::string describe() const {
+        auto milliseconds = [](double seconds) {
+            std::ostringstream out;
+            out << std::setprecision(3) << seconds * 1e3 << " ms";
+            return out.str();
+        };
+        std::ostringstream out;
+        out << "n " << count << ", mean " << milliseconds(getMeanSeconds()) << ", p50 "
+            << milliseconds(getPercentileSeconds(0.5)) << ", p90 " << milliseconds(getPercentileSeconds(0.9)) << ", p99 "
+            << milliseconds(getPercentileSeconds(0.99)) << ", max " << milliseconds(maxSeconds);
+        return out.str();
+    }
+};
+
+#endif //MATRIX_MULTIPROCESSING_TIMING_H
@@ -0,0 +1,260 @@
+#ifndef MATRIX_MULTIPROCESSING_TRANSPOSE_H
+#define MATRIX_MULTIPROCESSING_TRANSPOSE_H
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "Matrix.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+/**
+ *  Blocked, parallel matrix transpose.
+ *
+ *  The matrix is cut into TRANSPOSE_TILE x TRANSPOSE_TILE tiles, small enough that a source and a destination
+ *  tile sit in L1 together, and tiles are spread over the thread pool. Inside a tile, W x W blocks (4 x 4 for
+ *  AVX2, 8 x 8 for AVX-512) are loaded as W row vectors, transposed in registers and stored as W row vectors,
+ *  so both sides are read and written a full vector at a time. The register transpose is log2(W) butterfly
+ *  stages: stage `Block` exchanges the Block x Block off-diagonal sub-blocks of every row pair (r, r + Block),
+ *  i.e. swaps that bit between the row and the lane index. Ragged edges fall back to scalar copies.
+ *
+ *  Outputs too big to stay in cache are written with non-temporal stores, which skip reading every destination
+ *  line before overwriting it; that alone takes a 4096 x 4096 transpose from a third of memcpy speed to par.
+ *
+ *  transposeInPlace swaps tile (i, j) with tile (j, i) for square matrices, using the same register blocks.
+ */
+
+static constexpr std::size_t TRANSPOSE_TILE = 32;
+
+
+// Source lane for output lane `lane` of a butterfly stage: low keeps the row's lower half, high its upper half
+constexpr int transposeLowLane(int lane, int block, int width) {
+    return (lane & block) == 0 ? lane : width + lane - block;
+}
+
+constexpr int transposeHighLane(int lane, int block, int width) {
+    return (lane & block) == 0 ? lane + block : width + lane;
+}
+
+template<int Block, int W, typename V, int... Lanes>
+MATRIX_INLINE void transposeStage(V *rows, std::integer_sequence<int, Lanes...>) {
+    MATRIX_UNROLL
+    for (int row = 0; row < W; row++) {
+        if ((row & Block) != 0) { continue; }
+        V low = __builtin_shufflevector(rows[row], rows[row + Block], transposeLowLane(Lanes, Block, W)...);
+        V high = __builtin_shufflevector(rows[row], rows[row + Block], transposeHighLane(Lanes, Block, W)...);
+        rows[row] = low;
+        rows[row + Block] = high;
+    }
+}
+
+// Transposes W row vectors in registers
+template<int W, typename V>
+MATRIX_INLINE void transposeRegisters(V *rows) {
+    if constexpr (W >= 8) { transposeStage<4, W>(rows, std::make_integer_sequence<int, W>()); }
+    if constexpr (W >= 4) { transposeStage<2, W>(rows, std::make_integer_sequence<int, W>()); }
+    if constexpr (W >= 2) { transposeStage<1, W>(rows, std::make_integer_sequence<int, W>()); }
+}
+
+// Loads the W x W block at source and leaves its transpose in rows
+template<int W, typename V>
+MATRIX_INLINE void loadTransposed(V *rows, const double *source, std::size_t stride) {
+    MATRIX_UNROLL
+    for (int row = 0; row < W; row++) { loadVector(rows[row], source + row * stride); }
+    transposeRegisters<W>(rows);
+}
+
+template<int W, bool Stream, typename V>
+MATRIX_INLINE void storeRows(double *destination, std::size_t stride, const V *rows) {
+    MATRIX_UNROLL
+    for (int row = 0; row < W; row++) {
+        if constexpr (Stream) {
+            streamVector(destination + row * stride, rows[row]);
+        } else {
+            storeVector(destination + row * stride, rows[row]);
+        }
+    }
+}
+
+
+/**
+ *  out[col][row] = in[row][col] for in rows [rowBegin, rowEnd) and cols [colBegin, colEnd). With Stream the
+ *  blocks go out as non-temporal stores of whole cache lines (two 4 x 4 blocks side by side for AVX2, a
+ *  partly written line would be flushed half empty), which needs out rows to be line aligned.
+ */
+template<int W, bool Stream>
+MATRIX_INLINE void transposeTile(ConstMatrixView in, MatrixView out, std::size_t rowBegin, std::size_t rowEnd,
+                                 std::size_t colBegin, std::size_t colEnd) {
+    typedef typename SimdVector<double, W>::type V;
+    constexpr std::size_t BLOCKS = Stream ? MATRIX_ALIGNMENT / (W * sizeof(double)) : 1;
+    const std::size_t fullRows = rowBegin + (rowEnd - rowBegin) / (W * BLOCKS) * (W * BLOCKS);
+    const std::size_t fullCols = colBegin + (colEnd - colBegin) / W * W;
+
+    for (std::size_t row = rowBegin; row < fullRows; row += W * BLOCKS) {
+        for (std::size_t col = colBegin; col < fullCols; col += W) {
+            V rows[BLOCKS][W];
+            MATRIX_UNROLL
+            for (std::size_t block = 0; block < BLOCKS; block++) {
+                loadTransposed<W>(rows[block], &in(row + block * W, col), in.getStride());
+            }
+            MATRIX_UNROLL
+            for (std::size_t block = 0; block < BLOCKS; block++) {
+                storeRows<W, Stream>(&out(col, row + block * W), out.getStride(), rows[block]);
+            }
+        }
+    }
+
+    for (std::size_t row = rowBegin; row < rowEnd; row++) {
+        for (std::size_t col = row < fullRows ? fullCols : colBegin; col < colEnd; col++) { out(col, row) = in(row, col); }
+    }
+}
+
+
+// Swaps tile (tileRow, tileCol) of a square matrix with its mirror, transposing both. tileRow <= tileCol
+template<int W>
+MATRIX_INLINE void transposeSwapTiles(MatrixView matrix, std::size_t tileRow, std::size_t tileCol) {
+    typedef typename SimdVector<double, W>::type V;
+    const std::size_t n = matrix.getRows(), stride = matrix.getStride();
+    const std::size_t rowBegin = tileRow * TRANSPOSE_TILE, rowEnd = std::min(n, rowBegin + TRANSPOSE_TILE);
+    const std::size_t colBegin = tileCol * TRANSPOSE_TILE, colEnd = std::min(n, colBegin + TRANSPOSE_TILE);
+    const std::size_t fullRows = rowBegin + (rowEnd - rowBegin) / W * W;
+    const std::size_t fullCols = colBegin + (colEnd - colBegin) / W * W;
+    const bool diagonal = tileRow == tileCol;
+
+    for (std::size_t row = rowBegin; row < fullRows; row += W) {
+        for (std::size_t col = diagonal ? row : colBegin; col < fullCols; col += W) {
+            V upper[W], lower[W];
+            loadTransposed<W>(upper, &matrix(row, col), stride);
+            if (row == col) {
+                storeRows<W, false>(&matrix(row, col), stride, upper);
+                continue;
+            }
+            loadTransposed<W>(lower, &matrix(col, row), stride);
+            storeRows<W, false>(&matrix(col, row), stride, upper);
+            storeRows<W, false>(&matrix(row, col), stride, lower);
+        }
+    }
+
+    for (std::size_t row = rowBegin; row < rowEnd; row++) {
+        for (std::size_t col = row < fullRows ? fullCols : colBegin; col < colEnd; col++) {
+            if (!diagonal || col > row) { std::swap(matrix(row, col), matrix(col, row)); }
+        }
+    }
+}
+
+
+typedef void (*TransposeTileKernel)(ConstMatrixView, MatrixView, std::size_t, std::size_t, std::size_t, std::size_t);
+typedef void (*TransposeSwapKernel)(MatrixView, std::size_t, std::size_t);
+
+inline void transposeTileScalar(ConstMatrixView in, MatrixView out, std::size_t rowBegin, std::size_t rowEnd,
+                                std::size_t colBegin, std::size_t colEnd) {
+    transposeTile<1, false>(in, out, rowBegin, rowEnd, colBegin, colEnd);
+}
+
+inline void transposeSwapScalar(MatrixView matrix, std::size_t tileRow, std::size_t tileCol) {
+    transposeSwapTiles<1>(matrix, tileRow, tileCol);
+}
+
+#ifdef MATRIX_X86_SIMD
+template<bool Stream>
+MATRIX_TARGET_AVX2 void transposeTileAvx2(ConstMatrixView in, MatrixView out, std::size_t rowBegin,
+                                          std::size_t rowEnd, std::size_t colBegin, std::size_t colEnd) {
+    transposeTile<4, Stream>(in, out, rowBegin, rowEnd, colBegin, colEnd);
+}
+
+MATRIX_TARGET_AVX2 inline void transposeSwapAvx2(MatrixView matrix, std::size_t tileRow, std::size_t tileCol) {
+    transposeSwapTiles<4>(matrix, tileRow, tileCol);
+}
+
+template<bool Stream>
+MATRIX_TARGET_AVX512 void transposeTileAvx512(ConstMatrixView in, MatrixView out, std::size_t rowBegin,
+                                              std::size_t rowEnd, std::size_t colBegin, std::size_t colEnd) {
+    transposeTile<8, Stream>(in, out, rowBegin, rowEnd, colBegin, colEnd);
+}
+
+MATRIX_TARGET_AVX512 inline void transposeSwapAvx512(MatrixView matrix, std::size_t tileRow, std::size_t tileCol) {
+    transposeSwapTiles<8>(matrix, tileRow, tileCol);
+}
+#endif
+
+
+// Outputs at least this big are written with streaming stores: they cannot stay in cache anyway
+static constexpr std::size_t TRANSPOSE_STREAM_BYTES = std::size_t(4) << 20;
+
+// Tiles per pool task, about 16K elements
+static constexpr std::size_t TRANSPOSE_TILES_PER_TASK = std::max<std::size_t>(1, 16384 / (TRANSPOSE_TILE * TRANSPOSE_TILE));
+
+
+// out = transpose(in), out must be in.getCols() x in.getRows() and must not overlap in
+inline void transpose(ConstMatrixView in, MatrixView out, ThreadPool &pool = ThreadPool::global(),
+                      SimdLevel level = activeSimdLevel()) {
+    if (out.getRows() != in.getCols() || out.getCols() != in.getRows()) {
+        throw std::invalid_argument("Transpose result must have the operand's shape swapped");
+    }
+    if (in.getData() == out.getData() && in.getRows() > 0 && in.getCols() > 0) {
+        throw std::invalid_argument("Transpose cannot write into its operand, use transposeInPlace");
+    }
+
+    TransposeTileKernel kernel = transposeTileScalar;
+#ifdef MATRIX_X86_SIMD
+    const bool stream = out.getRows() * out.getStride() * sizeof(double) >= TRANSPOSE_STREAM_BYTES &&
+                        reinterpret_cast<std::uintptr_t>(out.getData()) % MATRIX_ALIGNMENT == 0 &&
+                        out.getStride() * sizeof(double) % MATRIX_ALIGNMENT == 0;
+    if (level == SimdLevel::AVX512) { kernel = stream ? transposeTileAvx512<true> : transposeTileAvx512<false>; }
+    else if (level == SimdLevel::AVX2) { kernel = stream ? transposeTileAvx2<true> : transposeTileAvx2<false>; }
+#else
+    (void) level;
+#endif
+
+    const std::size_t tileRows = (in.getRows() + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE;
+    const std::size_t tileCols = (in.getCols() + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE;
+    pool.parallelFor(tileRows * tileCols, TRANSPOSE_TILES_PER_TASK, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t tile = begin; tile < end; tile++) {
+            const std::size_t row = tile / tileCols * TRANSPOSE_TILE, col = tile % tileCols * TRANSPOSE_TILE;
+            kernel(in, out, row, std::min(in.getRows(), row + TRANSPOSE_TILE), col,
+                   std::min(in.getCols(), col + TRANSPOSE_TILE));
+        }
+        streamFence();
+    });
+}
+
+// New matrix holding transpose(in)
+inline Matrix transposed(ConstMatrixView in, ThreadPool &pool = ThreadPool::global()) {
+    Matrix result = Matrix::uninitialized(in.getCols(), in.getRows());
+    transpose(in, result.view(), pool);
+    return result;
+}
+
+
+// matrix = transpose(matrix) without a second buffer, matrix must be square
+inline void transposeInPlace(MatrixView matrix, ThreadPool &pool = ThreadPool::global(),
+                             SimdLevel level = activeSimdLevel()) {
+    if (matrix.getRows() != matrix.getCols()) { throw std::invalid_argument("In-place transpose needs a square matrix"); }
+
+    TransposeSwapKernel kernel = transposeSwapScalar;
+#ifdef MATRIX_X86_SIMD
+    if (level == SimdLevel::AVX512) { kernel = transposeSwapAvx512; }
+    else if (level == SimdLevel::AVX2) { kernel = transposeSwapAvx2; }
+#else
+    (void) level;
+#endif
+
+    // Upper-triangle tile pairs, each swapped with its mirror by one task
+    const std::size_t tiles = (matrix.getRows() + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE;
+    std::vector<std::pair<std::size_t, std::size_t>> pairs;
+    pairs.reserve(tiles * (tiles + 1) / 2);
+    for (std::size_t tileRow = 0; tileRow < tiles; tileRow++) {
+        for (std::size_t tileCol = tileRow; tileCol < tiles; tileCol++) { pairs.emplace_back(tileRow, tileCol); }
+    }
+
+    pool.parallelFor(pairs.size(), std::max<std::size_t>(1, TRANSPOSE_TILES_PER_TASK / 2), [&](std::size_t begin, std::size_t end) {
+        for (std::size_t pair = begin; pair < end; pair++) { kernel(matrix, pairs[pair].first, pairs[pair].second); }
+    });
+}
+
+#endif //MATRIX_MULTIPROCESSING_TRANSPOSE_H
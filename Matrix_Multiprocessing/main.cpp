@@ -1,93 +1,86 @@
+// Build: g++ -std=c++20 -O2 -pthread main.cpp
+// Benchmarks: ./a.out --bench gemm|scaling|elementwise|expressions|sparse|batched|stream|transpose|strassen|solve|precision|coroutines [--full] [--threads N]
+// Matrix files: ./a.out --convert in.csv out.mat | --export in.mat out.csv | --add|--multiply a.mat b.mat out.mat
+// Job pipeline: ./a.out --pipeline manifest.txt|- [--queue N]   (manifest format in Pipeline.h)
 #include <iostream>
+#include <fstream>
 #include <iomanip>
-#include <future>
-#include <ctime>
 #include <thread>
 #include <mutex>
+#include <cstring>
+#include "Async.h"
+#include "Batched.h"
+#include "Benchmarks.h"
+#include "MatrixCalculator.h"
+#include "MatrixFile.h"
+#include "Pipeline.h"
+#include "ThreadPool.h"
+#include "Timing.h"
 using namespace std;
 
 
-class Configuration {
-public:
-    static constexpr int NUM_ROWS = 5;
-    static constexpr int NUM_COLS = 5;
-};
-
-
-class MatrixCalculator {
-private:
-    int endRow = Configuration::NUM_ROWS;
-
-    clock_t startTime = 0;
-    clock_t endTime = 0;
-
-    double leftMatrix[Configuration::NUM_ROWS][Configuration::NUM_COLS];
-    double rightMatrix[Configuration::NUM_ROWS][Configuration::NUM_COLS];
-    double resultMatrix[Configuration::NUM_ROWS][Configuration::NUM_COLS];
-
-    double matrixSum = 0;
-
-public:
-    // No destructor needed - smart pointers handle cleanup automatically
-    ~MatrixCalculator() = default;
-
-    MatrixCalculator() { initalizeMatrices(); };
+// Binary matrix file commands, the operands are memory-mapped and never parsed or copied
+int runFileCommand(const string &command, int argc, char *argv[]) {
+    if (command == "--convert" && argc == 4) {
+        uint64_t rows = convertTextToMatrix(argv[2], argv[3]);
+        cout << "Wrote " << rows << " rows to " << argv[3] << endl;
+        return 0;
+    }
+    if (command == "--export" && argc == 4) {
+        MappedMatrix matrix(argv[2]);
+        writeMatrixText(argv[3], matrix);
+        return 0;
+    }
+    if ((command == "--add" || command == "--multiply") && argc == 5) {
+        MappedMatrix left(argv[2]), right(argv[3]);
+        MatrixCalculator calculator(0, 0);
+        calculator.useMatrices(left, right);
+        if (command == "--add") {
+            calculator.matrixAdd();
+        } else {
+            calculator.matrixMultiply();
+        }
+        calculator.writeResult(argv[4]);
 
+        cout << calculator.getRows() << " x " << calculator.getCols() << " result written to " << argv[4]
+                << ", total value: " << calculator.getSum() << endl;
+        cout << "Timing: " << calculator.getTiming().describe() << endl;
+        return 0;
+    }
 
-    // Initialize the class matrices with default values
-    void initalizeMatrices() {
-        for (int row = 0; row < Configuration::NUM_ROWS; row++) {
-            for (int col = 0; col < Configuration::NUM_COLS; col++) {
-                leftMatrix[row][col] = 0;
-                rightMatrix[row][col] = 0;
-                resultMatrix[row][col] = 0;
-            }
+    if (command == "--pipeline" && (argc == 3 || (argc == 5 && strcmp(argv[3], "--queue") == 0))) {
+        MatrixPipeline pipeline(argc == 5 ? stoul(argv[4]) : 2);
+        PipelineReport report;
+        if (strcmp(argv[2], "-") == 0) {
+            report = pipeline.run(cin, cout);
+        } else {
+            ifstream manifest(argv[2]);
+            if (!manifest) { throw runtime_error(string("Cannot open manifest: ") + argv[2]); }
+            report = pipeline.run(manifest, cout);
         }
+        cout << report.describe() << endl;
+        return report.failed == 0 ? 0 : 1;
     }
 
+    cerr << "Usage: " << argv[0] << " --convert in.csv out.mat | --export in.mat out.csv"
+            << " | --add|--multiply a.mat b.mat out.mat | --pipeline manifest.txt|- [--queue N]" << endl;
+    return 1;
+}
 
-    // Set the values inside the matrices
-    void setMatrices(const double leftMatrix[Configuration::NUM_ROWS][Configuration::NUM_COLS],
-                     const double rightMatrix[Configuration::NUM_ROWS][Configuration::NUM_COLS]) {
-        for (int row = 0; row < Configuration::NUM_ROWS; row++) {
-            for (int col = 0; col < Configuration::NUM_COLS; col++) {
-                this->leftMatrix[row][col] = leftMatrix[row][col];
-                this->rightMatrix[row][col] = rightMatrix[row][col];
-            }
-        }
-    }
 
-    void matrixAdd() {
-        startTime = clock();
-        for (int row = 0; row < Configuration::NUM_ROWS; row++) {
-            for (int col = 0; col < Configuration::NUM_COLS; col++) {
-                double value = this->leftMatrix[row][col] + this->rightMatrix[row][col];
-                this->resultMatrix[row][col] = value;
-                matrixSum += value;
-            }
-        }
-        endTime = clock();
-    } // end matrixAdd
-    double getElapsedTime() const { return double(endTime - startTime) / CLOCKS_PER_SEC; }
-    double getStartTime() const { return startTime; }
-
-    double getSum() const { return matrixSum; }
-
-    void printMatrixResult() const {
-        // Resetting the output stream
-        cout.unsetf(ios::fixed);
-
-        for (int i = 0; i < Configuration::NUM_ROWS; i++) {
-            for (int j = 0; j < Configuration::NUM_COLS; j++) {
-                cout << resultMatrix[i][j] << " ";
-            }
-            cout << endl;
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0) { return runBenchmarks(argc, argv); }
+    }
+    if (argc > 1) {
+        try {
+            return runFileCommand(argv[1], argc, argv);
+        } catch (const exception &error) {
+            cerr << "Error: " << error.what() << endl;
+            return 1;
         }
     }
-};
 
-
-int main() {
     // Basic positive integers
     double leftMatrixTestOne[Configuration::NUM_ROWS][Configuration::NUM_COLS] = {
         {4, 5, 7},
@@ -150,10 +143,13 @@ int main() {
     matrixCalculatorTestThree.setMatrices(leftMatrixTestThree, rightMatrixTestThree);
     matrixCalculatorTestFour.setMatrices(leftMatrixTestFour, rightMatrixTestFour);
 
+    OperationTimer singleThreadBatch;
+    singleThreadBatch.start();
     matrixCalculatorTestOne.matrixAdd();
     matrixCalculatorTestTwo.matrixAdd();
     matrixCalculatorTestThree.matrixAdd();
     matrixCalculatorTestFour.matrixAdd();
+    singleThreadBatch.stop();
 
     // =================================================
     //              Starting Threaded Testing
@@ -168,16 +164,17 @@ int main() {
     matrixCalculatorThreadTestThree.setMatrices(leftMatrixTestThree, rightMatrixTestThree);
     matrixCalculatorThreadTestFour.setMatrices(leftMatrixTestFour, rightMatrixTestFour);
 
-    std::future<void> future1 = async(launch::async, &MatrixCalculator::matrixAdd, &matrixCalculatorThreadTestOne);
-    std::future<void> future2 = async(launch::async, &MatrixCalculator::matrixAdd, &matrixCalculatorThreadTestTwo);
-    std::future<void> future3 = async(launch::async, &MatrixCalculator::matrixAdd, &matrixCalculatorThreadTestThree);
-    std::future<void> future4 = async(launch::async, &MatrixCalculator::matrixAdd, &matrixCalculatorThreadTestFour);
-
-
-    future1.get();
-    future2.get();
-    future3.get();
-    future4.get();
+    // Independent calculators go to the shared pool instead of a fresh thread each
+    ThreadPool &pool = ThreadPool::global();
+    OperationTimer multiThreadBatch;
+    multiThreadBatch.start();
+    std::vector<Task<>> additions;
+    additions.push_back(asyncAdd(matrixCalculatorThreadTestOne));
+    additions.push_back(asyncAdd(matrixCalculatorThreadTestTwo));
+    additions.push_back(asyncAdd(matrixCalculatorThreadTestThree));
+    additions.push_back(asyncAdd(matrixCalculatorThreadTestFour));
+    syncWait(pool, whenAll(pool, std::move(additions)));
+    multiThreadBatch.stop();
 
 
     cout << "==================================================" << endl;
@@ -240,6 +237,7 @@ int main() {
 
     cout << "Single Threaded Total Time Spent processing: " << totalTime << endl;
     cout << "Total sum of matrices: " << totalSum << endl;
+    cout << "Single Threaded batch: " << singleThreadBatch.getSample().describe() << endl;
 
     cout << "==================================================" << endl;
     cout << "========== Multi - thread Test Results ===========" << endl;
@@ -300,7 +298,85 @@ int main() {
     cout << "\n\n==================================================" << endl;
     cout << "Multi - Threaded Total Time Spent processing: " << totalTime << endl;
     cout << "Total sum of matrices: " << totalSum << endl;
+    cout << "Multi - Threaded batch: " << multiThreadBatch.getSample().describe() << endl;
+    cout << "==================================================" << endl;
+
+    // =================================================
+    //          Runtime-sized (heap) Matrix Testing
+    // =================================================
+    const size_t LARGE_SIZE = 4096;
+    Matrix largeLeft(LARGE_SIZE, LARGE_SIZE), largeRight(LARGE_SIZE, LARGE_SIZE);
+    for (size_t row = 0; row < LARGE_SIZE; row++) {
+        largeLeft(row, row) = 1;
+        largeRight(row, LARGE_SIZE - 1 - row) = 2;
+    }
+
+    MatrixCalculator largeCalculator(0, 0);
+    bool countersAvailable = largeCalculator.enableHardwareCounters();
+    largeCalculator.setMatrices(std::move(largeLeft), std::move(largeRight));
+    largeCalculator.matrixAdd();
+
+    cout << "\n\n==================================================" << endl;
+    cout << "========= " << LARGE_SIZE << " x " << LARGE_SIZE << " Matrix Test Results ==========" << endl;
     cout << "==================================================" << endl;
+    cout << "The time elapsed is: "
+            << fixed
+            << setprecision(6)
+            << largeCalculator.getElapsedTime()
+            << " seconds "
+            << "Total value: "
+            << largeCalculator.getSum()
+            << endl;
+    cout << "Timing: " << largeCalculator.getTiming().describe()
+            << (countersAvailable ? "" : " (hardware counters unavailable)") << endl;
+
+    // =================================================
+    //              Matrix Multiply Testing
+    // =================================================
+    const size_t MULTIPLY_SIZE = 1024;
+    MatrixCalculator multiplyCalculator(0, 0);
+    multiplyCalculator.setMatrices(randomMatrix(MULTIPLY_SIZE, MULTIPLY_SIZE, 1),
+                                   randomMatrix(MULTIPLY_SIZE, MULTIPLY_SIZE, 2));
+    multiplyCalculator.matrixMultiply();
+
+    cout << "\n\n==================================================" << endl;
+    cout << "===== " << MULTIPLY_SIZE << " x " << MULTIPLY_SIZE << " Matrix Multiply Results (" << simdLevelName(activeSimdLevel())
+            << ") =====" << endl;
+    cout << "==================================================" << endl;
+    cout << "The time elapsed is: "
+            << fixed
+            << setprecision(6)
+            << multiplyCalculator.getElapsedTime()
+            << " seconds "
+            << "Total value: "
+            << multiplyCalculator.getSum()
+            << endl;
+    cout << "Timing: " << multiplyCalculator.getTiming().describe() << endl;
+
+    // =================================================
+    //          Batched Testing (all four at once)
+    // =================================================
+    typedef double (*TestMatrix)[Configuration::NUM_COLS];
+    const TestMatrix batchLeft[] = {leftMatrixTestOne, leftMatrixTestTwo, leftMatrixTestThree, leftMatrixTestFour};
+    const TestMatrix batchRight[] = {rightMatrixTestOne, rightMatrixTestTwo, rightMatrixTestThree, rightMatrixTestFour};
+
+    MatrixBatch leftBatch(4, Configuration::NUM_ROWS, Configuration::NUM_COLS),
+            rightBatch(4, Configuration::NUM_ROWS, Configuration::NUM_COLS),
+            resultBatch(4, Configuration::NUM_ROWS, Configuration::NUM_COLS);
+    for (size_t i = 0; i < 4; i++) {
+        leftBatch.set(i, ConstMatrixView(&batchLeft[i][0][0], Configuration::NUM_ROWS, Configuration::NUM_COLS,
+                                         Configuration::NUM_COLS));
+        rightBatch.set(i, ConstMatrixView(&batchRight[i][0][0], Configuration::NUM_ROWS, Configuration::NUM_COLS,
+                                          Configuration::NUM_COLS));
+    }
+    vector<double> batchSums = batchedAdd(leftBatch, rightBatch, resultBatch);
+
+    cout << "\n\n==================================================" << endl;
+    cout << "============= Batched Test Results ===============" << endl;
+    cout << "==================================================" << endl;
+    for (size_t i = 0; i < batchSums.size(); i++) {
+        cout << "Batch matrix " << i + 1 << " total value: " << batchSums[i] << endl;
+    }
 
     return 0;
 }
@@ -0,0 +1,89 @@
+#include "ColumnarWriter.h"
+#include <bit>
+#include <stdexcept>
+
+namespace {
+    const char MAGIC[8] = {'E', 'L', 'V', 'C', 'O', 'L', '0', '1'};
+}
+
+
+ColumnarWriter::ColumnarWriter(const std::string &filename, const std::vector<std::string> &columnNames)
+    : file(filename, std::ios::binary | std::ios::trunc), columns(columnNames.size()), totalRows(0), closed(false) {
+
+    // Check if file opened successfully
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open results file: check path or permissions '" + filename + "'");
+    }
+
+    for (auto &column: columns) { column.reserve(ROW_GROUP_SIZE); }
+    writeHeader(columnNames);
+}
+
+
+ColumnarWriter::~ColumnarWriter() {
+    // Destructors must not throw, a failed close only loses the footer
+    try { close(); } catch (...) { }
+}
+
+
+void ColumnarWriter::writeHeader(const std::vector<std::string> &columnNames) {
+    file.write(MAGIC, sizeof(MAGIC));
+    writeValue<uint32_t>(columnNames.size());
+
+    for (const auto &name: columnNames) {
+        if (name.size() > 255) { throw std::invalid_argument("Column name too long: " + name); }
+        writeValue<uint8_t>(static_cast<uint8_t>(ColumnType::INT32));
+        writeValue<uint8_t>(name.size());
+        file.write(name.data(), name.size());
+    }
+}
+
+
+void ColumnarWriter::appendRow(std::initializer_list<int32_t> values) {
+    if (values.size() != columns.size()) {
+        throw std::invalid_argument("Row has " + std::to_string(values.size()) + " values, expected " +
+                                    std::to_string(columns.size()));
+    }
+
+    auto column = columns.begin();
+    for (int32_t value: values) { (column++)->push_back(value); }
+
+    if (++totalRows % ROW_GROUP_SIZE == 0) { flushRowGroup(); }
+}
+
+
+void ColumnarWriter::flushRowGroup() {
+    uint32_t rowCount = columns.front().size();
+    if (rowCount == 0) { return; }
+
+    rowGroupOffsets.push_back(file.tellp());
+    writeValue<uint32_t>(rowCount);
+
+    // Each column is written as one contiguous block, value by value on big-endian hosts
+    for (auto &column: columns) {
+        if constexpr (std::endian::native == std::endian::little) {
+            file.write(reinterpret_cast<const char *>(column.data()), column.size() * sizeof(int32_t));
+        } else {
+            for (int32_t value: column) { writeValue(value); }
+        }
+        column.clear();
+    }
+
+    if (!file) { throw std::runtime_error("Failed writing results row group"); }
+}
+
+
+void ColumnarWriter::close() {
+    if (closed) { return; }
+    closed = true;
+
+    if (!columns.empty()) { flushRowGroup(); }
+
+    for (uint64_t offset: rowGroupOffsets) { writeValue<uint64_t>(offset); }
+    writeValue<uint64_t>(rowGroupOffsets.size());
+    writeValue<uint64_t>(totalRows);
+    file.write(MAGIC, sizeof(MAGIC));
+    file.close();
+
+    if (!file) { throw std::runtime_error("Failed writing results footer"); }
+}
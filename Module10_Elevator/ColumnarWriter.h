@@ -0,0 +1,68 @@
+#ifndef MODULE10_ELEVATOR_COLUMNARWRITER_H
+#define MODULE10_ELEVATOR_COLUMNARWRITER_H
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <initializer_list>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Streaming writer for a small self-describing columnar file format.
+ *
+ * Rows are never stored as objects: each appended value goes straight into its column's buffer and whole
+ * row groups are written column by column once ROW_GROUP_SIZE rows have been collected.
+ *
+ * File layout (all integers little-endian):
+ *   Header:     "ELVCOL01" | uint32 columnCount | per column: uint8 type, uint8 nameLength, name bytes
+ *   Row group:  uint32 rowCount | columnCount contiguous arrays of rowCount values
+ *   Footer:     uint64 row group offsets[rowGroupCount] | uint64 rowGroupCount | uint64 totalRows | "ELVCOL01"
+ *
+ * A reader seeks to the last 24 bytes to find the footer, then jumps straight to any row group.
+ */
+class ColumnarWriter {
+public:
+    enum class ColumnType : uint8_t {
+        INT32 = 1
+    };
+
+    static const int ROW_GROUP_SIZE = 1 << 16;
+
+    ColumnarWriter(const std::string &filename, const std::vector<std::string> &columnNames);
+    ~ColumnarWriter();
+
+    ColumnarWriter(const ColumnarWriter &) = delete;
+    ColumnarWriter &operator=(const ColumnarWriter &) = delete;
+
+    // One value per column, in the order the columns were declared
+    void appendRow(std::initializer_list<int32_t> values);
+
+    // Flushes the last row group and writes the footer, called by the destructor if not done explicitly
+    void close();
+
+    uint64_t getRowCount() const { return totalRows; }
+
+private:
+    std::ofstream file;
+    std::vector<std::vector<int32_t>> columns;
+    std::vector<uint64_t> rowGroupOffsets;
+    uint64_t totalRows;
+    bool closed;
+
+    void writeHeader(const std::vector<std::string> &columnNames);
+    void flushRowGroup();
+
+    // Lowest byte first, so the file is little-endian whatever the host byte order
+    template<typename T>
+    void writeValue(T value) {
+        char bytes[sizeof(T)];
+        auto bits = static_cast<std::make_unsigned_t<T>>(value);
+        for (size_t i = 0; i < sizeof(T); i++) { bytes[i] = static_cast<char>(bits >> (8 * i)); }
+        file.write(bytes, sizeof(T));
+    }
+};
+
+#endif //MODULE10_ELEVATOR_COLUMNARWRITER_H
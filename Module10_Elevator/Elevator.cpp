@@ -6,8 +6,9 @@
 
 
 Elevator::Elevator(int id, int travelTime)
-    : elevatorId(id), currentFloor(0), targetFloor(0), state(ElevatorState::STOPPED), stoppingTime(0), movingTime(0),
-      floorTravelTime(travelTime) {
+    : elevatorId(id), currentFloor(0), targetFloor(0), state(ElevatorState::STOPPED), serviceStatus(ServiceStatus::IN_SERVICE),
+      failedSince(0), stoppingTime(0), idle(false),
+      departFloor(0), departTime(0), decisionFloor(0), decisionTime(0), floorTravelTime(travelTime) {
 }
 
 
@@ -16,6 +17,9 @@ void Elevator::update(int currentTime, std::vector<std::shared_ptr<Floor> > &flo
     // Bounds checking for currentFloor
     if (currentFloor < 0 || currentFloor >= int(floors.size())) { return; }
 
+    // A failed car stays exactly where it is until it is repaired
+    if (serviceStatus == ServiceStatus::FAILED) { return; }
+
     if (state == ElevatorState::STOPPED) {
         // Drop off passengers
         std::vector<std::shared_ptr<Passenger> > delivered;
@@ -37,36 +41,44 @@ void Elevator::update(int currentTime, std::vector<std::shared_ptr<Floor> > &flo
         if (stoppingTime >= STOP_DURATION) {
             stoppingTime = 0;
             state = ElevatorState::STOPPED;
+            idle = false;
         }
         return;
     }
 
     if (state == ElevatorState::MOVING_UP || state == ElevatorState::MOVING_DOWN) {
-        movingTime++;
-        if (movingTime >= floorTravelTime) {
-            movingTime = 0;
-
-            if (state == ElevatorState::MOVING_UP) { currentFloor++; } else { currentFloor--; }
+        // Between decision floors the position follows directly from the elapsed time
+        if (currentTime < decisionTime) {
+            currentFloor = departFloor + getDirection() * ((currentTime - departTime) / getTicksPerFloor());
+            return;
+        }
+        currentFloor = decisionFloor;
 
-            // Bounds checking after moving
-            if (currentFloor < 0) {
-                currentFloor = 0;
-                state = ElevatorState::STOPPED;
-                return;
-            }
+        // Bounds checking after moving
+        if (currentFloor < 0) {
+            currentFloor = 0;
+            state = ElevatorState::STOPPED;
+            idle = false;
+            return;
+        }
 
-            // If the elevator moves to the top floor, stop the elevator, so it can go in the opposite direction (bounds checking)
-            if (currentFloor >= int(floors.size())) {
-                currentFloor = int(floors.size()) - 1;
-                state = ElevatorState::STOPPED;
-                return;
-            }
+        // If the elevator moves to the top floor, stop the elevator, so it can go in the opposite direction (bounds checking)
+        if (currentFloor >= int(floors.size())) {
+            currentFloor = int(floors.size()) - 1;
+            state = ElevatorState::STOPPED;
+            idle = false;
+            return;
+        }
 
-            // Check if the elevator should stop
-            if (hasPassengerDestinationAtFloor(currentFloor) || hasPassengersWaitingAtFloor(currentFloor, floors)) {
-                state = ElevatorState::STOPPING;
-            }
+        // Check if the elevator should stop, the hall call may have been answered by another car in the meantime.
+        // A car going into maintenance parks at the first decision floor once it is empty
+        bool parkForMaintenance = serviceStatus != ServiceStatus::IN_SERVICE && passengers.empty();
+        if (hasPassengerDestinationAtFloor(currentFloor) || hasPassengersWaitingAtFloor(currentFloor, floors) ||
+            parkForMaintenance) {
+            state = ElevatorState::STOPPING;
+            return;
         }
+        planNextDecision(currentTime, floors);
     }
 }
 
@@ -74,16 +86,18 @@ void Elevator::update(int currentTime, std::vector<std::shared_ptr<Floor> > &flo
 void Elevator::decideNextAction(int currentTime, std::vector<std::shared_ptr<Floor> > &floors) {
     // Find the next target floor with waiting passengers or passenger destinations
     targetFloor = findNextTargetFloor(floors);
+    // Riders still on board here are bound for this floor and leave this tick, so the car decides again next tick
+    idle = targetFloor == currentFloor && passengers.empty();
 
     if (targetFloor > currentFloor) {   // Destination floor is upwards
         state = ElevatorState::MOVING_UP;
-        movingTime = 0;
+        planNextDecision(currentTime, floors);
         return;
     }
 
     if (targetFloor < currentFloor) {   // Destination floor is downwards
         state = ElevatorState::MOVING_DOWN;
-        movingTime = 0;
+        planNextDecision(currentTime, floors);
         return;
     }
 
@@ -93,8 +107,113 @@ void Elevator::decideNextAction(int currentTime, std::vector<std::shared_ptr<Flo
 }
 
 
-bool Elevator::canPickupPassenger() const { return passengers.size() < MAX_CAPACITY; }
-void Elevator::pickupPassenger(std::shared_ptr<Passenger> passenger) { passengers.push_back(passenger); }
+void Elevator::planNextDecision(int currentTime, const std::vector<std::shared_ptr<Floor> > &floors) {
+    departFloor = currentFloor;
+    departTime = currentTime;
+
+    // First floor ahead where the car would stop, or one past the end of the shaft when there is none
+    int direction = getDirection();
+    decisionFloor = currentFloor + direction;
+    bool parkForMaintenance = serviceStatus != ServiceStatus::IN_SERVICE && passengers.empty();
+    while (!parkForMaintenance && decisionFloor >= 0 && decisionFloor < int(floors.size()) &&
+           !hasPassengerDestinationAtFloor(decisionFloor) && !hasPassengersWaitingAtFloor(decisionFloor, floors)) {
+        decisionFloor += direction;
+    }
+    decisionTime = departTime + std::abs(decisionFloor - departFloor) * getTicksPerFloor();
+}
+
+
+void Elevator::replanFromPosition(int currentTime, const std::vector<std::shared_ptr<Floor> > &floors) {
+    // Keep departFloor/departTime so the car stays on the same floor timing, and scan again from the first floor it
+    // has not passed yet (a floor reached on this tick still counts, as in notifyHallCall)
+    int direction = getDirection();
+    int ticksPerFloor = getTicksPerFloor();
+    int floorsAhead = std::max(1, (currentTime - departTime + ticksPerFloor - 1) / ticksPerFloor);
+
+    decisionFloor = departFloor + direction * floorsAhead;
+    while (decisionFloor >= 0 && decisionFloor < int(floors.size()) &&
+           !hasPassengerDestinationAtFloor(decisionFloor) && !hasPassengersWaitingAtFloor(decisionFloor, floors)) {
+        decisionFloor += direction;
+    }
+    decisionTime = departTime + std::abs(decisionFloor - departFloor) * ticksPerFloor;
+}
+
+
+int Elevator::getNextEventTime(int currentTime) const {
+    // A failed car is frozen, an idle one is empty (it dropped everyone off first) and only leaves for a new hall
+    // call or a change of service status, which the simulation visits anyway
+    if (serviceStatus == ServiceStatus::FAILED) { return INT_MAX; }
+    switch (state) {
+        case ElevatorState::MOVING_UP:
+        case ElevatorState::MOVING_DOWN:
+            return std::max(currentTime + 1, decisionTime);
+        case ElevatorState::STOPPED:
+            return idle ? INT_MAX : currentTime + 1;
+        case ElevatorState::STOPPING:
+            break;
+    }
+    return currentTime + 1;
+}
+
+
+void Elevator::notifyHallCall(int floor, int currentTime) {
+    if (state != ElevatorState::MOVING_UP && state != ElevatorState::MOVING_DOWN) { return; }
+    if (serviceStatus != ServiceStatus::IN_SERVICE) { return; }
+
+    // Only floors between the departure floor and the planned decision floor can shorten the skip
+    int direction = getDirection();
+    int floorsAhead = (floor - departFloor) * direction;
+    if (floorsAhead <= 0 || floorsAhead >= (decisionFloor - departFloor) * direction) { return; }
+
+    // The car still stops if it has not passed the floor yet, including passing it on this tick
+    int arrivalTime = departTime + floorsAhead * getTicksPerFloor();
+    if (arrivalTime >= currentTime) {
+        decisionFloor = floor;
+        decisionTime = arrivalTime;
+    }
+}
+
+
+void Elevator::setServiceStatus(ServiceStatus status, int currentTime, const std::vector<std::shared_ptr<Floor> > &floors) {
+    if (status == serviceStatus) { return; }
+
+    // Moving cars resume their closed-form trip shifted by the time they were frozen
+    if (serviceStatus == ServiceStatus::FAILED) {
+        int downtime = currentTime - failedSince;
+        departTime += downtime;
+        decisionTime += downtime;
+    }
+    bool moving = state == ElevatorState::MOVING_UP || state == ElevatorState::MOVING_DOWN;
+    if (status == ServiceStatus::FAILED) {
+        failedSince = currentTime;
+
+        // Frozen on the floor it had reached by the last tick, which the simulation may have skipped over
+        if (moving) { currentFloor = departFloor + getDirection() * ((currentTime - 1 - departTime) / getTicksPerFloor()); }
+    }
+
+    serviceStatus = status;
+
+    // An empty car going into maintenance parks at the next floor instead of finishing its trip
+    if (moving && status == ServiceStatus::MAINTENANCE && passengers.empty()) {
+        int nextFloorCount = (currentTime - departTime) / getTicksPerFloor() + 1;
+        if (nextFloorCount < std::abs(decisionFloor - departFloor)) {
+            decisionFloor = departFloor + getDirection() * nextFloorCount;
+            decisionTime = departTime + nextFloorCount * getTicksPerFloor();
+        }
+    }
+
+    // Out of service the car ignored hall calls, so its plan may skip floors where people started waiting meanwhile
+    if (moving && status == ServiceStatus::IN_SERVICE) { replanFromPosition(currentTime, floors); }
+}
+
+
+bool Elevator::canPickupPassenger() const {
+    return serviceStatus == ServiceStatus::IN_SERVICE && passengers.size() < MAX_CAPACITY;
+}
+void Elevator::pickupPassenger(std::shared_ptr<Passenger> passenger) {
+    passenger->setServingElevator(elevatorId);
+    passengers.push_back(passenger);
+}
 
 
 void Elevator::dropoffPassengers(int floor, std::vector<std::shared_ptr<Passenger> > &delivered) {
@@ -112,6 +231,10 @@ void Elevator::dropoffPassengers(int floor, std::vector<std::shared_ptr<Passenge
 
 
 bool Elevator::hasPassengersWaitingAtFloor(int floor, const std::vector<std::shared_ptr<Floor> > &floors) const {
+    // Cars out of service do not answer hall calls
+    if (serviceStatus != ServiceStatus::IN_SERVICE) {
+        return false;
+    }
     if (floor < 0 || floor >= int(floors.size())) {
         return false;
     }
@@ -130,6 +253,7 @@ bool Elevator::hasPassengerDestinationAtFloor(int floor) const {
 int Elevator::findNextTargetFloor(const std::vector<std::shared_ptr<Floor> > &floors) {
     // When elevators are empty look for passengers
     if (passengers.empty()) {
+        if (serviceStatus != ServiceStatus::IN_SERVICE) { return currentFloor; }
 
         // Find the closest floor with waiting passengers
         int closestFloor = currentFloor;
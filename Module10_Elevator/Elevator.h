@@ -14,6 +14,13 @@ enum class ElevatorState {
     MOVING_DOWN
 };
 
+// Cars can be taken out of service by the fault schedule
+enum class ServiceStatus {
+    IN_SERVICE,
+    MAINTENANCE,    // Delivers the riders on board, then parks and ignores hall calls
+    FAILED          // Frozen in place with its riders until repaired
+};
+
 class Elevator {
 public:
     Elevator(int id);
@@ -23,11 +30,22 @@ public:
     // Simulation step - Updated to use Floor objects
     void update(int currentTime, std::vector<std::shared_ptr<Floor>>& floors);
 
+    // A passenger started waiting at this floor, a moving car may need to stop there before its planned floor
+    void notifyHallCall(int floor, int currentTime);
+
+    // First tick after currentTime at which update() may change this car, as long as no passenger arrives and its
+    // service status stays the same. INT_MAX when only one of those can wake it
+    int getNextEventTime(int currentTime) const;
+
+    // Fault injection and maintenance, floors are needed to re-plan a moving car that returns to service
+    void setServiceStatus(ServiceStatus status, int currentTime, const std::vector<std::shared_ptr<Floor>>& floors);
+
     // Getters
     int getElevatorId() const { return elevatorId; }
     int getId() const { return elevatorId; }
     int getCurrentFloor() const { return currentFloor; }
     ElevatorState getState() const { return state; }
+    ServiceStatus getServiceStatus() const { return serviceStatus; }
     int getPassengerCount() const { return passengers.size(); }
     std::vector<std::shared_ptr<Passenger>>& getPassengers() { return passengers; }
 
@@ -41,8 +59,17 @@ private:
     int currentFloor;
     int targetFloor;
     ElevatorState state;
+    ServiceStatus serviceStatus;
+    int failedSince;
     int stoppingTime;
-    int movingTime;
+    bool idle;      // STOPPED and empty with nowhere to go, set when decideNextAction found no target
+
+    // Closed-form movement: the car left departFloor at departTime and passes one floor every floorTravelTime
+    // ticks, nothing needs deciding until it reaches decisionFloor at decisionTime
+    int departFloor;
+    int departTime;
+    int decisionFloor;
+    int decisionTime;
     std::vector<std::shared_ptr<Passenger>> passengers;
     static const int MAX_CAPACITY = 8;
     static const int STOP_DURATION = 2;
@@ -52,6 +79,10 @@ private:
     bool hasPassengersWaitingAtFloor(int floor, const std::vector<std::shared_ptr<Floor>>& floors) const;
     bool hasPassengerDestinationAtFloor(int floor) const;
     int findNextTargetFloor(const std::vector<std::shared_ptr<Floor>>& floors);
+    void planNextDecision(int currentTime, const std::vector<std::shared_ptr<Floor>>& floors);
+    void replanFromPosition(int currentTime, const std::vector<std::shared_ptr<Floor>>& floors);
+    int getDirection() const { return state == ElevatorState::MOVING_UP ? 1 : -1; }
+    int getTicksPerFloor() const { return floorTravelTime > 0 ? floorTravelTime : 1; }
 };
 
 #endif //MODULE10_ELEVATOR_ELEVATOR_H
\ No newline at end of file
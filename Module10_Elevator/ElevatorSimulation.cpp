@@ -1,9 +1,18 @@
 #include "ElevatorSimulation.h"
+#include "Tracing.h"
 #include <fstream>
-#include <sstream>
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+
+const std::vector<std::string> ElevatorSimulation::RESULT_COLUMNS = {
+    "passenger_id", "start_floor", "end_floor", "start_time", "pickup_time", "delivery_time", "elevator_id"
+};
 
 
 ElevatorSimulation::ElevatorSimulation(int travelTime) : currentTime(0), nextPassengerIndex(0), floorTravelTime(travelTime) {
@@ -20,6 +29,7 @@ ElevatorSimulation::ElevatorSimulation(int travelTime) : currentTime(0), nextPas
 
 
 void ElevatorSimulation::loadPassengersFromCSV(const std::string& filename) {
+    TRACE_ZONE("loadPassengersFromCSV");
     std::ifstream file(filename);
 
     // Check if file opened successfully
@@ -31,6 +41,7 @@ void ElevatorSimulation::loadPassengersFromCSV(const std::string& filename) {
 
     std::string line;
     int passengerId = 0;
+    std::vector<PassengerRecord> trace;
 
     // Skip header
     std::getline(file, line);
@@ -39,20 +50,97 @@ void ElevatorSimulation::loadPassengersFromCSV(const std::string& filename) {
         if (line.empty()) continue;
 
         try {
-            // Use getline with comma delimiter to properly parse CSV
-            std::stringstream ss(line);
-            std::string startTimeStr, startFloorStr, endFloorStr;
+            trace.push_back(PassengerStreamReader::parseLine(line, passengerId));
+            passengerId++;
+
+        } catch (const std::exception& e) {
+            std::cerr << "Error parsing line: " << line << " (" << e.what() << ")";
+
+        }
+    }
+
+    // Sort passengers by start time AFTER loading
+    std::sort(trace.begin(), trace.end(),
+        [](const auto& a, const auto& b) { return a.startTime < b.startTime; });
+    passengerTrace = std::make_shared<const std::vector<PassengerRecord>>(std::move(trace));
+
+    BOOST_LOG_TRIVIAL(info) << "Loaded " << passengerTrace->size() << " passengers from CSV";
+    file.close();
+}
+
+
+void ElevatorSimulation::openPassengerStream(const std::string& filename) {
+    passengerStream = std::make_unique<PassengerStreamReader>(filename);
+
+    // The trace length is unknown up front, the run ends once the stream is drained and everyone is delivered,
+    // or once nothing has happened for STALL_TIMEOUT after that (a rider no car can deliver)
+    simulationEndTime = std::numeric_limits<int>::max();
+    BOOST_LOG_TRIVIAL(info) << "Streaming passengers from " << filename;
+}
+
+
+void ElevatorSimulation::streamResultsTo(const std::string& filename) {
+    resultsStream = std::make_unique<ColumnarWriter>(filename, RESULT_COLUMNS);
+}
+
+
+void ElevatorSimulation::loadFaultSchedule(const std::string& filename, unsigned int seed) {
+    std::ifstream file(filename);
+
+    // Check if file opened successfully
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open fault schedule: check path or permissions '" + filename + "'");
+    }
+
+    std::mt19937 generator(seed);
+    std::string line;
+
+    // Skip header
+    std::getline(file, line);
 
-            std::getline(ss, startTimeStr, ',');
-            std::getline(ss, startFloorStr, ',');
-            std::getline(ss, endFloorStr, ',');
+    while (std::getline(file, line)) {
+        if (line.empty()) continue;
+
+        try {
+            std::stringstream ss(line);
+            std::string elevatorStr, type, timeStr, durationStr;
+
+            std::getline(ss, elevatorStr, ',');
+            std::getline(ss, type, ',');
+            std::getline(ss, timeStr, ',');
+            std::getline(ss, durationStr, ',');
+
+            int elevatorId = std::stoi(elevatorStr);
+            int time = std::stoi(timeStr);
+            int duration = std::stoi(durationStr);
+
+            if (type == "MAINTENANCE") {
+                addServiceWindow(elevatorId, ServiceStatus::MAINTENANCE, time, duration);
+            } else if (type == "FAILURE") {
+                addServiceWindow(elevatorId, ServiceStatus::FAILED, time, duration);
+            } else if (type == "RANDOM") {
+                // Exponential time between failures and repair times, drawn over the default simulation length
+                if (time <= 0) {
+                    throw std::invalid_argument("Invalid mean time between failures " + std::to_string(time));
+                }
+                if (duration <= 0) {
+                    throw std::invalid_argument("Invalid mean repair time " + std::to_string(duration));
+                }
+                std::exponential_distribution<double> timeToFailure(1.0 / time);
+                std::exponential_distribution<double> timeToRepair(1.0 / duration);
 
-            int startTime = std::stoi(startTimeStr);
-            int startFloor = std::stoi(startFloorStr);
-            int endFloor = std::stoi(endFloorStr);
+                int failureTime = 0;
+                while (true) {
+                    failureTime += std::max(1, int(std::lround(timeToFailure(generator))));
+                    if (failureTime >= SIMULATION_END_TIME) break;
 
-            auto passenger = std::make_shared<Passenger>(passengerId++, startFloor - 1, endFloor - 1, startTime);
-            allPassengers.push_back(passenger);
+                    int repairTime = std::max(1, int(std::lround(timeToRepair(generator))));
+                    addServiceWindow(elevatorId, ServiceStatus::FAILED, failureTime, repairTime);
+                    failureTime += repairTime;
+                }
+            } else {
+                throw std::invalid_argument("unknown type '" + type + "'");
+            }
 
         } catch (const std::exception& e) {
             std::cerr << "Error parsing line: " << line << " (" << e.what() << ")";
@@ -60,43 +148,147 @@ void ElevatorSimulation::loadPassengersFromCSV(const std::string& filename) {
         }
     }
 
-    // Sort passengers by start time AFTER loading
-    std::sort(allPassengers.begin(), allPassengers.end(),
-        [](const auto& a, const auto& b) { return a->getStartTime() < b->getStartTime(); });
+    BOOST_LOG_TRIVIAL(info) << "Loaded " << serviceEvents.size() << " service events from " << filename;
+}
 
-    BOOST_LOG_TRIVIAL(info) << "Loaded " << allPassengers.size() << " passengers from CSV";
-    file.close();
+
+void ElevatorSimulation::addServiceWindow(int elevatorId, ServiceStatus status, int startTime, int duration) {
+    if (elevatorId < 0 || elevatorId >= TOTAL_ELEVATORS) {
+        throw std::invalid_argument("Invalid elevator " + std::to_string(elevatorId));
+    }
+    if (duration <= 0) {
+        throw std::invalid_argument("Invalid service window duration " + std::to_string(duration));
+    }
+
+    if (status == ServiceStatus::IN_SERVICE) {
+        throw std::invalid_argument("A service window must be MAINTENANCE or FAILED");
+    }
+
+    addServiceEvent(startTime, elevatorId, status, true);
+    addServiceEvent(startTime + duration, elevatorId, status, false);
+}
+
+
+void ElevatorSimulation::addServiceEvent(int time, int elevatorId, ServiceStatus status, bool opens) {
+    // Keep pending events sorted by time, events at the same time apply in the order they were added
+    auto pending = serviceEvents.begin() + nextServiceEventIndex;
+    auto position = std::upper_bound(pending, serviceEvents.end(), time,
+        [](int t, const ServiceEvent& event) { return t < event.time; });
+    serviceEvents.insert(position, ServiceEvent{time, elevatorId, status, opens});
+}
+
+
+void ElevatorSimulation::applyServiceEvents() {
+    bool applied = false;
+    while (nextServiceEventIndex < serviceEvents.size() && serviceEvents[nextServiceEventIndex].time <= currentTime) {
+        const ServiceEvent& event = serviceEvents[nextServiceEventIndex];
+        nextServiceEventIndex++;
+
+        OpenWindows& open = openServiceWindows[event.elevatorId];
+        int& count = event.status == ServiceStatus::FAILED ? open.failed : open.maintenance;
+        count += event.opens ? 1 : -1;
+        applied = true;
+    }
+    if (!applied) { return; }
+
+    // Only a change of the resulting status reaches the car, so a window nested in another of the same or a more
+    // severe kind leaves it alone
+    for (size_t i = 0; i < elevators.size(); i++) {
+        const OpenWindows& open = openServiceWindows[i];
+        ServiceStatus status = open.failed > 0 ? ServiceStatus::FAILED
+                             : open.maintenance > 0 ? ServiceStatus::MAINTENANCE
+                             : ServiceStatus::IN_SERVICE;
+        if (status != elevators[i]->getServiceStatus()) { elevators[i]->setServiceStatus(status, currentTime, floors); }
+    }
+}
+
+
+void ElevatorSimulation::admitPassenger(const std::shared_ptr<Passenger>& passenger) {
+    int startFloor = passenger->getStartFloor();
+    int endFloor = passenger->getEndFloor();
+
+    // Validate floor numbers (bounds checking)
+    if (startFloor < 0 || startFloor >= BUILDING_FLOORS) {
+        BOOST_LOG_TRIVIAL(error) << "Invalid start floor" << startFloor << " for passenger " << passenger->getPassengerId();
+        return;
+    }
+    if (endFloor < 0 || endFloor >= BUILDING_FLOORS) {
+        BOOST_LOG_TRIVIAL(error) << "Invalid end floor " << endFloor << " for passenger " << passenger->getPassengerId();
+        return;
+    }
+
+    // Add passenger to the floor using Floor class
+    floors[startFloor]->addPassenger(passenger);
+    admittedCount++;
+    lastProgressTime = currentTime;
+
+    // Moving cars may have planned to skip past this floor
+    for (const auto& elevator : elevators) { elevator->notifyHallCall(startFloor, currentTime); }
+}
+
+
+void ElevatorSimulation::recordDelivery(const std::shared_ptr<Passenger>& passenger) {
+    deliveredCount++;
+    lastProgressTime = currentTime;
+    totalWaitTime += passenger->getWaitTime();
+    totalTravelTime += passenger->getTravelTime();
+    peakWaitTime = std::max(peakWaitTime, passenger->getWaitTime());
+
+    if (resultsStream) { appendResultRow(*resultsStream, *passenger); }
+
+    // Streamed passengers are dropped here, their metrics are already folded in
+    if (!isStreaming()) { deliveredPassengers.push_back(passenger); }
+}
+
+
+bool ElevatorSimulation::hasPassengersRemaining() {
+    if (isStreaming()) {
+        if (!passengerStream->exhausted()) { return true; }
+        if (deliveredCount < admittedCount && currentTime - lastProgressTime > STALL_TIMEOUT && !stalled) {
+            BOOST_LOG_TRIVIAL(warning) << "No passenger delivered for " << STALL_TIMEOUT << " seconds, stopping with "
+                                       << admittedCount - deliveredCount << " undelivered";
+            stalled = true;
+        }
+        return deliveredCount < admittedCount && !stalled;
+    }
+    return passengerTrace != nullptr && deliveredCount < (long long)passengerTrace->size();
+}
+
+
+long long ElevatorSimulation::getTotalPassengers() const {
+    if (isStreaming()) { return admittedCount; }
+    return passengerTrace != nullptr ? (long long)passengerTrace->size() : 0;
 }
 
 
 void ElevatorSimulation::updateSimulation() {
+    TRACE_ZONE("updateSimulation");
+
+    // Take cars in and out of service
+    applyServiceEvents();
+
     // Add passengers to floors when they arrive
-    while (nextPassengerIndex < allPassengers.size() &&
-           allPassengers[nextPassengerIndex]->getStartTime() == currentTime) {
-        auto passenger = allPassengers[nextPassengerIndex];
-        int startFloor = passenger->getStartFloor();
-        int endFloor = passenger->getEndFloor();
-
-        // Validate floor numbers (bounds checking)
-        if (startFloor < 0 || startFloor >= BUILDING_FLOORS) {
-            BOOST_LOG_TRIVIAL(error) << "Invalid start floor" << startFloor << " for passenger " << passenger->getPassengerId();
-            nextPassengerIndex++;
-            continue;
-        }
-        if (endFloor < 0 || endFloor >= BUILDING_FLOORS) {
-            BOOST_LOG_TRIVIAL(error) << "Invalid end floor " << endFloor << " for passenger " << passenger->getPassengerId();
-            nextPassengerIndex++;
-            continue;
+    if (isStreaming()) {
+        const PassengerRecord* record;
+        while ((record = passengerStream->peek()) != nullptr && record->startTime <= currentTime) {
+            admitPassenger(std::make_shared<Passenger>(record->passengerId, record->startFloor, record->endFloor,
+                                                       record->startTime));
+            passengerStream->pop();
         }
-
-        // Add passenger to the floor using Floor class
-        floors[startFloor]->addPassenger(passenger);
+    }
+    while (passengerTrace != nullptr && nextPassengerIndex < passengerTrace->size() &&
+           (*passengerTrace)[nextPassengerIndex].startTime == currentTime) {
+        const PassengerRecord& record = (*passengerTrace)[nextPassengerIndex];
+        admitPassenger(std::make_shared<Passenger>(record.passengerId, record.startFloor, record.endFloor, record.startTime));
         nextPassengerIndex++;
     }
 
     // Update all elevators
     for (const auto& elevator : elevators) {
-        elevator->update(currentTime, floors);
+        {
+            TRACE_ZONE("Elevator::update", elevator->getId());
+            elevator->update(currentTime, floors);
+        }
 
         // Check for delivered passengers
         auto& passengers = elevator->getPassengers();
@@ -107,7 +299,7 @@ void ElevatorSimulation::updateSimulation() {
                 if (!(*it)->isPickedUp()) { (*it)->setPickedUp(currentTime); }
 
                 (*it)->setDelivered(currentTime);
-                deliveredPassengers.push_back(*it);
+                recordDelivery(*it);
                 it = passengers.erase(it);
 
             } else { it++; }
@@ -129,7 +321,7 @@ void ElevatorSimulation::run() {
     int passengersBoarded = 0;
     int passengersDisembarked = 0;
 
-    while (currentTime < SIMULATION_END_TIME && deliveredPassengers.size() < allPassengers.size()) {
+    while (currentTime < simulationEndTime && hasPassengersRemaining()) {
         // Count passengers boarding this tick
         int boardedThisTick = 0;
         int disembarkedThisTick = 0;
@@ -151,16 +343,17 @@ void ElevatorSimulation::run() {
         }
 
         // Count passengers that disembarked this tick
-        disembarkedThisTick = deliveredPassengers.size() - passengersDisembarked;
+        disembarkedThisTick = deliveredCount - passengersDisembarked;
 
         passengersBoarded += boardedThisTick;
         passengersDisembarked += disembarkedThisTick;
 
         // Show a detailed status every n seconds
-        if (currentTime % 1 == 0) {
+        if (currentTime % statusInterval == 0) {
+            TRACE_ZONE("statusLogging");
             BOOST_LOG_TRIVIAL(info);
             BOOST_LOG_TRIVIAL(info) << "--- Time: " << currentTime << "s ---";
-            BOOST_LOG_TRIVIAL(info) << "Delivered: " << deliveredPassengers.size() << "/" << allPassengers.size();
+            BOOST_LOG_TRIVIAL(info) << "Delivered: " << deliveredCount << "/" << getTotalPassengers();
             BOOST_LOG_TRIVIAL(info) << "Total Boarded: " << passengersBoarded << " | Total Disembarked: " << passengersDisembarked;
 
             // Show each elevator status
@@ -191,6 +384,10 @@ void ElevatorSimulation::run() {
                               "| Passengers " +
                               std::to_string(elevator->getPassengerCount()) +
                               "/8";
+
+                // Cars out of service are flagged after their usual status
+                if (elevator->getServiceStatus() == ServiceStatus::MAINTENANCE) { elevatorResults += " | MAINTENANCE"; }
+                if (elevator->getServiceStatus() == ServiceStatus::FAILED) { elevatorResults += " | FAILED"; }
                 BOOST_LOG_TRIVIAL(info) << elevatorResults;
             }
         }
@@ -207,37 +404,98 @@ void ElevatorSimulation::run() {
         updateSimulation();
     }
     BOOST_LOG_TRIVIAL(info) << "Simulation completed at time: " << currentTime << "\n";
-    BOOST_LOG_TRIVIAL(info) << "Total passengers delivered: " << deliveredPassengers.size();
+    BOOST_LOG_TRIVIAL(info) << "Total passengers delivered: " << deliveredCount;
+
+    if (resultsStream) { resultsStream->close(); }
 }
 
 
-double ElevatorSimulation::getAverageWaitTime() const {
-    if (deliveredPassengers.empty()) return 0.0;
+int ElevatorSimulation::nextEventTime() {
+    // The ticks in between would only move cars along their planned trips, which update() derives from the time
+    int next = std::numeric_limits<int>::max();
+    for (const auto& elevator : elevators) { next = std::min(next, elevator->getNextEventTime(currentTime)); }
 
-    double totalWaitTime = 0.0;
-    for (const auto& passenger : deliveredPassengers) {
-        totalWaitTime += passenger->getWaitTime();
+    if (isStreaming()) {
+        if (const PassengerRecord* record = passengerStream->peek()) { next = std::min(next, record->startTime); }
+    }
+    if (passengerTrace != nullptr && nextPassengerIndex < passengerTrace->size()) {
+        next = std::min(next, (*passengerTrace)[nextPassengerIndex].startTime);
     }
-    return totalWaitTime / deliveredPassengers.size();
+    if (nextServiceEventIndex < serviceEvents.size()) { next = std::min(next, serviceEvents[nextServiceEventIndex].time); }
+    return std::max(next, currentTime + 1);
 }
 
 
-double ElevatorSimulation::getAverageTravelTime() const {
-    if (deliveredPassengers.empty()) return 0.0;
+void ElevatorSimulation::advanceTo(int time) {
+    time = std::min(time, simulationEndTime);
+    while (currentTime < time) {
+        currentTime = std::min(nextEventTime(), time);
+        updateSimulation();
+    }
+}
+
+
+void ElevatorSimulation::runToCompletion() {
+    while (currentTime < simulationEndTime && hasPassengersRemaining()) {
+        currentTime = std::min(nextEventTime(), simulationEndTime);
+        updateSimulation();
+    }
+}
+
 
-    double totalTravelTime = 0.0;
-    for (const auto& passenger : deliveredPassengers) {
-        totalTravelTime += passenger->getTravelTime();
+std::unique_ptr<ElevatorSimulation> ElevatorSimulation::fork() const {
+    if (isStreaming()) { throw std::logic_error("A streaming simulation cannot be forked"); }
+
+    auto copy = std::make_unique<ElevatorSimulation>(floorTravelTime);
+    copy->passengerTrace = passengerTrace;
+    copy->currentTime = currentTime;
+    copy->nextPassengerIndex = nextPassengerIndex;
+    copy->simulationEndTime = simulationEndTime;
+    copy->statusInterval = statusInterval;
+    copy->admittedCount = admittedCount;
+    copy->deliveredCount = deliveredCount;
+    copy->totalWaitTime = totalWaitTime;
+    copy->totalTravelTime = totalTravelTime;
+    copy->peakWaitTime = peakWaitTime;
+    copy->serviceEvents = serviceEvents;
+    copy->nextServiceEventIndex = nextServiceEventIndex;
+    copy->openServiceWindows = openServiceWindows;
+
+    // Every rider in the building is either on one car or in one floor queue, so each is copied exactly once
+    for (size_t i = 0; i < elevators.size(); i++) {
+        copy->elevators[i] = std::make_shared<Elevator>(*elevators[i]);
+        for (auto& rider : copy->elevators[i]->getPassengers()) { rider = std::make_shared<Passenger>(*rider); }
     }
-    return totalTravelTime / deliveredPassengers.size();
+    for (size_t i = 0; i < floors.size(); i++) {
+        auto floor = std::make_shared<Floor>(*floors[i]);
+
+        // Rotate the queue once, replacing each waiting passenger with its copy
+        for (int waiting = floor->getWaitingPassengerCount(); waiting > 0; waiting--) {
+            floor->addPassenger(std::make_shared<Passenger>(*floor->getNextPassenger()));
+        }
+        copy->floors[i] = floor;
+    }
+    return copy;
+}
+
+
+double ElevatorSimulation::getAverageWaitTime() const {
+    if (deliveredCount == 0) return 0.0;
+    return double(totalWaitTime) / deliveredCount;
+}
+
+
+double ElevatorSimulation::getAverageTravelTime() const {
+    if (deliveredCount == 0) return 0.0;
+    return double(totalTravelTime) / deliveredCount;
 }
 
 
 void ElevatorSimulation::printResults(const std::string &simulationName) {
     BOOST_LOG_TRIVIAL(info);
     BOOST_LOG_TRIVIAL(info) << simulationName;
-    BOOST_LOG_TRIVIAL(info) << "Total Passengers: " << allPassengers.size();
-    BOOST_LOG_TRIVIAL(info) << "Delivered Passengers: " << deliveredPassengers.size();
+    BOOST_LOG_TRIVIAL(info) << "Total Passengers: " << getTotalPassengers();
+    BOOST_LOG_TRIVIAL(info) << "Delivered Passengers: " << deliveredCount;
     BOOST_LOG_TRIVIAL(info) << "Simulation Time: " << currentTime << " seconds";
 
     BOOST_LOG_TRIVIAL(info) << "Average Wait Time: " << getAverageWaitTime() << " seconds";
@@ -245,3 +503,27 @@ void ElevatorSimulation::printResults(const std::string &simulationName) {
     BOOST_LOG_TRIVIAL(info) << "Total Average Time (Wait + Travel): " << (getAverageWaitTime() + getAverageTravelTime()) << " seconds\n";
     BOOST_LOG_TRIVIAL(info);
 }
+
+
+void ElevatorSimulation::exportResults(const std::string &filename) const {
+    ColumnarWriter writer(filename, RESULT_COLUMNS);
+
+    for (const auto &passenger: deliveredPassengers) { appendResultRow(writer, *passenger); }
+    writer.close();
+
+    BOOST_LOG_TRIVIAL(info) << "Exported " << writer.getRowCount() << " passenger results to " << filename;
+}
+
+
+void ElevatorSimulation::appendResultRow(ColumnarWriter &writer, const Passenger &passenger) {
+    // Floors are written 1-based to match the input CSV
+    writer.appendRow({
+        passenger.getPassengerId(),
+        passenger.getStartFloor() + 1,
+        passenger.getEndFloor() + 1,
+        passenger.getStartTime(),
+        passenger.getPickupTime(),
+        passenger.getDeliveryTime(),
+        passenger.getServingElevator()
+    });
+}
@@ -10,6 +10,8 @@
 #include "Floor.h"
 #include "Passenger.h"
 #include "Logger.h"
+#include "ColumnarWriter.h"
+#include "PassengerStreamReader.h"
 
 
 class ElevatorSimulation {
@@ -17,14 +19,56 @@ private:
     static const int BUILDING_FLOORS = 100;
     static const int TOTAL_ELEVATORS = 4;
     static const int SIMULATION_END_TIME = 500000;
+    static const int STALL_TIMEOUT = 86400;     // streaming: give up after a simulated day without an arrival or delivery
+    static const std::vector<std::string> RESULT_COLUMNS;
 
     std::vector<std::shared_ptr<Elevator>> elevators;
     std::vector<std::shared_ptr<Floor>> floors;  // Changed from queue to Floor objects
-    std::vector<std::shared_ptr<Passenger>> allPassengers;
+    std::shared_ptr<const std::vector<PassengerRecord>> passengerTrace;  // Immutable, shared by forked simulations
     std::vector<std::shared_ptr<Passenger>> deliveredPassengers;
     int currentTime;
     int nextPassengerIndex;
     int floorTravelTime;
+    int simulationEndTime = SIMULATION_END_TIME;
+    int statusInterval = 1;
+
+    // Streaming mode: arrivals are pulled from the reader and delivered passengers are folded into the
+    // metrics below and then discarded, so memory only grows with the riders currently in the building
+    std::unique_ptr<PassengerStreamReader> passengerStream;
+    std::unique_ptr<ColumnarWriter> resultsStream;
+    long long admittedCount = 0;
+    long long deliveredCount = 0;
+    long long totalWaitTime = 0;
+    long long totalTravelTime = 0;
+    int peakWaitTime = 0;
+    int lastProgressTime = 0;
+    bool stalled = false;
+
+    // Fault schedule, applied in time order at the start of each tick: each window opens and later closes
+    struct ServiceEvent {
+        int time;
+        int elevatorId;
+        ServiceStatus status;   // MAINTENANCE or FAILED, the kind of window
+        bool opens;
+    };
+    std::vector<ServiceEvent> serviceEvents;
+    size_t nextServiceEventIndex = 0;
+
+    // Windows of each kind started and not yet ended, per car. Windows may overlap, the car takes the status of
+    // the most severe open one: FAILED over MAINTENANCE over IN_SERVICE
+    struct OpenWindows {
+        int maintenance = 0;
+        int failed = 0;
+    };
+    std::vector<OpenWindows> openServiceWindows = std::vector<OpenWindows>(TOTAL_ELEVATORS);
+
+    void addServiceEvent(int time, int elevatorId, ServiceStatus status, bool opens);
+    void applyServiceEvents();
+    void admitPassenger(const std::shared_ptr<Passenger>& passenger);
+    void recordDelivery(const std::shared_ptr<Passenger>& passenger);
+    bool hasPassengersRemaining();
+    int nextEventTime();
+    static void appendResultRow(ColumnarWriter &writer, const Passenger &passenger);
 
 public:
     ElevatorSimulation() = default;
@@ -35,16 +79,41 @@ public:
     // Loading data
     void loadPassengersFromCSV(const std::string& filename);
 
+    // Streaming mode for traces larger than memory, the file must be sorted by start time
+    void openPassengerStream(const std::string& filename);
+    void streamResultsTo(const std::string& filename);
+    bool isStreaming() const { return passengerStream != nullptr; }
+
+    // Fault injection: "Elevator,Type,Time(s),Duration(s)" rows of MAINTENANCE, FAILURE or RANDOM, where RANDOM
+    // rows give the mean time between failures and the mean repair time of that car
+    void loadFaultSchedule(const std::string& filename, unsigned int seed);
+    void addServiceWindow(int elevatorId, ServiceStatus status, int startTime, int duration);
+
     // Simulation
     void run();
     void updateSimulation();
+    void setStatusInterval(int seconds) { statusInterval = seconds; }
+
+    // Quiet stepping for what-if evaluation: no per-tick logging, so they jump from one event to the next
+    void advanceTo(int time);
+    void runToCompletion();
+
+    // Independent copy of the current state: the passenger trace is shared, only the riders in the building are
+    // copied and delivered passengers are carried over as metrics, so forking a warm simulation is cheap
+    std::unique_ptr<ElevatorSimulation> fork() const;
 
     // Results
     void printResults(const std::string &);
     double getAverageWaitTime() const;
     double getAverageTravelTime() const;
+    long long getTotalPassengers() const;
+    long long getDeliveredCount() const { return deliveredCount; }
+    int getPeakWaitTime() const { return peakWaitTime; }
     int getSimulationTime() const { return currentTime; }
 
+    // Writes one row per delivered passenger to a columnar results file (see ColumnarWriter.h)
+    void exportResults(const std::string &filename) const;
+
 };
 
 #endif //MODULE10_ELEVATOR_ELEVATORSIMULATION_H
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "MaintenancePlanner.h"
+#include <algorithm>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+
+MaintenancePlanner::MaintenancePlanner(const ElevatorSimulation &baseline, int elevatorId, int windowDuration)
+    : baseline(baseline), elevatorId(elevatorId), windowDuration(windowDuration) {
+}
+
+
+MaintenanceCandidate MaintenancePlanner::score(ElevatorSimulation &candidate, int startTime) const {
+    candidate.addServiceWindow(elevatorId, ServiceStatus::MAINTENANCE, startTime, windowDuration);
+    candidate.runToCompletion();
+    return {startTime, candidate.getPeakWaitTime(), candidate.getAverageWaitTime()};
+}
+
+
+std::vector<MaintenanceCandidate> MaintenancePlanner::evaluate(int earliestStart, int latestStart, int step) const {
+    if (step <= 0 || latestStart < earliestStart) {
+        throw std::invalid_argument("Invalid maintenance search range");
+    }
+
+    std::vector<MaintenanceCandidate> results;
+    std::unique_ptr<ElevatorSimulation> warm = baseline.fork();
+
+    // Forks are scored in waves so only a bounded number of copies exist at once
+    const size_t waveSize = std::max(1u, std::thread::hardware_concurrency()) * 4;
+    std::vector<std::future<MaintenanceCandidate>> wave;
+
+    for (int startTime = earliestStart; startTime <= latestStart; startTime += step) {
+        // The window opens at the start of its tick, so fork from the state right before it
+        warm->advanceTo(startTime - 1);
+        std::shared_ptr<ElevatorSimulation> candidate = warm->fork();
+
+        wave.push_back(std::async(std::launch::async, [this, candidate, startTime]() {
+            return score(*candidate, startTime);
+        }));
+
+        if (wave.size() == waveSize) {
+            for (auto &future: wave) { results.push_back(future.get()); }
+            wave.clear();
+        }
+    }
+    for (auto &future: wave) { results.push_back(future.get()); }
+
+    return results;
+}
+
+
+MaintenanceCandidate MaintenancePlanner::findBest(const std::vector<MaintenanceCandidate> &candidates) {
+    if (candidates.empty()) { throw std::invalid_argument("No maintenance candidates to choose from"); }
+
+    return *std::min_element(candidates.begin(), candidates.end(),
+        [](const MaintenanceCandidate &a, const MaintenanceCandidate &b) {
+            if (a.peakWaitTime != b.peakWaitTime) { return a.peakWaitTime < b.peakWaitTime; }
+            if (a.averageWaitTime != b.averageWaitTime) { return a.averageWaitTime < b.averageWaitTime; }
+            return a.startTime < b.startTime;
+        });
+}
@@ -0,0 +1,42 @@
+#ifndef MODULE10_ELEVATOR_MAINTENANCEPLANNER_H
+#define MODULE10_ELEVATOR_MAINTENANCEPLANNER_H
+
+#pragma once
+
+#include <vector>
+#include "ElevatorSimulation.h"
+
+struct MaintenanceCandidate {
+    int startTime;
+    int peakWaitTime;
+    double averageWaitTime;
+};
+
+/**
+ * Searches for the maintenance window start that minimises the peak passenger wait.
+ *
+ * Candidates are visited in start time order while one warm simulation walks forward through the day. Each
+ * candidate forks the warm state just before its window opens and only simulates from there to the end, instead
+ * of replaying the day from t=0, and the forks are scored in parallel.
+ */
+class MaintenancePlanner {
+public:
+    // baseline is a loaded simulation that has not been run yet, it is forked and never modified
+    MaintenancePlanner(const ElevatorSimulation &baseline, int elevatorId, int windowDuration);
+    ~MaintenancePlanner() = default;
+
+    // Scores every start time in [earliestStart, latestStart] spaced step seconds apart
+    std::vector<MaintenanceCandidate> evaluate(int earliestStart, int latestStart, int step) const;
+
+    // Lowest peak wait, ties broken by average wait and then by the earlier start
+    static MaintenanceCandidate findBest(const std::vector<MaintenanceCandidate> &candidates);
+
+private:
+    const ElevatorSimulation &baseline;
+    int elevatorId;
+    int windowDuration;
+
+    MaintenanceCandidate score(ElevatorSimulation &candidate, int startTime) const;
+};
+
+#endif //MODULE10_ELEVATOR_MAINTENANCEPLANNER_H
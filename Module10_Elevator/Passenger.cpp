@@ -2,7 +2,7 @@
 
 Passenger::Passenger(int id, int start, int end, int time)
     : passengerId(id), startFloor(start), endFloor(end), startTime(time),
-      pickupTime(-1), deliveryTime(-1), pickedUp(false), delivered(false) { }
+      pickupTime(-1), deliveryTime(-1), servingElevator(-1), pickedUp(false), delivered(false) { }
 
 void Passenger::setPickedUp(int currentTime) { pickedUp = true; pickupTime = currentTime; }
 void Passenger::setDelivered(int currentTime) { delivered = true; deliveryTime = currentTime; }
@@ -18,12 +18,14 @@ public:
     int getStartTime() const { return startTime; }
     int getPickupTime() const { return pickupTime; }
     int getDeliveryTime() const { return deliveryTime; }
+    int getServingElevator() const { return servingElevator; }
     bool isPickedUp() const { return pickedUp; }
     bool isDelivered() const { return delivered; }
 
     // Setters
     void setPickedUp(int currentTime);
     void setDelivered(int currentTime);
+    void setServingElevator(int elevatorId) { servingElevator = elevatorId; }
 
     // Calculate metrics
     int getWaitTime() const;
@@ -36,6 +38,7 @@ private:
     int startTime;
     int pickupTime;
     int deliveryTime;
+    int servingElevator;
     bool pickedUp;
     bool delivered;
 };
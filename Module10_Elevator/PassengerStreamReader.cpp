@@ -0,0 +1,126 @@
+#include "PassengerStreamReader.h"
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+
+PassengerStreamReader::PassengerStreamReader(const std::string &filename, size_t blockSize)
+    : file(filename), filename(filename), blockSize(blockSize), frontIndex(0), frontIsLast(false), backReady(false),
+      backIsLast(false), stopping(false), nextPassengerId(0), lastStartTime(0), lineNumber(0) {
+
+    // Check if file opened successfully
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file: check path or permissions '" + filename + "'");
+    }
+
+    // Skip header
+    std::string line;
+    std::getline(file, line);
+    lineNumber++;
+
+    front.reserve(blockSize);
+    back.reserve(blockSize);
+    reader = std::thread(&PassengerStreamReader::readerLoop, this);
+}
+
+
+PassengerStreamReader::~PassengerStreamReader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    reader.join();
+}
+
+
+PassengerRecord PassengerStreamReader::parseLine(const std::string &line, int passengerId) {
+    // Use getline with comma delimiter to properly parse CSV
+    std::stringstream ss(line);
+    std::string startTimeStr, startFloorStr, endFloorStr;
+
+    std::getline(ss, startTimeStr, ',');
+    std::getline(ss, startFloorStr, ',');
+    std::getline(ss, endFloorStr, ',');
+
+    return {passengerId, std::stoi(startTimeStr), std::stoi(startFloorStr) - 1, std::stoi(endFloorStr) - 1};
+}
+
+
+const PassengerRecord *PassengerStreamReader::peek() {
+    while (frontIndex >= front.size()) {
+        if (frontIsLast) { return nullptr; }
+
+        // Take the block the reader thread prefetched and hand the drained one back to it
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this]() { return backReady || readerError; });
+        if (readerError) { std::rethrow_exception(readerError); }
+
+        std::swap(front, back);
+        frontIndex = 0;
+        frontIsLast = backIsLast;
+        backReady = false;
+        lock.unlock();
+        condition.notify_all();
+    }
+    return &front[frontIndex];
+}
+
+
+void PassengerStreamReader::readerLoop() {
+    try {
+        bool endOfFile = false;
+        while (!endOfFile) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]() { return !backReady || stopping; });
+                if (stopping) { return; }
+            }
+
+            // The consumer does not touch back until backReady is set, so it is filled without the lock
+            endOfFile = fillBlock(back);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                backReady = true;
+                backIsLast = endOfFile;
+            }
+            condition.notify_all();
+        }
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            readerError = std::current_exception();
+        }
+        condition.notify_all();
+    }
+}
+
+
+bool PassengerStreamReader::fillBlock(std::vector<PassengerRecord> &block) {
+    block.clear();
+    std::string line;
+
+    while (block.size() < blockSize) {
+        if (!std::getline(file, line)) { return true; }
+        lineNumber++;
+        if (line.empty()) continue;
+
+        PassengerRecord record{};
+        try {
+            record = parseLine(line, nextPassengerId);
+        } catch (const std::exception &e) {
+            std::cerr << "Error parsing line: " << line << " (" << e.what() << ")";
+            continue;
+        }
+
+        if (record.startTime < lastStartTime) {
+            throw std::runtime_error("Passenger trace '" + filename + "' is not sorted by start time at line " +
+                                     std::to_string(lineNumber));
+        }
+        lastStartTime = record.startTime;
+        nextPassengerId++;
+        block.push_back(record);
+    }
+    return false;
+}
@@ -0,0 +1,74 @@
+#ifndef MODULE10_ELEVATOR_PASSENGERSTREAMREADER_H
+#define MODULE10_ELEVATOR_PASSENGERSTREAMREADER_H
+
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One row of the passenger trace, floors already converted to 0-based
+struct PassengerRecord {
+    int passengerId;
+    int startTime;
+    int startFloor;
+    int endFloor;
+};
+
+/**
+ * Reads a passenger trace lazily for traces that do not fit in memory.
+ *
+ * A background thread parses the next block of rows while the simulation consumes the current one (double
+ * buffering), so memory is bounded by two blocks no matter how long the trace is. The trace must be sorted by
+ * start time, an out-of-order row is reported as an error instead of silently delaying passengers.
+ */
+class PassengerStreamReader {
+public:
+    static const size_t DEFAULT_BLOCK_SIZE = 1 << 16;
+
+    explicit PassengerStreamReader(const std::string &filename, size_t blockSize = DEFAULT_BLOCK_SIZE);
+    ~PassengerStreamReader();
+
+    PassengerStreamReader(const PassengerStreamReader &) = delete;
+    PassengerStreamReader &operator=(const PassengerStreamReader &) = delete;
+
+    // Next passenger in start time order, nullptr once the trace is exhausted
+    const PassengerRecord *peek();
+    void pop() { frontIndex++; }
+    bool exhausted() { return peek() == nullptr; }
+
+    // Parses "Start Time(s),Start Floor,End Floor", throws on malformed input
+    static PassengerRecord parseLine(const std::string &line, int passengerId);
+
+private:
+    std::ifstream file;
+    std::string filename;
+    size_t blockSize;
+
+    // front is owned by the consumer, back by the reader thread until backReady is set
+    std::vector<PassengerRecord> front;
+    std::vector<PassengerRecord> back;
+    size_t frontIndex;
+    bool frontIsLast;
+    bool backReady;
+    bool backIsLast;
+    bool stopping;
+    std::exception_ptr readerError;
+
+    int nextPassengerId;
+    int lastStartTime;
+    long lineNumber;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::thread reader;
+
+    void readerLoop();
+    bool fillBlock(std::vector<PassengerRecord> &block);
+};
+
+#endif //MODULE10_ELEVATOR_PASSENGERSTREAMREADER_H
@@ -0,0 +1,142 @@
+#ifndef MODULE10_ELEVATOR_TRACING_H
+#define MODULE10_ELEVATOR_TRACING_H
+
+
+// Tracing.h
+#pragma once
+
+/**
+ * Opt-in hot-path tracing, enabled with -DELEVATOR_ENABLE_TRACING=ON in CMake.
+ *
+ *   TRACE_INIT("Trace.json");        // once at boot, the file is written when the program exits
+ *   TRACE_ZONE("updateSimulation");  // times the enclosing scope
+ *
+ * The output is Chrome trace-event JSON, open it offline at ui.perfetto.dev or chrome://tracing.
+ * Without ELEVATOR_ENABLE_TRACING both macros expand to nothing.
+ */
+#ifdef ELEVATOR_ENABLE_TRACING
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+class Tracer {
+public:
+    struct Event {
+        const char *name;
+        int argument;
+        double startMicros;
+        double durationMicros;
+    };
+
+    // Per-thread buffer so recording an event never takes a lock
+    struct ThreadBuffer {
+        int threadId;
+        std::vector<Event> events;
+    };
+
+    ~Tracer() { write(); }
+
+    static Tracer &get() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    void init(const std::string &traceFile) {
+        std::lock_guard<std::mutex> lock(mutex);
+        fileName = traceFile;
+    }
+
+    double nowMicros() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    void record(const char *name, int argument, double startMicros, double durationMicros) {
+        thread_local ThreadBuffer *buffer = registerThread();
+        buffer->events.push_back({name, argument, startMicros, durationMicros});
+    }
+
+private:
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    std::mutex mutex;
+    std::string fileName;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+    Tracer() = default;
+
+    ThreadBuffer *registerThread() {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffers.push_back(std::make_unique<ThreadBuffer>());
+        buffers.back()->threadId = int(buffers.size());
+        buffers.back()->events.reserve(1 << 16);
+        return buffers.back().get();
+    }
+
+    void write() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fileName.empty()) { return; }
+
+        std::ofstream file(fileName, std::ios::trunc);
+        if (!file.is_open()) { return; }
+
+        // Complete ("X") events, timestamps and durations in microseconds. Fixed notation with nanosecond
+        // decimals: the default 6 significant digits would round late timestamps to tens of microseconds
+        file << std::fixed << std::setprecision(3);
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        for (const auto &buffer: buffers) {
+            for (const Event &event: buffer->events) {
+                file << (first ? "\n" : ",\n")
+                     << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+                     << ",\"ts\":" << event.startMicros << ",\"dur\":" << event.durationMicros;
+                if (event.argument >= 0) { file << ",\"args\":{\"id\":" << event.argument << "}"; }
+                file << "}";
+                first = false;
+            }
+        }
+        file << "\n]}\n";
+    }
+};
+
+
+class TraceZone {
+public:
+    explicit TraceZone(const char *name, int argument = -1)
+        : name(name), argument(argument), startMicros(Tracer::get().nowMicros()) { }
+
+    ~TraceZone() {
+        Tracer &tracer = Tracer::get();
+        tracer.record(name, argument, startMicros, tracer.nowMicros() - startMicros);
+    }
+
+    TraceZone(const TraceZone &) = delete;
+    TraceZone &operator=(const TraceZone &) = delete;
+
+private:
+    const char *name;
+    int argument;
+    double startMicros;
+};
+
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#define TRACE_INIT(traceFile) Tracer::get().init(traceFile)
+#define TRACE_ZONE(...) TraceZone TRACE_CONCAT(traceZone, __LINE__)(__VA_ARGS__)
+
+#else
+
+#define TRACE_INIT(traceFile) ((void)0)
+#define TRACE_ZONE(...) ((void)0)
+
+#endif
+
+
+#endif //MODULE10_ELEVATOR_TRACING_H
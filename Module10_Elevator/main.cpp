@@ -1,12 +1,16 @@
 #include <iomanip>
 #include <iostream>
 #include "ElevatorSimulation.h"
+#include "MaintenancePlanner.h"
 
 #include "Logger.h"
+#include "Tracing.h"
 #include <boost/log/trivial.hpp>
 
 
-int main() {
+// Usage: Module10_Elevator                      runs the 10s vs 5s per-floor comparison on Elevators.csv
+//        Module10_Elevator --stream <trace>     streams a time-sorted trace that does not fit in memory
+int main(int argc, char *argv[]) {
     const int FLOOR_TRAVEL_TIME_SIM_ONE = 10;
     const int FLOOR_TRAVEL_TIME_SIM_TWO = 5;
 
@@ -15,9 +19,34 @@ int main() {
 
     const std::string CSV_FILE = "Elevators.csv";
     const std::string LOG_FILE = "Log.txt";
+    const std::string TRACE_FILE = "Trace.json";
+    const std::string RESULTS_FILE_SIM_ONE = "Simulation1_Results.ecol";
+    const std::string RESULTS_FILE_SIM_TWO = "Simulation2_Results.ecol";
+    const std::string RESULTS_FILE_STREAM = "Stream_Results.ecol";
+    const int STREAM_STATUS_INTERVAL = 3600;
+
+    const std::string FAULT_FILE = "Faults.csv";
+    const unsigned int FAULT_SEED = 42;
+    const int MAINTENANCE_ELEVATOR = 0;
+    const int MAINTENANCE_WINDOW = 1800;
+    const int MAINTENANCE_SEARCH_STEP = 60;
 
     try {
         Logger::init(LOG_FILE);
+        TRACE_INIT(TRACE_FILE);
+
+        if (argc == 3 && std::string(argv[1]) == "--stream") {
+            BOOST_LOG_TRIVIAL(info) << "=====================================";
+            BOOST_LOG_TRIVIAL(info) << "STREAMING SIMULATION: " << argv[2];
+            BOOST_LOG_TRIVIAL(info) << "=====================================\n\n";
+            ElevatorSimulation streamSimulation(FLOOR_TRAVEL_TIME_SIM_ONE);
+            streamSimulation.openPassengerStream(argv[2]);
+            streamSimulation.streamResultsTo(RESULTS_FILE_STREAM);
+            streamSimulation.setStatusInterval(STREAM_STATUS_INTERVAL);
+            streamSimulation.run();
+            streamSimulation.printResults("Streaming results (" + SIM_ONE + "seconds per-floor )");
+            return 0;
+        }
 
         BOOST_LOG_TRIVIAL(info) << "=====================================";
         BOOST_LOG_TRIVIAL(info) << "SIMULATION 1: 10 seconds per floor (CURRENT)";
@@ -43,6 +72,10 @@ int main() {
         simulation1.printResults("Simulation 1 results (" + SIM_ONE + "seconds per-floor )");
         simulation2.printResults("Simulation 2 results (" + SIM_TWO + "seconds per-floor )");
 
+        // Per-passenger results for offline analysis
+        simulation1.exportResults(RESULTS_FILE_SIM_ONE);
+        simulation2.exportResults(RESULTS_FILE_SIM_TWO);
+
         // Store results from simulation 2
         double waitTime2 = simulation2.getAverageWaitTime();
         double travelTime2 = simulation2.getAverageTravelTime();
@@ -93,6 +126,36 @@ int main() {
         BOOST_LOG_TRIVIAL(info);
         BOOST_LOG_TRIVIAL(info) << "========================================================";
 
+        BOOST_LOG_TRIVIAL(info) << "=====================================";
+        BOOST_LOG_TRIVIAL(info) << "SIMULATION 3: FAULT SCHEDULE (" << FAULT_FILE << ")";
+        BOOST_LOG_TRIVIAL(info) << "=====================================\n\n";
+        ElevatorSimulation simulation3(FLOOR_TRAVEL_TIME_SIM_ONE);
+        simulation3.loadPassengersFromCSV(CSV_FILE);
+        simulation3.loadFaultSchedule(FAULT_FILE, FAULT_SEED);
+        simulation3.run();
+        simulation3.printResults("Simulation 3 results (" + SIM_ONE + "seconds per-floor, with faults )");
+        BOOST_LOG_TRIVIAL(info) << "Peak Wait Time: " << simulation3.getPeakWaitTime() << " seconds";
+
+        // Where should the next maintenance window go, given the same faults?
+        ElevatorSimulation planningBaseline(FLOOR_TRAVEL_TIME_SIM_ONE);
+        planningBaseline.loadPassengersFromCSV(CSV_FILE);
+        planningBaseline.loadFaultSchedule(FAULT_FILE, FAULT_SEED);
+
+        MaintenancePlanner planner(planningBaseline, MAINTENANCE_ELEVATOR, MAINTENANCE_WINDOW);
+        std::vector<MaintenanceCandidate> candidates =
+            planner.evaluate(1, int(simTime1) - MAINTENANCE_WINDOW, MAINTENANCE_SEARCH_STEP);
+        MaintenanceCandidate best = MaintenancePlanner::findBest(candidates);
+
+        BOOST_LOG_TRIVIAL(info) << "========================================================";
+        BOOST_LOG_TRIVIAL(info) << "MAINTENANCE WINDOW PLANNING";
+        BOOST_LOG_TRIVIAL(info) << "Elevator " << MAINTENANCE_ELEVATOR << ", " << MAINTENANCE_WINDOW << " second window";
+        BOOST_LOG_TRIVIAL(info) << "========================================================";
+        BOOST_LOG_TRIVIAL(info) << "  Candidates evaluated: " << candidates.size();
+        BOOST_LOG_TRIVIAL(info) << "  Best start time: " << best.startTime << "s";
+        BOOST_LOG_TRIVIAL(info) << "  Peak wait: " << best.peakWaitTime << " seconds";
+        BOOST_LOG_TRIVIAL(info) << "  Average wait: " << best.averageWaitTime << " seconds";
+        BOOST_LOG_TRIVIAL(info) << "========================================================";
+
     } catch (const std::exception &e) {
         BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
         return 1;
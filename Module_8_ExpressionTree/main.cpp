@@ -1,7 +1,16 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <vector>
 
 /**
  *      ===================================================================================================
@@ -25,6 +34,10 @@
  * Step 3:  Test the evaluate function to make sure it calculates correctly.
  * Step 4:  Set up the derivatives in each class based on the rules from the homework.
  * Step 5:  Test the derivative calculations
+ * Step 6:  Bind variables to slots so repeated evaluation reads a flat array instead of the symbol table
+ * Step 7:  Compile the tree to postfix bytecode and evaluate it with a loop instead of virtual calls
+ * Step 8:  Evaluate a compiled expression over whole columns of inputs at once, block by block, on several threads
+ * Step 9:  Simplify derivatives (constant folding, x * 1, x + 0, like terms) so repeated derivatives stay small
  *
  */
 
@@ -41,6 +54,268 @@
  *
  */
 
+/**
+ *  Resolves variable names to slots 0, 1, 2, ... once, so evaluate(env) reads env[slot] instead of
+ *  searching the symbol table by name for every variable in every evaluation.
+ */
+class SymbolSlots {
+    std::map<std::string, std::size_t> slots;
+
+public:
+    // The slot of name, a new one if name has not been seen yet
+    std::size_t slotOf(const std::string &name) {
+        std::map<std::string, std::size_t>::const_iterator it = slots.find(name);
+        if (it != slots.end()) { return it->second; }
+        std::size_t slot = slots.size();
+        slots.emplace(name, slot);
+        return slot;
+    }
+
+    std::size_t size() const { return slots.size(); }
+
+    // One value per slot taken from a symbol table, names missing from it are 0 like in Variable::evaluate()
+    std::vector<double> environment(const std::map<std::string, double> &table) const {
+        std::vector<double> env(slots.size(), 0.0);
+        for (std::map<std::string, std::size_t>::const_iterator it = slots.begin(); it != slots.end(); ++it) {
+            std::map<std::string, double>::const_iterator value = table.find(it->first);
+            if (value != table.end()) { env[it->second] = value->second; }
+        }
+        return env;
+    }
+
+    // One input column per slot for Program::runBatch, every name must have a column (std::out_of_range if not)
+    std::vector<const double *> columns(const std::map<std::string, std::vector<double> > &table) const {
+        std::vector<const double *> columns(slots.size(), nullptr);
+        for (std::map<std::string, std::size_t>::const_iterator it = slots.begin(); it != slots.end(); ++it) {
+            columns[it->second] = table.at(it->first).data();
+        }
+        return columns;
+    }
+};
+
+
+/**
+ *  An expression compiled to postfix bytecode: constants and variables push a value, operators pop two and
+ *  push the result. run() is one loop over a flat array with a switch, instead of a virtual call per node and a
+ *  pointer chase per child; the stack depth is known after compiling, so it needs no bounds checks.
+ *
+ *      2.3 * Xray + Yellow   ->   CONSTANT 2.3, VARIABLE slot 0, MUL, VARIABLE slot 1, ADD
+ *                            ->   CONSTANT 2.3, MUL_VARIABLE slot 0, ADD_VARIABLE slot 1   (as emitted)
+ */
+class Program {
+public:
+    // OP_CONSTANT and OP_VARIABLE take their right operand from the instruction: OP + 4 and OP + 8
+    enum OpCode {
+        CONSTANT, VARIABLE,
+        ADD, SUB, MUL, DIV,
+        ADD_CONSTANT, SUB_CONSTANT, MUL_CONSTANT, DIV_CONSTANT,
+        ADD_VARIABLE, SUB_VARIABLE, MUL_VARIABLE, DIV_VARIABLE
+    };
+
+    struct Instruction {
+        OpCode op;
+        std::size_t slot;       // VARIABLE
+        double value;           // CONSTANT
+    };
+
+private:
+    std::vector<Instruction> code;
+    std::size_t depth;
+    std::size_t maxDepth;
+
+    void push(const Instruction &instruction, std::size_t newDepth) {
+        this->code.push_back(instruction);
+        this->depth = newDepth;
+        if (this->depth > this->maxDepth) { this->maxDepth = this->depth; }
+    }
+
+public:
+    Program() : depth(0), maxDepth(0) {
+    }
+
+    void emitConstant(double value) {
+        Instruction instruction = {CONSTANT, 0, value};
+        push(instruction, this->depth + 1);
+    }
+
+    void emitVariable(std::size_t slot) {
+        Instruction instruction = {VARIABLE, slot, 0.0};
+        push(instruction, this->depth + 1);
+    }
+
+    // Pops the two operands, pushes the result (ADD, SUB, MUL or DIV). A constant or variable right operand
+    // was the last instruction emitted: it is folded into this one instead of being pushed and popped
+    void emitOperator(OpCode op) {
+        Instruction &last = this->code.back();
+        if (last.op == CONSTANT || last.op == VARIABLE) {
+            last.op = static_cast<OpCode>(op + (last.op == CONSTANT ? 4 : 8));
+            this->depth--;
+            return;
+        }
+        Instruction instruction = {op, 0, 0.0};
+        push(instruction, this->depth - 1);
+    }
+
+    std::size_t size() const { return this->code.size(); }
+
+    // Evaluates the program with variables read from env[slot]. Safe to call from many threads at once
+    double run(const double *env) const {
+        if (this->code.empty()) { return 0; }
+        if (this->maxDepth > SMALL_STACK) {
+            std::vector<double> stack(this->maxDepth);
+            return execute(env, stack.data());
+        }
+        double stack[SMALL_STACK];
+        return execute(env, stack);
+    }
+
+    /**
+     *  result[row] = the expression with every variable read from columns[slot][row], for rows [0, rows).
+     *  Rows go through in blocks of BATCH_BLOCK: each instruction runs over the whole block in a loop the
+     *  compiler vectorizes, so one dispatch is shared by BATCH_BLOCK rows. Batches of at least PARALLEL_ROWS
+     *  are split across up to `threads` threads (0: one per core), the calling thread takes a share too.
+     */
+    void runBatch(const double *const *columns, std::size_t rows, double *result, unsigned threads = 0) const {
+        if (threads == 0) { threads = std::max(1u, std::thread::hardware_concurrency()); }
+        const std::size_t blocks = (rows + BATCH_BLOCK - 1) / BATCH_BLOCK;
+        const std::size_t parts = rows < PARALLEL_ROWS ? 1 : std::min<std::size_t>(threads, blocks);
+
+        // Part p gets a contiguous run of whole blocks, the caller runs part 0
+        std::vector<std::thread> workers;
+        for (std::size_t part = 1; part < parts; part++) {
+            const std::size_t begin = blocks * part / parts * BATCH_BLOCK;
+            const std::size_t end = std::min(rows, blocks * (part + 1) / parts * BATCH_BLOCK);
+            workers.push_back(std::thread(&Program::runRows, this, columns, begin, end, result));
+        }
+        runRows(columns, 0, std::min(rows, blocks / parts * BATCH_BLOCK), result);
+        for (std::size_t i = 0; i < workers.size(); i++) { workers[i].join(); }
+    }
+
+    static const std::size_t BATCH_BLOCK = 256;
+    static const std::size_t PARALLEL_ROWS = 1 << 16;
+
+private:
+    static const std::size_t SMALL_STACK = 32;
+
+    // runBatch for rows [begin, end) on this thread, one block of values per stack entry
+    void runRows(const double *const *columns, std::size_t begin, std::size_t end, double *result) const {
+        if (this->code.empty()) {
+            std::fill(result + begin, result + end, 0.0);
+            return;
+        }
+        std::vector<double> stack(this->maxDepth * BATCH_BLOCK);
+        for (std::size_t row = begin; row < end; row += BATCH_BLOCK) {
+            const std::size_t count = std::min(BATCH_BLOCK, end - row);
+            const double *top = count == BATCH_BLOCK ? executeBlock<true>(columns, row, count, stack.data())
+                                                     : executeBlock<false>(columns, row, count, stack.data());
+            std::copy(top, top + count, result + row);
+        }
+    }
+
+    // target[j] = op(target[j], operand[j]), the operand never overlaps the target
+    template<typename Op>
+    static void combine(double *__restrict target, const double *__restrict operand, std::size_t count, Op op) {
+        for (std::size_t j = 0; j < count; j++) { target[j] = op(target[j], operand[j]); }
+    }
+
+    template<typename Op>
+    static void combine(double *__restrict target, double operand, std::size_t count, Op op) {
+        for (std::size_t j = 0; j < count; j++) { target[j] = op(target[j], operand); }
+    }
+
+    // Stack entry `index` of executeBlock, BATCH_BLOCK values each
+    static double *block(double *stack, std::size_t index) {
+        return stack + index * BATCH_BLOCK;
+    }
+
+    /**
+     *  Runs the program over rows [row, row + count), returns the block holding the results. FULL_BLOCK makes
+     *  the trip count the constant BATCH_BLOCK, which is what lets GCC vectorize these loops at -O2 already.
+     */
+    template<bool FULL_BLOCK>
+    const double *executeBlock(const double *const *columns, std::size_t row, std::size_t count,
+                               double *stack) const {
+        const std::size_t n = FULL_BLOCK ? BATCH_BLOCK : count;
+        std::size_t depth = 0;      // blocks on the stack, the top one is block(stack, depth - 1)
+        for (std::size_t i = 0; i < this->code.size(); i++) {
+            const Instruction &instruction = this->code[i];
+            const double value = instruction.value;
+            const double *column = instruction.op == VARIABLE || instruction.op >= ADD_VARIABLE
+                                   ? columns[instruction.slot] + row : nullptr;
+            switch (instruction.op) {
+                case CONSTANT: std::fill(block(stack, depth), block(stack, depth) + n, value); depth++; break;
+                case VARIABLE: std::copy(column, column + n, block(stack, depth)); depth++; break;
+                case ADD: depth--; combine(block(stack, depth - 1), block(stack, depth), n, std::plus<double>()); break;
+                case SUB: depth--; combine(block(stack, depth - 1), block(stack, depth), n, std::minus<double>()); break;
+                case MUL: depth--; combine(block(stack, depth - 1), block(stack, depth), n, std::multiplies<double>()); break;
+                case DIV: depth--; combine(block(stack, depth - 1), block(stack, depth), n, std::divides<double>()); break;
+                case ADD_CONSTANT: combine(block(stack, depth - 1), value, n, std::plus<double>()); break;
+                case SUB_CONSTANT: combine(block(stack, depth - 1), value, n, std::minus<double>()); break;
+                case MUL_CONSTANT: combine(block(stack, depth - 1), value, n, std::multiplies<double>()); break;
+                case DIV_CONSTANT: combine(block(stack, depth - 1), value, n, std::divides<double>()); break;
+                case ADD_VARIABLE: combine(block(stack, depth - 1), column, n, std::plus<double>()); break;
+                case SUB_VARIABLE: combine(block(stack, depth - 1), column, n, std::minus<double>()); break;
+                case MUL_VARIABLE: combine(block(stack, depth - 1), column, n, std::multiplies<double>()); break;
+                case DIV_VARIABLE: combine(block(stack, depth - 1), column, n, std::divides<double>()); break;
+            }
+        }
+        return block(stack, depth - 1);
+    }
+
+    // The interpreter loop. With GCC or Clang every opcode jumps straight to the next one's handler (computed
+    // goto), so each handler gets its own branch history instead of all sharing the one switch branch
+    double execute(const double *env, double *stack) const {
+        const Instruction *instruction = this->code.data();
+        const Instruction *end = instruction + this->code.size();
+        double *top = stack;    // next free slot, the value on top is top[-1]
+#if defined(__GNUC__)
+        static void *const handlers[] = {
+            &&constant, &&variable, &&add, &&sub, &&mul, &&div,
+            &&addConstant, &&subConstant, &&mulConstant, &&divConstant,
+            &&addVariable, &&subVariable, &&mulVariable, &&divVariable
+        };
+#define NEXT() if (++instruction == end) { return top[-1]; } goto *handlers[instruction->op]
+        goto *handlers[instruction->op];
+    constant: *top++ = instruction->value; NEXT();
+    variable: *top++ = env[instruction->slot]; NEXT();
+    add: top[-2] += top[-1]; --top; NEXT();
+    sub: top[-2] -= top[-1]; --top; NEXT();
+    mul: top[-2] *= top[-1]; --top; NEXT();
+    div: top[-2] /= top[-1]; --top; NEXT();
+    addConstant: top[-1] += instruction->value; NEXT();
+    subConstant: top[-1] -= instruction->value; NEXT();
+    mulConstant: top[-1] *= instruction->value; NEXT();
+    divConstant: top[-1] /= instruction->value; NEXT();
+    addVariable: top[-1] += env[instruction->slot]; NEXT();
+    subVariable: top[-1] -= env[instruction->slot]; NEXT();
+    mulVariable: top[-1] *= env[instruction->slot]; NEXT();
+    divVariable: top[-1] /= env[instruction->slot]; NEXT();
+#undef NEXT
+#else
+        for (; instruction != end; ++instruction) {
+            switch (instruction->op) {
+                case CONSTANT: *top++ = instruction->value; break;
+                case VARIABLE: *top++ = env[instruction->slot]; break;
+                case ADD: top[-2] += top[-1]; --top; break;
+                case SUB: top[-2] -= top[-1]; --top; break;
+                case MUL: top[-2] *= top[-1]; --top; break;
+                case DIV: top[-2] /= top[-1]; --top; break;
+                case ADD_CONSTANT: top[-1] += instruction->value; break;
+                case SUB_CONSTANT: top[-1] -= instruction->value; break;
+                case MUL_CONSTANT: top[-1] *= instruction->value; break;
+                case DIV_CONSTANT: top[-1] /= instruction->value; break;
+                case ADD_VARIABLE: top[-1] += env[instruction->slot]; break;
+                case SUB_VARIABLE: top[-1] -= env[instruction->slot]; break;
+                case MUL_VARIABLE: top[-1] *= env[instruction->slot]; break;
+                case DIV_VARIABLE: top[-1] /= env[instruction->slot]; break;
+            }
+        }
+        return top[-1];
+#endif
+    }
+};
+
+
 /**
  * An abstract Node class that will be inherited from Constant and Variable
  *  Contains virtual functions for a destructor, evaluate(), toString(), and derivative()
@@ -55,17 +330,62 @@ public:
     // Using virtual functions so that every subclass will be able to implement these functions
     virtual double evaluate() const = 0;
 
+    // Same as evaluate() but variables read env[slot], only for a tree returned by bind()
+    virtual double evaluate(const double *env) const = 0;
+
+    // A copy of the tree with every variable given its slot. Nodes are shared between trees (derivatives reuse
+    // their operands), so the slots live in the copy and this tree is left as it was
+    virtual std::shared_ptr<Node> bind(SymbolSlots &slots) const = 0;
+
     // Allows the entire node to be printed out
     virtual std::string toString() const = 0;
 
-    // Calculates the derivative based on the operator rule
-    virtual std::shared_ptr<Node> derivative(const std::string &var) const = 0;
+    // Calculates the derivative based on the operator rule, exactly as the rule builds it
+    virtual std::shared_ptr<Node> rawDerivative(const std::string &var) const = 0;
+
+    // The derivative with simplify() applied, so (0) * x and x + (0) terms do not pile up
+    std::shared_ptr<Node> derivative(const std::string &var) const {
+        return rawDerivative(var)->simplify();
+    }
+
+    /**
+     *  An equivalent tree with constants folded, x * 1, x * 0, x + 0, x - 0, 0 / x and x / 1 removed and like
+     *  terms collected (2 * x + 3 * x becomes 5 * x). Like the derivative rules it treats values as finite, so
+     *  x * 0 is 0 even where evaluate() would give NaN.
+     */
+    virtual std::shared_ptr<Node> simplify() const = 0;
+
+    // True if other is the same expression, node for node
+    virtual bool equals(const Node &other) const = 0;
+
+    // Nodes evaluate() visits, a subtree shared by several parents counts once per parent
+    virtual std::size_t nodeCount() const {
+        return 1;
+    }
+
+    // Appends this subtree to program in postfix order, variables get their slots from slots
+    virtual void compile(Program &program, SymbolSlots &slots) const = 0;
+
+    // The whole tree as a Program, evaluate it with program.run(env) where env is laid out by slots.
+    // Overriding compile(program, slots) hides this, so every subclass that does has using Node::compile
+    Program compile(SymbolSlots &slots) const {
+        Program program;
+        compile(program, slots);
+        return program;
+    }
 
     // Note: Using C++ 11 so I can't use an inline declaration and initialization
     static std::shared_ptr<std::map<std::string, double> > symbolTable;
 };
 
 
+// Builders for simplify(): combine two simplified operands into a simplified node, defined after Div
+std::shared_ptr<Node> makeSum(const std::shared_ptr<Node> &left, const std::shared_ptr<Node> &right);
+std::shared_ptr<Node> makeDifference(const std::shared_ptr<Node> &left, const std::shared_ptr<Node> &right);
+std::shared_ptr<Node> makeProduct(const std::shared_ptr<Node> &left, const std::shared_ptr<Node> &right);
+std::shared_ptr<Node> makeQuotient(const std::shared_ptr<Node> &left, const std::shared_ptr<Node> &right);
+
+
 class Constant : public Node {
     double value;
 
@@ -77,11 +397,36 @@ public:
         return this->value;
     }
 
+    double evaluate(const double *) const override {
+        return this->value;
+    }
+
+    std::shared_ptr<Node> bind(SymbolSlots &) const override {
+        return std::make_shared<Constant>(this->value);
+    }
+
+    using Node::compile;
+
+    void compile(Program &program, SymbolSlots &) const override {
+        program.emitConstant(this->value);
+    }
+
+    double getValue() const { return this->value; }
+
     // Calculation for a constant for derivatives is 0
-    std::shared_ptr<Node> derivative(const std::string &var) const override {
+    std::shared_ptr<Node> rawDerivative(const std::string &var) const override {
         return std::make_shared<Constant>(0);
     }
 
+    std::shared_ptr<Node> simplify() const override {
+        return std::make_shared<Constant>(this->value);
+    }
+
+    bool equals(const Node &other) const override {
+        const Constant *constant = dynamic_cast<const Constant *>(&other);
+        return constant != nullptr && constant->value == this->value;
+    }
+
     std::string toString() const override { return "(" + std::to_string(this->value) + ")"; }
 };
 
@@ -89,8 +434,20 @@ public:
 class Variable : public Node {
     std::string name;
 
+    // Only a variable made by bind() has a slot
+    const std::size_t slot;
+    static const std::size_t UNBOUND = static_cast<std::size_t>(-1);
+
+    // Kept out of evaluate(env) so the check costs a compare and a branch
+    [[noreturn]] void throwUnbound() const {
+        throw std::logic_error("Variable " + this->name + " has no slot, evaluate the tree bind() returned");
+    }
+
 public:
-    explicit Variable(const std::string &name) : name(name) {
+    explicit Variable(const std::string &name) : name(name), slot(UNBOUND) {
+    }
+
+    Variable(const std::string &name, std::size_t slot) : name(name), slot(slot) {
     }
 
     double evaluate() const override {
@@ -102,12 +459,36 @@ public:
         return 0;
     }
 
+    double evaluate(const double *env) const override {
+        if (this->slot == UNBOUND) { throwUnbound(); }
+        return env[this->slot];
+    }
+
+    std::shared_ptr<Node> bind(SymbolSlots &slots) const override {
+        return std::make_shared<Variable>(this->name, slots.slotOf(this->name));
+    }
+
+    using Node::compile;
+
+    void compile(Program &program, SymbolSlots &slots) const override {
+        program.emitVariable(slots.slotOf(this->name));
+    }
+
     // If there is a variable, it will either be a 1 or a 0
-    std::shared_ptr<Node> derivative(const std::string &var) const override {
+    std::shared_ptr<Node> rawDerivative(const std::string &var) const override {
         if (name == var) { return std::make_shared<Constant>(1.0); }
         return std::make_shared<Constant>(0.0);
     }
 
+    std::shared_ptr<Node> simplify() const override {
+        return std::make_shared<Variable>(this->name);
+    }
+
+    bool equals(const Node &other) const override {
+        const Variable *variable = dynamic_cast<const Variable *>(&other);
+        return variable != nullptr && variable->name == this->name;
+    }
+
     std::string toString() const override { return "(" + this->name + ")"; }
 };
 
@@ -121,6 +502,28 @@ protected:
 public:
     Operator(const std::shared_ptr<Node> &left, const std::shared_ptr<Node> &right) : left(left), right(right) {
     }
+
+    const std::shared_ptr<Node> &getLeft() const { return this->left; }
+    const std::shared_ptr<Node> &getRight() const { return this->right; }
+
+    // Same operator class with equal operands
+    bool equals(const Node &other) const override {
+        if (typeid(*this) != typeid(other)) { return false; }
+        const Operator &operation = static_cast<const Operator &>(other);
+        return this->left->equals(*operation.left) && this->right->equals(*operation.right);
+    }
+
+    std::size_t nodeCount() const override {
+        return 1 + this->left->nodeCount() + this->right->nodeCount();
+    }
+
+    using Node::compile;
+
+    // Compiles left then right, each subclass appends its own opcode after them
+    void compileOperands(Program &program, SymbolSlots &slots) const {
+        this->left->compile(program, slots);
+        this->right->compile(program, slots);
+    }
 };
 
 
@@ -133,12 +536,31 @@ public:
         return this->left->evaluate() + this->right->evaluate();
     }
 
-    std::shared_ptr<Node> derivative(const std::string &var) const override {
-        std::shared_ptr<Node> du = left->derivative(var);
-        std::shared_ptr<Node> dv = right->derivative(var);
+    double evaluate(const double *env) const override {
+        return this->left->evaluate(env) + this->right->evaluate(env);
+    }
+
+    std::shared_ptr<Node> bind(SymbolSlots &slots) const override {
+        return std::make_shared<Add>(this->left->bind(slots), this->right->bind(slots));
+    }
+
+    using Node::compile;
+
+    void compile(Program &program, SymbolSlots &slots) const override {
+        compileOperands(program, slots);
+        program.emitOperator(Program::ADD);
+    }
+
+    std::shared_ptr<Node> rawDerivative(const std::string &var) const override {
+        std::shared_ptr<Node> du = left->rawDerivative(var);
+        std::shared_ptr<Node> dv = right->rawDerivative(var);
         return std::make_shared<Add>(du, dv);
     }
 
+    std::shared_ptr<Node> simplify() const override {
+        return makeSum(this->left->simplify(), this->right->simplify());
+    }
+
     std::string toString() const override {
         return "(" + this->left->toString() + " + " + this->right->toString() + ")";
     }
@@ -154,12 +576,31 @@ public:
         return this->left->evaluate() - this->right->evaluate();
     }
 
-    std::shared_ptr<Node> derivative(const std::string &var) const override {
-        std::shared_ptr<Node> du = left->derivative(var);
-        std::shared_ptr<Node> dv = right->derivative(var);
+    double evaluate(const double *env) const override {
+        return this->left->evaluate(env) - this->right->evaluate(env);
+    }
+
+    std::shared_ptr<Node> bind(SymbolSlots &slots) const override {
+        return std::make_shared<Sub>(this->left->bind(slots), this->right->bind(slots));
+    }
+
+    using Node::compile;
+
+    void compile(Program &program, SymbolSlots &slots) const override {
+        compileOperands(program, slots);
+        program.emitOperator(Program::SUB);
+    }
+
+    std::shared_ptr<Node> rawDerivative(const std::string &var) const override {
+        std::shared_ptr<Node> du = left->rawDerivative(var);
+        std::shared_ptr<Node> dv = right->rawDerivative(var);
         return std::make_shared<Sub>(du, dv);
     }
 
+    std::shared_ptr<Node> simplify() const override {
+        return makeDifference(this->left->simplify(), this->right->simplify());
+    }
+
     std::string toString() const override {
         return "(" + this->left->toString() + " - " + this->right->toString() + ")";
     }
@@ -175,9 +616,24 @@ public:
         return this->left->evaluate() * this->right->evaluate();
     }
 
-    std::shared_ptr<Node> derivative(const std::string &var) const override {
-        std::shared_ptr<Node> du = left->derivative(var);
-        std::shared_ptr<Node> dv = right->derivative(var);
+    double evaluate(const double *env) const override {
+        return this->left->evaluate(env) * this->right->evaluate(env);
+    }
+
+    std::shared_ptr<Node> bind(SymbolSlots &slots) const override {
+        return std::make_shared<Mul>(this->left->bind(slots), this->right->bind(slots));
+    }
+
+    using Node::compile;
+
+    void compile(Program &program, SymbolSlots &slots) const override {
+        compileOperands(program, slots);
+        program.emitOperator(Program::MUL);
+    }
+
+    std::shared_ptr<Node> rawDerivative(const std::string &var) const override {
+        std::shared_ptr<Node> du = left->rawDerivative(var);
+        std::shared_ptr<Node> dv = right->rawDerivative(var);
 
         std::shared_ptr<Node> leftDu = std::make_shared<Mul>(left, dv);
         std::shared_ptr<Node> rightDv = std::make_shared<Mul>(right, du);
@@ -185,6 +641,10 @@ public:
         return std::make_shared<Add>(leftDu, rightDv);
     }
 
+    std::shared_ptr<Node> simplify() const override {
+        return makeProduct(this->left->simplify(), this->right->simplify());
+    }
+
     std::string toString() const override {
         return "(" + this->left->toString() + " * " + this->right->toString() + ")";
     }
@@ -200,10 +660,25 @@ public:
         return this->left->evaluate() / this->right->evaluate();
     }
 
+    double evaluate(const double *env) const override {
+        return this->left->evaluate(env) / this->right->evaluate(env);
+    }
 
-    std::shared_ptr<Node> derivative(const std::string &var) const override {
-        std::shared_ptr<Node> du = left->derivative(var);
-        std::shared_ptr<Node> dv = right->derivative(var);
+    std::shared_ptr<Node> bind(SymbolSlots &slots) const override {
+        return std::make_shared<Div>(this->left->bind(slots), this->right->bind(slots));
+    }
+
+    using Node::compile;
+
+    void compile(Program &program, SymbolSlots &slots) const override {
+        compileOperands(program, slots);
+        program.emitOperator(Program::DIV);
+    }
+
+
+    std::shared_ptr<Node> rawDerivative(const std::string &var) const override {
+        std::shared_ptr<Node> du = left->rawDerivative(var);
+        std::shared_ptr<Node> dv = right->rawDerivative(var);
         std::shared_ptr<Node> numerator = std::make_shared<Sub>(
             std::make_shared<Mul>(right, du),
             std::make_shared<Mul>(left, dv)
@@ -212,15 +687,121 @@ public:
         return std::make_shared<Div>(numerator, denominator);
     }
 
+    std::shared_ptr<Node> simplify() const override {
+        return makeQuotient(this->left->simplify(), this->right->simplify());
+    }
+
     std::string toString() const override {
         return "(" + this->left->toString() + " / " + this->right->toString() + ")";
     }
 };
 
 
+// value = the constant's value if node is a Constant
+bool constantValue(const std::shared_ptr<Node> &node, double &value) {
+    const Constant *constant = dynamic_cast<const Constant *>(node.get());
+    if (constant != nullptr) { value = constant->getValue(); }
+    return constant != nullptr;
+}
+
+// Splits node into coefficient * base: (c * x) gives c and x, anything else 1 and itself. makeProduct keeps
+// constants on the left, so this finds every simplified term with a coefficient
+void splitTerm(const std::shared_ptr<Node> &node, double &coefficient, std::shared_ptr<Node> &base) {
+    const Mul *product = dynamic_cast<const Mul *>(node.get());
+    if (product != nullptr && constantValue(product->getLeft(), coefficient)) {
+        base = product->getRight();
+        return;
+    }
+    coefficient = 1;
+    base = node;
+}
+
+std::shared_ptr<Node> makeConstant(double value) {
+    return std::make_shared<Constant>(value);
+}
+
+std::shared_ptr<Node> makeSum(const std::shared_ptr<Node> &left, const std::shared_ptr<Node> &right) {
+    double a, b;
+    const bool leftConstant = constantValue(left, a), rightConstant = constantValue(right, b);
+    if (leftConstant && rightConstant) { return makeConstant(a + b); }
+    if (leftConstant && a == 0) { return right; }
+    if (rightConstant && b == 0) { return left; }
+
+    // a * x + b * x = (a + b) * x, and x + (-c * y) = x - c * y
+    std::shared_ptr<Node> leftBase, rightBase;
+    splitTerm(left, a, leftBase);
+    splitTerm(right, b, rightBase);
+    if (leftBase->equals(*rightBase)) { return makeProduct(makeConstant(a + b), leftBase); }
+    if (b < 0 && rightBase != right) { return makeDifference(left, makeProduct(makeConstant(-b), rightBase)); }
+
+    return std::make_shared<Add>(left, right);
+}
+
+std::shared_ptr<Node> makeDifference(const std::shared_ptr<Node> &left, const std::shared_ptr<Node> &right) {
+    double a, b;
+    const bool leftConstant = constantValue(left, a), rightConstant = constantValue(right, b);
+    if (leftConstant && rightConstant) { return makeConstant(a - b); }
+    if (rightConstant && b == 0) { return left; }
+    if (leftConstant && a == 0) { return makeProduct(makeConstant(-1), right); }
+
+    // a * x - b * x = (a - b) * x, and x - (-c * y) = x + c * y
+    std::shared_ptr<Node> leftBase, rightBase;
+    splitTerm(left, a, leftBase);
+    splitTerm(right, b, rightBase);
+    if (leftBase->equals(*rightBase)) { return makeProduct(makeConstant(a - b), leftBase); }
+    if (b < 0 && rightBase != right) { return makeSum(left, makeProduct(makeConstant(-b), rightBase)); }
+
+    return std::make_shared<Sub>(left, right);
+}
+
+std::shared_ptr<Node> makeProduct(const std::shared_ptr<Node> &left, const std::shared_ptr<Node> &right) {
+    double a, b;
+    const bool leftConstant = constantValue(left, a), rightConstant = constantValue(right, b);
+    if (leftConstant && rightConstant) { return makeConstant(a * b); }
+
+    // Constants go on the left, so like terms and nested coefficients are found in one place
+    if (rightConstant) { return makeProduct(right, left); }
+    if (leftConstant) {
+        if (a == 0) { return makeConstant(0); }
+        if (a == 1) { return right; }
+
+        // a * (b * x) = (a b) * x
+        std::shared_ptr<Node> base;
+        splitTerm(right, b, base);
+        if (base != right) { return makeProduct(makeConstant(a * b), base); }
+    }
+    return std::make_shared<Mul>(left, right);
+}
+
+std::shared_ptr<Node> makeQuotient(const std::shared_ptr<Node> &left, const std::shared_ptr<Node> &right) {
+    double a, b;
+    const bool leftConstant = constantValue(left, a), rightConstant = constantValue(right, b);
+    if (leftConstant && rightConstant) { return makeConstant(a / b); }
+    if (rightConstant && b == 1) { return left; }
+    if (leftConstant && a == 0) { return makeConstant(0); }
+    return std::make_shared<Div>(left, right);
+}
+
+
+
 // Static variable with a shared pointer has to be declared outside the class for defining and initializing in c++ 11
 std::shared_ptr<std::map<std::string, double> > Node::symbolTable = std::make_shared<std::map<std::string, double> >();
 
+// Same for the static constants that are passed by reference (std::min)
+const std::size_t Program::BATCH_BLOCK;
+const std::size_t Program::PARALLEL_ROWS;
+
+// Seconds since start, for the benchmark at the end of main
+double secondsSince(const std::chrono::steady_clock::time_point &start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Prints the size of var's derivative of node as the rules build it and after simplify()
+void printNodeCounts(const std::shared_ptr<Node> &node, const std::string &var) {
+    std::cout << "Nodes: " << node->rawDerivative(var)->nodeCount() << " before simplifying, "
+            << node->derivative(var)->nodeCount() << " after" << std::endl;
+}
+
 int main() {
     Node::symbolTable->emplace("Xray", 2.0);
     Node::symbolTable->emplace("Yellow", 3.0);
@@ -259,6 +840,7 @@ int main() {
     /*     Derivative Test One     */
     test1 = test1->derivative("Xray");
     std::cout << "Xray Derivative: " << test1->toString() << std::endl;
+    printNodeCounts(originalNode, "Xray");
     double derivativeResult = test1->evaluate();
     std::cout << "Derivative Result = " << derivativeResult << std::endl;
 
@@ -267,6 +849,7 @@ int main() {
     /*      Derivative Test Two    */
     test2 = test2->derivative("Yellow");
     std::cout << "Yellow Derivative: " << test2->toString() << std::endl;
+    printNodeCounts(originalNode, "Yellow");
     derivativeResult = test2->evaluate();
     std::cout << "Derivative Result = " << derivativeResult << std::endl;
 
@@ -275,6 +858,7 @@ int main() {
     /*      Derivative Test Three    */
     test3 = test3->derivative("Zebra");
     std::cout << "Zebra Derivative: " << test3->toString() << std::endl;
+    printNodeCounts(originalNode, "Zebra");
     derivativeResult = test3->evaluate();
     std::cout << "Derivative Result: = " << derivativeResult << std::endl;
 
@@ -283,6 +867,7 @@ int main() {
     /*      Derivative Test Four    */
     test4 = test4->derivative("Xray");
     std::cout << "Xray Derivative: " << test4->toString() << std::endl;
+    printNodeCounts(originalNode, "Xray");
     derivativeResult = test4->evaluate();
     std::cout << "Derivative Result: = " << derivativeResult << std::endl;
 
@@ -334,6 +919,135 @@ int main() {
     std::cout << "Zebra Derivative = " << testNode1->toString() << std::endl;
     std::cout << "Derivative Result = " << derivativeResult << std::endl;
 
+    std::cout << std::endl;
+
+    /*
+     *  =================================================
+     *        Repeated derivatives, raw vs simplified
+     * ==================================================
+     */
+    // Xray / (Yellow + Xray * Zebra): without simplifying, every quotient rule makes the tree five to seven times larger
+    std::shared_ptr<Node> rawDerivative = std::make_shared<Div>(
+        std::make_shared<Variable>("Xray"),
+        std::make_shared<Add>(
+            std::make_shared<Variable>("Yellow"),
+            std::make_shared<Mul>(
+                std::make_shared<Variable>("Xray"),
+                std::make_shared<Variable>("Zebra")
+            )
+        )
+    );
+    std::shared_ptr<Node> simplifiedDerivative = rawDerivative;
+    std::cout << "Order   Raw nodes   Simplified nodes   Raw result   Simplified result" << std::endl;
+    for (int order = 1; order <= 5; order++) {
+        rawDerivative = rawDerivative->rawDerivative("Xray");
+        simplifiedDerivative = simplifiedDerivative->derivative("Xray");
+        std::cout << std::setw(5) << order << std::setw(12) << rawDerivative->nodeCount()
+                << std::setw(19) << simplifiedDerivative->nodeCount()
+                << std::setw(13) << rawDerivative->evaluate() << std::setw(20) << simplifiedDerivative->evaluate()
+                << std::endl;
+    }
+
+    std::cout << std::endl;
+
+    /*
+     *  =================================================
+     *     Benchmark: symbol table vs slots vs bytecode
+     * ==================================================
+     */
+    // Evaluate the original expression with Xray changing every time, through the symbol table, through slots
+    // bound ahead of time and through the compiled program
+    const int evaluations = 2000000;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double mapChecksum = 0;
+    for (int i = 0; i < evaluations; i++) {
+        (*Node::symbolTable)["Xray"] = i * 1e-6;
+        mapChecksum += originalNode->evaluate();
+    }
+    double mapSeconds = secondsSince(start);
+
+    SymbolSlots slots;
+    const std::shared_ptr<Node> boundNode = originalNode->bind(slots);
+    std::vector<double> env = slots.environment(*Node::symbolTable);
+    const std::size_t xraySlot = slots.slotOf("Xray");
+
+    start = std::chrono::steady_clock::now();
+    double slotChecksum = 0;
+    for (int i = 0; i < evaluations; i++) {
+        env[xraySlot] = i * 1e-6;
+        slotChecksum += boundNode->evaluate(env.data());
+    }
+    double slotSeconds = secondsSince(start);
+
+    const Program program = originalNode->compile(slots);
+    start = std::chrono::steady_clock::now();
+    double programChecksum = 0;
+    for (int i = 0; i < evaluations; i++) {
+        env[xraySlot] = i * 1e-6;
+        programChecksum += program.run(env.data());
+    }
+    double programSeconds = secondsSince(start);
+    (*Node::symbolTable)["Xray"] = 2.0;
+
+    std::cout << std::fixed << std::setprecision(1)
+            << "Symbol table: " << evaluations / mapSeconds / 1e6 << " M evaluations/s" << std::endl
+            << "Slots:        " << evaluations / slotSeconds / 1e6 << " M evaluations/s ("
+            << mapSeconds / slotSeconds << "x)" << std::endl
+            << "Bytecode:     " << evaluations / programSeconds / 1e6 << " M evaluations/s ("
+            << mapSeconds / programSeconds << "x, " << program.size() << " instructions)" << std::endl
+            << "Checksums match: "
+            << (mapChecksum == slotChecksum && mapChecksum == programChecksum ? "yes" : "no") << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::endl;
+
+    /*
+     *  =================================================
+     *        Benchmark: row by row vs batch columns
+     * ==================================================
+     */
+    // The same expression over a table of inputs, one column per variable
+    const std::size_t rows = 2000000;
+    std::map<std::string, std::vector<double> > table;
+    std::vector<double> &xray = table["Xray"], &yellow = table["Yellow"], &zebra = table["Zebra"];
+    for (std::size_t i = 0; i < rows; i++) {
+        xray.push_back(i * 1e-6);
+        yellow.push_back(3.0 + (i % 100) * 0.01);
+        zebra.push_back(5.0 - (i % 7) * 0.5);
+    }
+    std::vector<double> rowResults(rows), batchResults(rows), parallelResults(rows);
+
+    start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < rows; i++) {
+        (*Node::symbolTable)["Xray"] = xray[i];
+        (*Node::symbolTable)["Yellow"] = yellow[i];
+        (*Node::symbolTable)["Zebra"] = zebra[i];
+        rowResults[i] = originalNode->evaluate();
+    }
+    double rowSeconds = secondsSince(start);
+    (*Node::symbolTable)["Xray"] = 2.0;
+    (*Node::symbolTable)["Yellow"] = 3.0;
+    (*Node::symbolTable)["Zebra"] = 5.0;
+
+    const std::vector<const double *> columns = slots.columns(table);
+    start = std::chrono::steady_clock::now();
+    program.runBatch(columns.data(), rows, batchResults.data(), 1);
+    double batchSeconds = secondsSince(start);
+
+    const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    start = std::chrono::steady_clock::now();
+    program.runBatch(columns.data(), rows, parallelResults.data(), threads);
+    double parallelSeconds = secondsSince(start);
+
+    std::cout << std::fixed << std::setprecision(1)
+            << "Row by row:            " << rows / rowSeconds / 1e6 << " M rows/s" << std::endl
+            << "Batch, 1 thread:       " << rows / batchSeconds / 1e6 << " M rows/s ("
+            << rowSeconds / batchSeconds << "x)" << std::endl
+            << "Batch, " << threads << " thread(s):    " << rows / parallelSeconds / 1e6
+            << " M rows/s (" << rowSeconds / parallelSeconds << "x)" << std::endl
+            << "Results match: " << (rowResults == batchResults && rowResults == parallelResults ? "yes" : "no")
+            << std::endl;
+    std::cout.unsetf(std::ios::fixed);
     std::cout << std::endl;
     return 0;
 }